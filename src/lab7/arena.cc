@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include "arena.hh"
+#include "error.hh"
+
+
+/* Set by compilation::bind(), see compilation.hh. */
+__thread arena *block_arena = NULL;
+
+
+
+/* Start allocating from a new chunk big enough for at least size bytes. */
+void arena::new_chunk(size_t size)
+{
+    if (size < ARENA_CHUNK_SIZE)
+        size = ARENA_CHUNK_SIZE;
+
+    // The header is padded so the memory after it stays aligned.
+    size_t header = (sizeof(arena_chunk) + ARENA_ALIGNMENT - 1) &
+        ~(ARENA_ALIGNMENT - 1);
+    arena_chunk *chunk = (arena_chunk *)malloc(header + size);
+    if (chunk == NULL)
+        fatal("arena::new_chunk(): out of memory");
+
+    chunk->prev = current;
+    chunk->size = size;
+    current = chunk;
+    next = (char *)chunk + header;
+    end = next + size;
+}
+
+
+
+/* Return size bytes of aligned memory. */
+void *arena::allocate(size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+    if (current == NULL || (size_t)(end - next) < size)
+        new_chunk(size);
+
+    void *result = next;
+    next += size;
+    return result;
+}
+
+
+
+/* Remember the current allocation point. */
+arena_mark arena::mark()
+{
+    arena_mark m;
+
+    m.chunk = current;
+    m.next = next;
+    return m;
+}
+
+
+
+/* Free everything that was allocated after a mark was taken. Chunks that
+   were started after it are given back to malloc; the chunk that was
+   current at the time is kept and allocation resumes where it left off. */
+void arena::release(arena_mark m)
+{
+    while (current != m.chunk)
+    {
+        arena_chunk *prev = current->prev;
+        free(current);
+        current = prev;
+    }
+
+    if (current == NULL)
+    {
+        next = end = NULL;
+        return;
+    }
+
+    size_t header = (sizeof(arena_chunk) + ARENA_ALIGNMENT - 1) &
+        ~(ARENA_ALIGNMENT - 1);
+    next = m.next;
+    end = (char *)current + header + current->size;
+}
+
+
+
+/* Free all the memory, leaving an empty arena. */
+void arena::release_all()
+{
+    arena_mark none = { NULL, NULL };
+
+    release(none);
+}
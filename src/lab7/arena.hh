@@ -0,0 +1,70 @@
+#ifndef __ARENA_HH__
+#define __ARENA_HH__
+
+
+#include <stddef.h>
+
+
+/* The size of the chunks an arena gets its memory in. Bigger requests get a
+   chunk of their own. */
+const size_t ARENA_CHUNK_SIZE = 64 * 1024;
+
+/* Everything handed out by an arena is aligned to this. */
+const size_t ARENA_ALIGNMENT = 16;
+
+
+/* A chunk of arena memory. The memory itself follows right after this
+   header. */
+class arena_chunk {
+public:
+    arena_chunk *prev;       // The chunk that was filled up before this one.
+    size_t       size;       // Bytes of memory following the header.
+};
+
+
+/* A point in an arena to release() back to. */
+class arena_mark {
+public:
+    arena_chunk *chunk;
+    char        *next;
+};
+
+
+/* An arena hands out memory with a simple bump pointer and gives it all
+   back at once, so it suits the many small objects that are created while
+   compiling a block and are useless once the block has been expanded to
+   assembler. Nothing is ever freed one object at a time, and no destructors
+   are run.
+
+   Note that the class has no constructor on purpose: zero-initialized
+   storage is a valid empty arena, and an arena that is a member of another
+   class is initialized with arena(). */
+class arena {
+private:
+    arena_chunk *current;    // The chunk being allocated from.
+    char        *next;       // The next free byte in it.
+    char        *end;        // The end of it.
+
+    void         new_chunk(size_t);
+
+public:
+    void        *allocate(size_t);           // Bump allocate some memory.
+    arena_mark   mark();                     // Remember the current point.
+    void         release(arena_mark);        // Free everything allocated
+                                             //   after the mark.
+    void         release_all();              // Free everything.
+};
+
+
+/* The arena for ASTs, quads and position information of the block being
+   compiled. parser.y gives each procedure and function an arena of its own,
+   which is freed when the backend is done with the block's quads, see
+   backend_pipeline::release(). The global level uses the program arena of
+   the compilation, which lives as long as the compilation does. The
+   pointer is per thread, since with -J a backend thread allocates quads in
+   the arena of the block it is working on, while the parser goes on with
+   the next one. Symbols are allocated in an arena that belongs to the
+   symbol table. */
+extern __thread arena *block_arena;   // Defined in arena.cc.
+
+#endif
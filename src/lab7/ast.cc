@@ -5,14 +5,16 @@
  *** The abstract AST classes - never used directly. ***
  *******************************************************/
 
-int ast_node::indent_level = 0;
-bool ast_node::branches[10000];
+__thread int ast_node::indent_level = 0;
+__thread bool ast_node::branches[10000];
+__thread long ast_node::nr_nodes = 0;
 
 /* The superclass ast_node. */
 ast_node::ast_node(position_information *p) :
     pos(p)
 {
     tag = AST_NODE;
+    nr_nodes++;
 }
 
 
@@ -100,7 +100,7 @@ enum ast_node_types { AST_NODE, AST_STATEMENT, AST_EXPRESSION,
 typedef enum ast_node_types ast_node_type;
 
 
-extern symbol_table *sym_tab;  // Defined in symtab.cc.
+extern __thread symbol_table *sym_tab;  // Defined in symtab.cc.
 
 
 /* Needed so we can refer to quad_list& as arguments. See below. */
@@ -170,9 +170,10 @@ class quad_list;
 /* Base class for all ast nodes. */
 class ast_node {
 protected:
-    // Used for AST printing.
-    static int indent_level;
-    static bool branches[10000];
+    // Used for AST printing. These are per thread, like the rest of the
+    // compiler's state, see compilation.hh.
+    static __thread int indent_level;
+    static __thread bool branches[10000];
 
     // All these methods are concerned with printing the AST.
     void indent(ostream&);
@@ -195,6 +196,14 @@ public:
     // Constructor. 
     ast_node(position_information *);
 
+    // Number of nodes created so far. Used by the profiler, see profile.cc.
+    static __thread long nr_nodes;
+
+    // AST nodes are allocated in the block arena, and are freed with it
+    // once their block has been handed to the backend. See arena.hh.
+    void *operator new(size_t size) { return block_arena->allocate(size); }
+    void operator delete(void *) {}
+
     // Perform type checking. See semantic.cc for the method bodies.
     // Note that it's an error to call type_check in this class. It should
     // only be called in the concrete AST nodes, see below.
@@ -2,27 +2,173 @@
 #include <iomanip>
 #include <fstream>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "symtab.hh"
 #include "quads.hh"
 #include "codegen.hh"
+#include "profile.hh"
 
 using namespace std;
 
 
 extern int assembler_trace; // Defined in main.cc.
+extern int no_optimize;     // Defined in main.cc.
 
-// Used in parser.y. Ideally the filename should be parametrized, but it's not
-// _that_ important...
-code_generator *code_gen = new code_generator("d.out");
+// Used in parser.y. Which backend this points to, and the file it writes
+// to, is decided in main.cc once the command line has been parsed. It is
+// per thread, like the rest of the compilation, see compilation.hh.
+__thread assembler_backend *code_gen = NULL;
 
 
-// Constructor.
-code_generator::code_generator(const char *object_file_name)
+
+/* Count how many times each of the temporaries of a block is read. Every
+   temporary that is written in the block gets an entry, even if it is
+   never read. The temporaries are the block's variables from first_temp
+   and up, see quads.cc. */
+void assembler_backend::count_temp_uses(quad_list *q_list, symbol *env,
+                                        map<sym_index, int> &uses)
+{
+    quadruple *q;
+    sym_index  ops[4];
+    int        n, i;
+
+    uses.clear();
+
+    quad_list_iterator *ql_iterator = new quad_list_iterator(q_list);
+    for (q = ql_iterator->get_current(); q != NULL; q = ql_iterator->get_next())
+    {
+        n = q->get_uses(ops);
+        ops[n++] = q->get_def();
+        for (i = 0; i < n; i++)
+        {
+            if (ops[i] == NULL_SYM)
+                continue;
+            symbol *sym = sym_tab->get_symbol(ops[i]);
+            if (sym->tag != SYM_VAR || sym->level != env->level + 1 ||
+                sym->offset < q_list->first_temp)
+                continue;
+            if (i < n - 1)
+                uses[ops[i]]++;
+            else
+                uses.insert(make_pair(ops[i], 0));
+        }
+    }
+    delete ql_iterator;
+}
+
+
+
+/* Returns true if q is a relation whose result is only used by next, a
+   q_jmpf. The backend can then compare and branch directly, without ever
+   computing the result. */
+bool assembler_backend::is_jump_on(quadruple *q, quadruple *next,
+                                   map<sym_index, int> &uses)
+{
+    switch (q->op_code)
+    {
+    case q_ieq:
+    case q_ine:
+    case q_ilt:
+    case q_igt:
+    case q_req:
+    case q_rne:
+    case q_rlt:
+    case q_rgt:
+        break;
+    default:
+        return false;
+    }
+
+    if (next == NULL || next->op_code != q_jmpf || next->sym2 != q->sym3)
+        return false;
+
+    map<sym_index, int>::iterator it = uses.find(q->sym3);
+    return it != uses.end() && it->second == 1;
+}
+
+
+
+/* Constructor. The file is unbuffered, since we do our own buffering and
+   want each chunk to go straight to the operating system. */
+assembler_file::assembler_file(const char *file_name)
+{
+    copy = NULL;
+    file.rdbuf()->pubsetbuf(NULL, 0);
+    file.open(file_name);
+    if (!file)
+    {
+        perror(file_name);
+        exit(1);
+    }
+}
+
+
+
+/* Constructor for a file that only collects code in memory. */
+assembler_file::assembler_file()
+{
+    copy = NULL;
+}
+
+
+
+/* Destructor. */
+assembler_file::~assembler_file()
+{
+    flush();
+    file.close();
+}
+
+
+
+/* Write out everything that has been collected so far. */
+void assembler_file::write_out()
 {
+    if (buffer.empty() || !file.is_open())
+        return;
+
+    file.write(buffer.data(), buffer.size());
+    profiler->count_output(buffer.size());
+    buffer.clear();
+}
 
-    out.open(object_file_name);
 
+
+/* Add some text, normally a whole block, to the file. */
+void assembler_file::write(const string &text)
+{
+    buffer += text;
+    if (copy != NULL)
+        *copy += text;
+    if (buffer.size() >= (unsigned)OUTPUT_CHUNK_SIZE)
+        write_out();
+}
+
+
+
+/* Make sure everything is written. */
+void assembler_file::flush()
+{
+    write_out();
+}
+
+
+
+/* Return everything collected so far, and start over. */
+string assembler_file::take()
+{
+    string text;
+
+    text.swap(buffer);
+    return text;
+}
+
+
+// Constructor.
+code_generator::code_generator(const char *object_file_name,
+                               bool whole_program)
+{
     // Initialize register array.
     strcpy(reg[static_cast<int>(o0)], "%o0");
     strcpy(reg[static_cast<int>(o1)], "%o1");
@@ -34,19 +180,49 @@ code_generator::code_generator(const char *object_file_name)
     strcpy(reg[static_cast<int>(f0)], "%f0");
     strcpy(reg[static_cast<int>(f1)], "%f1");
     strcpy(reg[static_cast<int>(f2)], "%f2");
+    strcpy(reg[static_cast<int>(l1)], "%l1");
+    strcpy(reg[static_cast<int>(l2)], "%l2");
+    strcpy(reg[static_cast<int>(l3)], "%l3");
+    strcpy(reg[static_cast<int>(l4)], "%l4");
+    strcpy(reg[static_cast<int>(l5)], "%l5");
+    strcpy(reg[static_cast<int>(l6)], "%l6");
+    strcpy(reg[static_cast<int>(l7)], "%l7");
+    strcpy(reg[static_cast<int>(i1)], "%i1");
+    strcpy(reg[static_cast<int>(i2)], "%i2");
+    strcpy(reg[static_cast<int>(i3)], "%i3");
+    strcpy(reg[static_cast<int>(i4)], "%i4");
+    strcpy(reg[static_cast<int>(i5)], "%i5");
+    strcpy(reg[static_cast<int>(l0)], "%l0");
+
+    if (object_file_name == NULL)
+        object_file = new assembler_file();
+    else
+        object_file = new assembler_file(object_file_name);
+    if (!whole_program)
+        return;
+
+    // The glue calls the main program by this name. It goes through cpp.
+    ostringstream main_label;
+    main_label << "#define diesel_main L" << MAIN_PROGRAM_LABEL << "\n";
+    object_file->write(main_label.str());
 
     // Contains the preinstalled diesel functions: read, write, trunc.
-    out << "#include \"diesel_glue.s\"" << endl;
+    object_file->write("#include \"diesel_glue.s\"\n");
 }
 
 
 
-/* Destructor. */
+/* Destructor. The file is written out by assembler_backend. */
 code_generator::~code_generator()
 {
-    // Make sure we close the outfile before exiting the compiler.
-    out << flush;
-    out.close();
+}
+
+
+
+/* A code generator of our own for a backend thread. */
+assembler_backend *code_generator::new_buffered()
+{
+    return new code_generator(NULL, false);
 }
 
 
@@ -56,9 +232,61 @@ code_generator::~code_generator()
    the symbol for the environment for which code is being generated. */
 void code_generator::generate_assembler(quad_list *q, symbol *env)
 {
+    // Decide which variables and temporaries live in registers. This has
+    // to be done before the prologue, which loads the parameters that got
+    // one.
+    home_reg.clear();
+    if (!no_register_allocation)
+        allocator.allocate(q, env, NR_ALLOCATABLE_REGISTERS, home_reg);
+    count_temp_uses(q, env, temp_uses);
+    find_constants(q);
+    find_frame(q, env);
+
+    out.str("");
     prologue(env);
     expand(q);
     epilogue(env);
+    flush_block(env);
+}
+
+
+
+/* The code for a block is collected in out. When the block is done, it is
+   handed to the peephole optimizer (unless optimization is turned off) and
+   then joined up again and written to the object file in one piece. */
+void code_generator::flush_block(symbol *env)
+{
+    vector<asm_line> lines;
+    string           text = out.str();
+    string::size_type start = 0, end;
+
+    while ((end = text.find('\n', start)) != string::npos)
+    {
+        lines.push_back(asm_line(text.substr(start, end - start)));
+        start = end + 1;
+    }
+    if (start < text.size())
+        lines.push_back(asm_line(text.substr(start)));
+
+    if (!no_optimize)
+    {
+        int removed = peephole.optimize(lines);
+        *log << "Peephole optimizer removed " << removed
+             << " instructions from \"" << sym_tab->pool_view(env->id)
+             << "\"" << endl;
+    }
+
+    text.clear();
+    for (unsigned i = 0; i < lines.size(); i++)
+    {
+        if (!lines[i].deleted)
+        {
+            text += lines[i].text;
+            text += '\n';
+        }
+    }
+    object_file->write(text);
+    out.str("");
 }
 
 
@@ -106,38 +334,82 @@ void code_generator::prologue(symbol *new_env)
         return;
     }
 
+    frame_size = ar_size;
+
     out << "L" << label_nr << ":" << "\t\t\t" << "! " <<
-        sym_tab->pool_lookup(new_env->id) << endl;
+        sym_tab->pool_view(new_env->id) << '\n';
 
     if (assembler_trace)
         out << "\t" << "! PROLOGUE (" << short_symbols << new_env
-            << long_symbols << ")" << endl;
+            << long_symbols << ")" << '\n';
 
     /* Your code here. */
 	
-	// Create the AR
-    out << "\t\t" << "set" << "\t" << -ar_size <<",%l0" << endl;
-    out << "\t\t" << "save" << "\t" << "%sp,%l0,%sp" << endl;
+    if (!leaf)
+    {
+        // Create the AR
+        out << "\t\t" << "set" << "\t" << -ar_size <<",%l0" << '\n';
+        out << "\t\t" << "save" << "\t" << "%sp,%l0,%sp" << '\n';
 
-    // Save display
-    out << "\t\t" << "st" << "\t" << "%g" << new_env->level + 1 << 
-    	",[%fp+" << DISPLAY_REG_OFFSET << "]" << endl;
+        if (keep_display)
+        {
+            // Save display
+            out << "\t\t" << "st" << "\t" << "%g" << new_env->level + 1 << 
+                ",[%fp+" << DISPLAY_REG_OFFSET << "]" << '\n';
 
-    // Update display
-    out << "\t\t" << "mov" << "\t" << "%fp,%g" << new_env->level + 1 << endl;
+            // Update display
+            out << "\t\t" << "mov" << "\t" << "%fp,%g" << new_env->level + 1 << '\n';
+        }
+    }
 
-    // Save the arguments
+    // Save the arguments. A leaf has no register window of its own, so they
+    // are still in the %o registers, and %sp is still the caller's.
     int current_addr = FIRST_ARG_OFFSET;
     int current_reg = 0;
     while (last_arg != NULL)
     {
-	    out << "\t\t" << "st" << "\t" << "%i" << current_reg << ",[%fp+" << current_addr << "]" << endl;
+	    out << "\t\t" << "st" << "\t" << (leaf ? "%o" : "%i") << current_reg
+	        << ",[" << (leaf ? "%sp" : "%fp") << "+" << current_addr << "]" << '\n';
 	    current_addr += 4;
 	    current_reg += 1;
 	    last_arg = last_arg->preceding;
     }
 
-    out << flush;
+    if (leaf)
+    {
+        // Create the AR, without a register window.
+        if (ar_size <= 4096)
+        {
+            out << "\t\t" << "add" << "\t" << "%sp," << -ar_size << ",%sp"
+                << '\n';
+        }
+        else
+        {
+            out << "\t\t" << "set" << "\t" << -ar_size << "," << reg[l0] << '\n';
+            out << "\t\t" << "add" << "\t" << "%sp," << reg[l0] << ",%sp" << '\n';
+        }
+    }
+
+    // Load the parameters that live in registers. All of the incoming
+    // arguments are safely on the stack by now.
+    for (map<sym_index, int>::iterator it = home_reg.begin();
+         it != home_reg.end(); it++)
+    {
+        if (it->second == NO_REGISTER)
+            continue;
+        if (assembler_trace)
+            out << "\t" << "! " << reg[l1 + it->second] << " = "
+                << short_symbols << sym_tab->get_symbol(it->first)
+                << long_symbols << '\n';
+        if (sym_tab->get_symbol_tag(it->first) == SYM_PARAM)
+        {
+            int level, offset;
+            find(it->first, &level, &offset);
+            string base = frame_base(level, &offset);
+            out << "\t\t" << "ld" << "\t" << "[" << base << "+" << offset
+                << "]," << reg[l1 + it->second] << '\n';
+        }
+    }
 }
 
 
@@ -149,18 +421,38 @@ void code_generator::epilogue(symbol *old_env)
 
     if (assembler_trace)
         out << "\t" << "! EPILOGUE (" << short_symbols << old_env
-            << long_symbols << ")" << endl;
+            << long_symbols << ")" << '\n';
     /* Your code here. */
+
+    if (leaf)
+    {
+        // Return, popping the AR in the delay slot.
+        if (frame_size <= 4095)
+        {
+            out << "\t\t" << "retl" << '\n';
+            out << "\t\t" << "add" << "\t" << "%sp," << frame_size << ",%sp"
+                << '\n';
+        }
+        else
+        {
+            out << "\t\t" << "set" << "\t" << frame_size << "," << reg[l0] << '\n';
+            out << "\t\t" << "add" << "\t" << "%sp," << reg[l0] << ",%sp" << '\n';
+            out << "\t\t" << "retl" << '\n';
+            out << "\t\t" << "nop" << '\n';
+        }
+        return;
+    }
 	
-	// Restore display
-    out << "\t\t" << "ld" << "\t" << 
-    	"[%fp+" << DISPLAY_REG_OFFSET << "]," << "%g" << old_env->level + 1 << endl;
+    if (keep_display)
+    {
+        // Restore display
+        out << "\t\t" << "ld" << "\t" << 
+            "[%fp+" << DISPLAY_REG_OFFSET << "]," << "%g" << old_env->level + 1 << '\n';
+    }
 
     // Return
-    out << "\t\t" << "ret" << endl;
-    out << "\t\t" << "restore" << endl;
-
-    out << flush;
+    out << "\t\t" << "ret" << '\n';
+    out << "\t\t" << "restore" << '\n';
 }
 
 
@@ -196,6 +488,335 @@ void code_generator::find(sym_index sym_p, int *level, int *offset)
 
 
 
+/* This function returns the register that variables at a display level are
+   addressed through. The block's own variables are addressed through its
+   frame pointer rather than the display register, which is then only needed
+   by the procedures nested in it. A leaf has no frame pointer of its own, so
+   its variables are addressed through %sp, and *offset is adjusted. */
+string code_generator::frame_base(int level, int *offset)
+{
+    if (level != frame_level)
+    {
+        ostringstream base;
+        base << "%g" << level;
+        return base.str();
+    }
+    if (!leaf)
+        return "%fp";
+    *offset += frame_size;
+    return "%sp";
+}
+
+
+
+/* Returns true if the code for a quad makes a call, and sets *nested if it
+   calls a procedure or function declared inside the block env. */
+bool code_generator::calls(quadruple *q, symbol *env, bool *nested)
+{
+    sym_index k_sym;
+
+    *nested = false;
+    switch (q->op_code)
+    {
+    case q_call:
+        *nested = sym_tab->get_symbol(q->sym1)->level > env->level;
+        return true;
+    case q_imult:
+    case q_idivide:
+    case q_imod:
+        // Mul, Div and Rem in diesel_glue.s are called unless this can be
+        // done with shifts or the V8 instructions.
+        return !sparc_v8 && power_of_two_operand(q, &k_sym) < 0;
+    default:
+        return false;
+    }
+}
+
+
+
+/* Decide what the prologue and epilogue of a block have to do. The display
+   register of the block is only read by the procedures nested in it, and
+   they can only run if the block itself calls one of them. If it doesn't,
+   keep_display is false and the display is neither saved, updated nor
+   restored.
+
+   A block that doesn't call anything at all, and whose variables fit in
+   LEAF_REGISTERS registers, is a leaf. It runs in the register window of
+   its caller, so there is no save and restore: its AR is made by moving
+   %sp, and it returns with retl. The registers are renamed to %o ones,
+   which the caller doesn't expect to survive a call anyway. */
+void code_generator::find_frame(quad_list *q_list, symbol *env)
+{
+    quadruple *q;
+    bool       nested;
+
+    frame_level = env->level + 1;
+    keep_display = false;
+    leaf = true;
+
+    quad_list_iterator *ql_iterator = new quad_list_iterator(q_list);
+    for (q = ql_iterator->get_current(); q != NULL; q = ql_iterator->get_next())
+    {
+        if (calls(q, env, &nested))
+        {
+            leaf = false;
+            if (nested)
+                keep_display = true;
+        }
+    }
+    delete ql_iterator;
+
+    for (map<sym_index, int>::iterator it = home_reg.begin();
+         it != home_reg.end(); it++)
+        if (it->second >= LEAF_REGISTERS)
+            leaf = false;
+
+    strcpy(reg[static_cast<int>(l0)], leaf ? "%o5" : "%l0");
+    strcpy(reg[static_cast<int>(i0)], leaf ? "%o0" : "%i0");
+    strcpy(reg[static_cast<int>(l1)], leaf ? "%o3" : "%l1");
+    strcpy(reg[static_cast<int>(l2)], leaf ? "%o4" : "%l2");
+}
+
+
+
+/* This function returns the register a symbol has been given by the register
+   allocator, or NO_REGISTER if it lives in memory. */
+int code_generator::home(sym_index sym_p)
+{
+    map<sym_index, int>::iterator it = home_reg.find(sym_p);
+
+    if (it == home_reg.end() || it->second == NO_REGISTER)
+        return NO_REGISTER;
+    return l1 + it->second;
+}
+
+
+
+/* Find the temporaries that are set once, by a q_iload, and so hold that
+   constant everywhere they are read. A temporary whose only uses are
+   multiplications and divisions that will be done by shifting, or operands
+   that become immediates, doesn't need to be loaded at all; those are put
+   in unneeded_loads. */
+void code_generator::find_constants(quad_list *q_list)
+{
+    map<sym_index, int> defs, reduced;
+    quadruple          *q;
+    sym_index           k_sym, ops[2];
+    int                 n;
+
+    constant_temps.clear();
+    unneeded_loads.clear();
+
+    quad_list_iterator *ql_iterator = new quad_list_iterator(q_list);
+    for (q = ql_iterator->get_current(); q != NULL; q = ql_iterator->get_next())
+    {
+        sym_index def = q->get_def();
+        if (temp_uses.find(def) == temp_uses.end())
+            continue;
+        if (++defs[def] == 1 && q->op_code == q_iload)
+            constant_temps[def] = q->int1;
+        else
+            constant_temps.erase(def);
+    }
+    delete ql_iterator;
+
+    // Count the uses that will disappear.
+    ql_iterator = new quad_list_iterator(q_list);
+    for (q = ql_iterator->get_current(); q != NULL; q = ql_iterator->get_next())
+    {
+        if (power_of_two_operand(q, &k_sym) >= 0)
+            reduced[k_sym]++;
+        n = immediate_operands(q, ops);
+        while (n > 0)
+            reduced[ops[--n]]++;
+    }
+    delete ql_iterator;
+
+    map<sym_index, int>::iterator it;
+    for (it = reduced.begin(); it != reduced.end(); it++)
+        if (constant_temps.find(it->first) != constant_temps.end() &&
+            temp_uses[it->first] == it->second)
+            unneeded_loads.insert(it->first);
+}
+
+
+
+/* If a symbol is an integer constant, or a temporary holding one, that is a
+   power of two, return its base 2 logarithm. Otherwise return -1. */
+int code_generator::power_of_two(sym_index sym_p)
+{
+    int value;
+
+    if (sym_p == NULL_SYM)
+        return -1;
+
+    symbol *sym = sym_tab->get_symbol(sym_p);
+    map<sym_index, int>::iterator it = constant_temps.find(sym_p);
+    if (it != constant_temps.end())
+        value = it->second;
+    else if (sym->tag == SYM_CONST && sym->type == integer_type)
+        value = sym->get_constant_symbol()->const_value.ival;
+    else
+        return -1;
+
+    if (value <= 0 || (value & (value - 1)) != 0)
+        return -1;
+
+    int k = 0;
+    while ((1 << k) != value)
+        k++;
+    return k;
+}
+
+
+
+/* If a q_imult, q_idivide or q_imod can be done with shifts and masks since
+   its (right, for division) operand is a power of two 2^k, set *k_sym to
+   that operand and return k. Otherwise return -1. */
+int code_generator::power_of_two_operand(quadruple *q, sym_index *k_sym)
+{
+    int k;
+
+    switch (q->op_code)
+    {
+    case q_imult:
+        if ((k = power_of_two(q->sym1)) >= 0)
+        {
+            *k_sym = q->sym1;
+            return k;
+        }
+        // Fall through.
+    case q_idivide:
+    case q_imod:
+        *k_sym = q->sym2;
+        return power_of_two(q->sym2);
+    default:
+        return -1;
+    }
+}
+
+
+
+/* If a symbol is an integer constant, or a temporary holding one, that fits
+   in the 13 bit signed immediate field of an instruction, set *value to it
+   and return true. */
+bool code_generator::immediate(sym_index sym_p, int *value)
+{
+    if (sym_p == NULL_SYM)
+        return false;
+
+    symbol *sym = sym_tab->get_symbol(sym_p);
+    map<sym_index, int>::iterator it = constant_temps.find(sym_p);
+    if (it != constant_temps.end())
+        *value = it->second;
+    else if (sym->tag == SYM_CONST && sym->type == integer_type)
+        *value = sym->get_constant_symbol()->const_value.ival;
+    else
+        return false;
+
+    return *value >= -4096 && *value <= 4095;
+}
+
+
+
+/* Put the operands of q that expand() uses directly as immediates in ops,
+   and return how many there are. Only the right operand of an instruction
+   can be an immediate, so a constant on the left is only used when the
+   operation is commutative. This must agree with expand(). */
+int code_generator::immediate_operands(quadruple *q, sym_index *ops)
+{
+    int       value;
+    sym_index k_sym;
+
+    if (power_of_two_operand(q, &k_sym) >= 0)
+        return 0;
+
+    switch (q->op_code)
+    {
+    case q_imult:
+        if (!sparc_v8)
+            return 0;
+        // Fall through.
+    case q_iplus:
+        if (!immediate(q->sym2, &value) && immediate(q->sym1, &value))
+        {
+            ops[0] = q->sym1;
+            return 1;
+        }
+        // Fall through.
+    case q_iminus:
+    case q_ieq:
+    case q_ine:
+    case q_ilt:
+    case q_igt:
+        break;
+    case q_idivide:
+    case q_imod:
+        if (!sparc_v8)
+            return 0;
+        break;
+    case q_iassign:
+        if (!immediate(q->sym1, &value))
+            return 0;
+        ops[0] = q->sym1;
+        return 1;
+    default:
+        return 0;
+    }
+
+    if (!immediate(q->sym2, &value))
+        return 0;
+    ops[0] = q->sym2;
+    return 1;
+}
+
+
+
+/* This function returns the right operand of an instruction: an immediate
+   if the symbol is a small enough constant, otherwise a register holding
+   it as given by source(). */
+string code_generator::operand(sym_index sym_p, register_type scratch)
+{
+    int value;
+
+    if (immediate(sym_p, &value))
+    {
+        ostringstream s;
+        s << value;
+        return s.str();
+    }
+    return reg[source(sym_p, scratch)];
+}
+
+
+
+/* This function returns a register holding the value of a symbol: its own
+   register if it has one, otherwise scratch, which the value is fetched into.
+*/
+register_type code_generator::source(sym_index sym_p, register_type scratch)
+{
+    int r = home(sym_p);
+
+    if (r != NO_REGISTER)
+        return r;
+    fetch(sym_p, scratch);
+    return scratch;
+}
+
+
+
+/* This function returns the register a result should be computed into. If it
+   is scratch, the result must be stored afterwards (store() does nothing when
+   the symbol already lives in the register). */
+register_type code_generator::target(sym_index sym_p, register_type scratch)
+{
+    int r = home(sym_p);
+
+    return r != NO_REGISTER ? r : scratch;
+}
+
+
+
 /* This function fetches the value of a variable or a constant into a
    register. */
 void code_generator::fetch(sym_index sym_p, register_type dest)
@@ -203,37 +824,44 @@ void code_generator::fetch(sym_index sym_p, register_type dest)
     /* Your code here. */
     int level, offset;
     sym_type type = sym_tab->get_symbol_tag(sym_p);
+    int r = home(sym_p);
+
+    if (r != NO_REGISTER)
+    {
+        // The allocator never gives a register to anything that is
+        // handled as a real, so dest is an integer register here.
+        if (dest >= f0 && dest <= f2)
+            fatal("code_generator::fetch(): real in integer register");
+        if (r != dest)
+            out << "\t\t" << "mov" << "\t" << reg[r] << "," << reg[dest] << '\n';
+        return;
+    }
 
     if (type == SYM_CONST)
     {
         constant_symbol *sym = sym_tab->get_symbol(sym_p)->get_constant_symbol();
 	
-        if(dest > f0)
+        if(dest >= f0 && dest <= f2)
         {
 	    int value = sym_tab->ieee(sym->const_value.rval);
-            if (value < -4096 || value >= 4095)
-            {
-                out << "\t\t" << "set" << "\t" << value << ",%l0" << endl;
-	        out << "\t\t" << "st" << "\t" << "%l0" << ",[%sp+64]" << endl;
-                out << "\t\t" << "ld" << "\t" << "[%sp+64]," << reg[dest] << endl;
-            }
-	    else
-	    {
-                out << "\t\t" << "st" << "\t" << value << ",[%sp+64]" << endl;
-                out << "\t\t" << "ld" << "\t" << "[%sp+64]," << reg[dest] << endl;
-	    }
+            // There is no way to move an integer register into a float
+            // one except through memory. The peephole optimizer stores
+            // %g0 directly for 0.0.
+            out << "\t\t" << "set" << "\t" << value << "," << reg[l0] << '\n';
+            out << "\t\t" << "st" << "\t" << reg[l0] << ",[%sp+64]" << '\n';
+            out << "\t\t" << "ld" << "\t" << "[%sp+64]," << reg[dest] << '\n';
         }
         else
         {
 	    int value = sym->const_value.ival;
             if (value < -4096 || value >= 4095)
             {
-                out << "\t\t" << "set" << "\t" << value << ",%l0" << endl;
-                out << "\t\t" << "mov" << "\t" << "%l0," << reg[dest] << endl;
+                out << "\t\t" << "set" << "\t" << value << "," << reg[l0] << '\n';
+                out << "\t\t" << "mov" << "\t" << reg[l0] << "," << reg[dest] << '\n';
             }
 	    else
 	    {
-                out << "\t\t" << "set" << "\t" << value << "," << reg[dest] << endl;
+                out << "\t\t" << "set" << "\t" << value << "," << reg[dest] << '\n';
 	    }
             
 	}
@@ -241,18 +869,19 @@ void code_generator::fetch(sym_index sym_p, register_type dest)
     else
     {
         find(sym_p, &level, &offset);
+        string base = frame_base(level, &offset);
         if (offset < -4096 || offset >= 4095)
         {
-            out << "\t\t" << "set" << "\t" << offset << ",%l0" << endl;
-            out << "\t\t" << "ld" << "\t" << "[%g" << level << "+%l0]," << reg[dest] << endl;
+            out << "\t\t" << "set" << "\t" << offset << "," << reg[l0] << '\n';
+            out << "\t\t" << "ld" << "\t" << "[" << base << "+" << reg[l0] << "]," << reg[dest] << '\n';
         }
         else if (offset < 0)
         {
-            out << "\t\t" << "ld" << "\t" << "[%g" << level << offset << "]," << reg[dest] << endl;
+            out << "\t\t" << "ld" << "\t" << "[" << base << offset << "]," << reg[dest] << '\n';
         }
         else
         {
-            out << "\t\t" << "ld" << "\t" << "[%g" << level << "+" << offset << "]," << reg[dest] << endl;
+            out << "\t\t" << "ld" << "\t" << "[" << base << "+" << offset << "]," << reg[dest] << '\n';
         }
     }
 }
@@ -264,19 +893,29 @@ void code_generator::store(register_type src, sym_index sym_p)
 {
     /* Your code here. */
     int level, offset;
+    int r = home(sym_p);
+
+    if (r != NO_REGISTER)
+    {
+        if (r != src)
+            out << "\t\t" << "mov" << "\t" << reg[src] << "," << reg[r] << '\n';
+        return;
+    }
+
     find(sym_p, &level, &offset);
+    string base = frame_base(level, &offset);
     if (offset < -4096 || offset >= 4095)
     {
-        out << "\t\t" << "set" << "\t" << offset << ",%l0" << endl;
-        out << "\t\t" << "st" << "\t" << reg[src] << ",[%g" << level << "+%l0]" << endl;
+        out << "\t\t" << "set" << "\t" << offset << "," << reg[l0] << '\n';
+        out << "\t\t" << "st" << "\t" << reg[src] << ",[" << base << "+" << reg[l0] << "]" << '\n';
     }
     else if (offset < 0)
     {
-        out << "\t\t" << "st" << "\t" << reg[src] << ",[%g" << level << offset << "]" << endl;
+        out << "\t\t" << "st" << "\t" << reg[src] << ",[" << base << offset << "]" << '\n';
     }
     else
     {
-        out << "\t\t" << "st" << "\t" << reg[src] << ",[%g" << level << "+" << offset << "]" << endl;
+        out << "\t\t" << "st" << "\t" << reg[src] << ",[" << base << "+" << offset << "]" << '\n';
     }
 }
 
@@ -288,21 +927,31 @@ void code_generator::array_address(sym_index sym_p, register_type dest)
     /* Your code here. */
     int level, offset;
     find(sym_p, &level, &offset);
+
+    // The array is below the base, at -offset.
+    offset = -offset;
+    string base = frame_base(level, &offset);
 	
         if (offset < -4096 || offset >= 4095)
         {
-            out << "\t\t" << "set" << "\t" << offset << ",%l0" << endl;
-            out << "\t\t" << "sub" << "\t" << "%g" << level << ",%l0," << reg[dest] << endl;
+            out << "\t\t" << "set" << "\t" << offset << "," << reg[l0] << '\n';
+            out << "\t\t" << "add" << "\t" << base << "," << reg[l0] << "," << reg[dest] << '\n';
         }
 	else
 	{
-	    out << "\t\t" << "sub" << "\t" << "%g" << level << "," << offset << "," << reg[dest] << endl;
+	    out << "\t\t" << "add" << "\t" << base << "," << offset << "," << reg[dest] << '\n';
 
 	}
     
 }
 
-void code_generator::funcall(quadruple *q)
+/* Generate a call. If it is a tail call, the callee is given our caller's
+   register window: the arguments go in our %i registers, which are the
+   caller's %o ones, the display is restored as in the epilogue, and the
+   restore is done in the delay slot of the call. The callee then returns
+   straight to our caller. This can't be done for a procedure nested in
+   this block, since it may use our frame. */
+void code_generator::funcall(quadruple *q, bool tail)
 {
     int i;
     int label;
@@ -331,23 +980,134 @@ void code_generator::funcall(quadruple *q)
         current_reg += 1;
     }
 
-    char *name = sym_tab->pool_lookup(name_id);
-    out << "\t\t" << "call" << "\t" << "L" << label << "\t! " << name << endl;
-    out << "\t\t" << "nop" << endl;
+    if (tail && sym_tab->get_symbol(sym)->level < frame_level)
+    {
+        for (i = 0; i < q->int2; ++i)
+            out << "\t\t" << "mov" << "\t" << "%o" << i << ",%i" << i << '\n';
+        if (keep_display)
+            out << "\t\t" << "ld" << "\t" << "[%fp+" << DISPLAY_REG_OFFSET
+                << "]," << "%g" << frame_level << '\n';
+        out << "\t\t" << "call" << "\t" << "L" << label << "\t! "
+            << sym_tab->pool_view(name_id) << '\n';
+        out << "\t\t" << "restore" << '\n';
+        return;
+    }
+
+    out << "\t\t" << "call" << "\t" << "L" << label << "\t! "
+        << sym_tab->pool_view(name_id) << '\n';
+    out << "\t\t" << "nop" << '\n';
 
     if (sym_tab->get_symbol_tag(sym) == SYM_FUNC)
     {
         store(o0, q->sym3);
     }
+}
 
-    delete[] name;
+/* Put the dividend in register a into %o1, adjusted so that shifting it
+   right by k divides it by 2^k rounding towards zero. That means adding
+   2^k - 1 if it is negative, which is its sign bits shifted down. */
+void code_generator::round_to_zero(register_type a, int k)
+{
+    out << "\t\t" << "sra" << "\t" << reg[a] << ",31,%o1" << '\n';
+    out << "\t\t" << "srl" << "\t" << "%o1," << 32 - k << ",%o1" << '\n';
+    out << "\t\t" << "add" << "\t" << reg[a] << ",%o1,%o1" << '\n';
+}
+
+
+
+/* Set up %y for a V8 sdiv of register a by the divisor, and return the
+   divisor operand, an immediate or %o1. sdiv divides the 64 bit value %y:a,
+   so %y gets the sign extension of a. Writing %y takes effect three
+   instructions later. */
+string code_generator::signed_divide(register_type a, sym_index divisor)
+{
+    out << "\t\t" << "sra" << "\t" << reg[a] << ",31," << reg[l0] << '\n';
+    out << "\t\t" << "wr" << "\t" << reg[l0] << ",%g0,%y" << '\n';
+    out << "\t\t" << "nop" << '\n';
+    out << "\t\t" << "nop" << '\n';
+    out << "\t\t" << "nop" << '\n';
+    return operand(divisor, o1);
 }
 
+
+
+/* Compare the operands of a relation, and branch to a label if it is false.
+   The branches are the ones the relation quads use to set their result
+   to 0, so a NaN gives the same answer either way. */
+void code_generator::jump_on(quadruple *q, int label)
+{
+    const char   *compare = "cmp";
+    const char   *branch;
+    register_type a;
+    string        b;
+
+    switch (q->op_code)
+    {
+    case q_ieq:
+        branch = "bne";
+        break;
+    case q_ine:
+        branch = "be";
+        break;
+    case q_ilt:
+        branch = "bge";
+        break;
+    case q_igt:
+        branch = "ble";
+        break;
+    case q_req:
+        compare = "fcmps";
+        branch = "fbne";
+        break;
+    case q_rne:
+        compare = "fcmps";
+        branch = "fbe";
+        break;
+    case q_rlt:
+        compare = "fcmpes";
+        branch = "fbuge";
+        break;
+    case q_rgt:
+        compare = "fcmpes";
+        branch = "fbule";
+        break;
+    default:
+        fatal("code_generator::jump_on(): not a relation");
+        return;
+    }
+
+    if (compare[0] == 'f')
+    {
+        // There must be an instruction between a float compare and the
+        // branch on it.
+        fetch(q->sym1, f0);
+        fetch(q->sym2, f1);
+        out << "\t\t" << compare << "\t" << "%f0,%f1" << '\n';
+        out << "\t\t" << "nop" << '\n';
+    }
+    else
+    {
+        a = source(q->sym1, o0);
+        b = operand(q->sym2, o1);
+        out << "\t\t" << compare << "\t" << reg[a] << "," << b << '\n';
+    }
+    out << "\t\t" << branch << "\t" << "L" << label << '\n';
+    out << "\t\t" << "nop" << '\n';
+}
+
+
+
 /* This method expands a quad_list into assembler code, quad for quad. */
 void code_generator::expand(quad_list *q_list)
 {
     quadruple *q;           // Used to iterate through the list.
     int label;              // Assembler label.
+    register_type a, b, d;  // Operand and result registers.
+    string rhs;             // Right operand, a register or an immediate.
+    sym_index left, right;  // Operands, swapped to get an immediate right.
+    sym_index ops[2];       // Operands used as immediates.
+    int k;                  // Shift count, for strength reduction.
+    sym_index k_sym;        // The power of two operand.
 
     //int nr_args;            // Used for parameter generation.
 
@@ -366,144 +1126,273 @@ void code_generator::expand(quad_list *q_list)
         // We always do labels here so that a branch doesn't miss the
         // trace code.
         if (q->op_code == q_labl)
-            out << "L" << q->int1 << ":" << endl;
+            out << "L" << q->int1 << ":" << '\n';
 
         // Debug output.
         if (assembler_trace)
             out << "\t" << "! QUAD " << quad_nr << ": "
-                << short_symbols << q << long_symbols << endl;
+                << short_symbols << q << long_symbols << '\n';
+
+        // A relation that only decides the q_jmpf right after it becomes a
+        // compare and a branch, and the q_jmpf is skipped.
+        if (is_jump_on(q, ql_iterator->peek_next(), temp_uses))
+        {
+            jump_on(q, ql_iterator->peek_next()->int1);
+            quad_nr++;
+            ql_iterator->get_next();
+            q = ql_iterator->get_next();
+            continue;
+        }
 
         // The main switch on quad type. This is where code is actually
         // generated.
         switch (q->op_code)
         {
         case q_iload:
+            // Constants that are only multiplied or divided by are folded
+            // into shifts instead.
+            if (unneeded_loads.find(q->sym3) != unneeded_loads.end())
+                break;
+            // Fall through.
         case q_rload:
-            out << "\t\t" << "set" << "\t" << q->int1 << ",%o0" << endl;
-            store(o0, q->sym3);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "set" << "\t" << q->int1 << "," << reg[d] << '\n';
+            store(d, q->sym3);
             break;
 
         case q_inot:
             label = sym_tab->get_next_label();
-            fetch(q->sym1, o0);
-            out << "\t\t" << "tst" << "\t" << "%o0" << endl;
-            out << "\t\t" << "be,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "1,%o0" << endl;
-            out << "\t\t" << "mov" << "\t" << "0,%o0" << endl;
-            out << "\t\t" << "L" << label << ":" << endl;
-            store(o0, q->sym3);
+            a = source(q->sym1, o0);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "tst" << "\t" << reg[a] << '\n';
+            out << "\t\t" << "be,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "1," << reg[d] << '\n';
+            out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+            out << "\t\t" << "L" << label << ":" << '\n';
+            store(d, q->sym3);
             break;
 
         case q_ruminus:
             fetch(q->sym1, f0);
-            out << "\t\t" << "fnegs" << "\t" << "%f0,%f1" << endl;
+            out << "\t\t" << "fnegs" << "\t" << "%f0,%f1" << '\n';
             store(f1, q->sym3);
             break;
 
         case q_iuminus:
-            fetch(q->sym1, o0);
-            out << "\t\t" << "neg" << "\t" << "%o0" << endl;
-            store(o0, q->sym3);
+            a = source(q->sym1, o0);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "neg" << "\t" << reg[a] << "," << reg[d] << '\n';
+            store(d, q->sym3);
             break;
 
         case q_rplus:
             fetch(q->sym1, f0);
             fetch(q->sym2, f1);
-            out << "\t\t" << "fadds" << "\t" << "%f0,%f1,%f2" << endl;
+            out << "\t\t" << "fadds" << "\t" << "%f0,%f1,%f2" << '\n';
             store(f2, q->sym3);
             break;
 
         case q_iplus:
-            fetch(q->sym1, o0);
-            fetch(q->sym2, o1);
-            out << "\t\t" << "add" << "\t" << "%o0,%o1,%o0" << endl;
-            store(o0, q->sym3);
+            // A constant on the left is moved over to the right, where it
+            // can be an immediate.
+            left = q->sym1;
+            right = q->sym2;
+            if (immediate_operands(q, ops) == 1 && ops[0] == left)
+                swap(left, right);
+            a = source(left, o0);
+            rhs = operand(right, o1);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "add" << "\t" << reg[a] << "," << rhs << ","
+                << reg[d] << '\n';
+            store(d, q->sym3);
             break;
 
         case q_rminus:
             fetch(q->sym1, f0);
             fetch(q->sym2, f1);
-            out << "\t\t" << "fsubs" << "\t" << "%f0,%f1,%f2" << endl;
+            out << "\t\t" << "fsubs" << "\t" << "%f0,%f1,%f2" << '\n';
             store(f2, q->sym3);
             break;
 
         case q_iminus:
-            fetch(q->sym1, o0);
-            fetch(q->sym2, o1);
-            out << "\t\t" << "sub" << "\t" << "%o0,%o1,%o0" << endl;
-            store(o0, q->sym3);
+            a = source(q->sym1, o0);
+            rhs = operand(q->sym2, o1);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "sub" << "\t" << reg[a] << "," << rhs << ","
+                << reg[d] << '\n';
+            store(d, q->sym3);
             break;
 
         case q_ior:
             label = sym_tab->get_next_label();
-            fetch(q->sym1, o0);
-            out << "\t\t" << "tst" << "\t" << "%o0" << endl;
-            out << "\t\t" << "bne,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "1,%o0" << endl;
-            fetch(q->sym2, o0);
-            out << "\t\t" << "tst" << "\t" << "%o0" << endl;
-            out << "\t\t" << "bne,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "1,%o0" << endl;
-            out << "\t\t" << "mov" << "\t" << "0,%o0" << endl;
-            out << "L" << label << ":" << endl;
-            store(o0, q->sym3);
+            d = target(q->sym3, o0);
+            a = source(q->sym1, o1);
+            out << "\t\t" << "tst" << "\t" << reg[a] << '\n';
+            out << "\t\t" << "bne,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "1," << reg[d] << '\n';
+            b = source(q->sym2, o1);
+            out << "\t\t" << "tst" << "\t" << reg[b] << '\n';
+            out << "\t\t" << "bne,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "1," << reg[d] << '\n';
+            out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+            out << "L" << label << ":" << '\n';
+            store(d, q->sym3);
             break;
 
         case q_iand:
             label = sym_tab->get_next_label();
-            fetch(q->sym1, o0);
-            out << "\t\t" << "tst" << "\t" << "%o0" << endl;
-            out << "\t\t" << "be,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "0,%o0" << endl;
-            fetch(q->sym2, o0);
-            out << "\t\t" << "tst" << "\t" << "%o0" << endl;
-            out << "\t\t" << "be,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "0,%o0" << endl;
-            out << "\t\t" << "mov" << "\t" << "1,%o0" << endl;
-            out << "L" << label << ":" << endl;
-            store(o0, q->sym3);
+            d = target(q->sym3, o0);
+            a = source(q->sym1, o1);
+            out << "\t\t" << "tst" << "\t" << reg[a] << '\n';
+            out << "\t\t" << "be,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+            b = source(q->sym2, o1);
+            out << "\t\t" << "tst" << "\t" << reg[b] << '\n';
+            out << "\t\t" << "be,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+            out << "\t\t" << "mov" << "\t" << "1," << reg[d] << '\n';
+            out << "L" << label << ":" << '\n';
+            store(d, q->sym3);
             break;
 
         case q_rmult:
             fetch(q->sym1, f0);
             fetch(q->sym2, f1);
-            out << "\t\t" << "fmuls" << "\t" << "%f0,%f1,%f2" << endl;
+            out << "\t\t" << "fmuls" << "\t" << "%f0,%f1,%f2" << '\n';
             store(f2, q->sym3);
             break;
 
         case q_imult:
+            if ((k = power_of_two_operand(q, &k_sym)) >= 0)
+            {
+                a = source(k_sym == q->sym1 ? q->sym2 : q->sym1, o0);
+                d = target(q->sym3, o0);
+                out << "\t\t" << "sll" << "\t" << reg[a] << "," << k << ","
+                    << reg[d] << '\n';
+                store(d, q->sym3);
+                break;
+            }
+            if (sparc_v8)
+            {
+                left = q->sym1;
+                right = q->sym2;
+                if (immediate_operands(q, ops) == 1 && ops[0] == left)
+                    swap(left, right);
+                a = source(left, o0);
+                rhs = operand(right, o1);
+                d = target(q->sym3, o0);
+                out << "\t\t" << "smul" << "\t" << reg[a] << "," << rhs
+                    << "," << reg[d] << '\n';
+                store(d, q->sym3);
+                break;
+            }
             fetch(q->sym1, o0);
             fetch(q->sym2, o1);
             // Note: We're calling routines from diesel_glue.s here.
-            out << "\t\t" << "call" << "\t" << "Mul" << endl;
-            out << "\t\t" << "nop" << endl;
+            out << "\t\t" << "call" << "\t" << "Mul" << '\n';
+            out << "\t\t" << "nop" << '\n';
             store(o0, q->sym3);
             break;
 
         case q_rdivide:
             fetch(q->sym1, f0);
             fetch(q->sym2, f1);
-            out << "\t\t" << "fdivs" << "\t" << "%f0,%f1,%f2" << endl;
+            out << "\t\t" << "fdivs" << "\t" << "%f0,%f1,%f2" << '\n';
 
-            out << "\t\t" << "fmovs" << "\t" << "%f2,%f2" << endl;
+            out << "\t\t" << "fmovs" << "\t" << "%f2,%f2" << '\n';
             store(f2, q->sym3);
             break;
 
         case q_idivide:
+            if ((k = power_of_two_operand(q, &k_sym)) >= 0)
+            {
+                a = source(q->sym1, o0);
+                d = target(q->sym3, o0);
+                if (k == 0)
+                {
+                    out << "\t\t" << "mov" << "\t" << reg[a] << ","
+                        << reg[d] << '\n';
+                }
+                else
+                {
+                    // Division rounds towards zero, so 2^k - 1 is added to
+                    // a negative dividend before it is shifted.
+                    round_to_zero(a, k);
+                    out << "\t\t" << "sra" << "\t" << "%o1," << k << ","
+                        << reg[d] << '\n';
+                }
+                store(d, q->sym3);
+                break;
+            }
+            if (sparc_v8)
+            {
+                a = source(q->sym1, o0);
+                rhs = signed_divide(a, q->sym2);
+                d = target(q->sym3, o0);
+                out << "\t\t" << "sdiv" << "\t" << reg[a] << "," << rhs << ","
+                    << reg[d] << '\n';
+                store(d, q->sym3);
+                break;
+            }
             fetch(q->sym1, o0);
             fetch(q->sym2, o1);
             // Note: We're calling routines from diesel_glue.s here.
-            out << "\t\t" << "call" << "\t" << "Div" << endl;
-            out << "\t\t" << "nop" << endl;
+            out << "\t\t" << "call" << "\t" << "Div" << '\n';
+            out << "\t\t" << "nop" << '\n';
             store(o0, q->sym3);
             break;
 
         case q_imod:
+            if ((k = power_of_two_operand(q, &k_sym)) >= 0)
+            {
+                a = source(q->sym1, o0);
+                d = target(q->sym3, o0);
+                if (k == 0)
+                {
+                    out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+                }
+                else
+                {
+                    // The remainder has the sign of the dividend, so it is
+                    // the dividend minus the quotient times 2^k.
+                    round_to_zero(a, k);
+                    if ((1 << k) - 1 <= 4095)
+                    {
+                        out << "\t\t" << "andn" << "\t" << "%o1,"
+                            << (1 << k) - 1 << ",%o1" << '\n';
+                    }
+                    else
+                    {
+                        out << "\t\t" << "set" << "\t" << -(1 << k) << ","
+                            << reg[l0] << '\n';
+                        out << "\t\t" << "and" << "\t" << "%o1," << reg[l0]
+                            << ",%o1" << '\n';
+                    }
+                    out << "\t\t" << "sub" << "\t" << reg[a] << ",%o1,"
+                        << reg[d] << '\n';
+                }
+                store(d, q->sym3);
+                break;
+            }
+            if (sparc_v8)
+            {
+                a = source(q->sym1, o0);
+                rhs = signed_divide(a, q->sym2);
+                d = target(q->sym3, o0);
+                out << "\t\t" << "sdiv" << "\t" << reg[a] << "," << rhs
+                    << ",%o2" << '\n';
+                out << "\t\t" << "smul" << "\t" << "%o2," << rhs << ",%o2"
+                    << '\n';
+                out << "\t\t" << "sub" << "\t" << reg[a] << ",%o2,"
+                    << reg[d] << '\n';
+                store(d, q->sym3);
+                break;
+            }
             fetch(q->sym1, o0);
             fetch(q->sym2, o1);
             // Note: We're calling routines from diesel_glue.s here.
-            out << "\t\t" << "call" << "\t" << "Rem" << endl;
-            out << "\t\t" << "nop" << endl;
+            out << "\t\t" << "call" << "\t" << "Rem" << '\n';
+            out << "\t\t" << "nop" << '\n';
             store(o0, q->sym3);
             break;
 
@@ -511,113 +1400,126 @@ void code_generator::expand(quad_list *q_list)
             label = sym_tab->get_next_label();
             fetch(q->sym1, f0);
             fetch(q->sym2, f1);
-            out << "\t\t" << "fcmps" << "\t" << "%f0,%f1" << endl;
-            out << "\t\t" << "nop" << endl;
-            out << "\t\t" << "fbne,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "0,%o0" << endl;
-            out << "\t\t" << "mov" << "\t" << "1,%o0" << endl;
-            out << "L" << label << ":" << endl;
-            store(o0, q->sym3);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "fcmps" << "\t" << "%f0,%f1" << '\n';
+            out << "\t\t" << "nop" << '\n';
+            out << "\t\t" << "fbne,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+            out << "\t\t" << "mov" << "\t" << "1," << reg[d] << '\n';
+            out << "L" << label << ":" << '\n';
+            store(d, q->sym3);
             break;
 
         case q_ieq:
             label = sym_tab->get_next_label();
-            fetch(q->sym1, o0);
-            fetch(q->sym2, o1);
-            out << "\t\t" << "cmp" << "\t" << "%o0,%o1" << endl;
-            out << "\t\t" << "bne,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "0,%o0" << endl;
-            out << "\t\t" << "mov" << "\t" << "1,%o0" << endl;
-            out << "L" << label << ":" << endl;
-            store(o0, q->sym3);
+            a = source(q->sym1, o0);
+            rhs = operand(q->sym2, o1);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "cmp" << "\t" << reg[a] << "," << rhs << '\n';
+            out << "\t\t" << "bne,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+            out << "\t\t" << "mov" << "\t" << "1," << reg[d] << '\n';
+            out << "L" << label << ":" << '\n';
+            store(d, q->sym3);
             break;
 
         case q_rne:
             label = sym_tab->get_next_label();
             fetch(q->sym1, f0);
             fetch(q->sym2, f1);
-            out << "\t\t" << "fcmps" << "\t" << "%f0,%f1" << endl;
-            out << "\t\t" << "nop" << endl;
-            out << "\t\t" << "fbe,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "0,%o0" << endl;
-            out << "\t\t" << "mov" << "\t" << "1,%o0" << endl;
-            out << "L" << label << ":" << endl;
-            store(o0, q->sym3);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "fcmps" << "\t" << "%f0,%f1" << '\n';
+            out << "\t\t" << "nop" << '\n';
+            out << "\t\t" << "fbe,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+            out << "\t\t" << "mov" << "\t" << "1," << reg[d] << '\n';
+            out << "L" << label << ":" << '\n';
+            store(d, q->sym3);
             break;
 
         case q_ine:
             label = sym_tab->get_next_label();
-            fetch(q->sym1, o0);
-            fetch(q->sym2, o1);
-            out << "\t\t" << "cmp" << "\t" << "%o0,%o1" << endl;
-            out << "\t\t" << "be,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "0,%o0" << endl;
-            out << "\t\t" << "mov" << "\t" << "1,%o0" << endl;
-            out << "L" << label << ":" << endl;
-            store(o0, q->sym3);
+            a = source(q->sym1, o0);
+            rhs = operand(q->sym2, o1);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "cmp" << "\t" << reg[a] << "," << rhs << '\n';
+            out << "\t\t" << "be,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+            out << "\t\t" << "mov" << "\t" << "1," << reg[d] << '\n';
+            out << "L" << label << ":" << '\n';
+            store(d, q->sym3);
             break;
 
         case q_rlt:
             label = sym_tab->get_next_label();
             fetch(q->sym1, f0);
             fetch(q->sym2, f1);
-            out << "\t\t" << "fcmpes" << "\t" << "%f0,%f1" << endl;
-            out << "\t\t" << "nop" << endl;
-            out << "\t\t" << "fbuge,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "0,%o0" << endl;
-            out << "\t\t" << "mov" << "\t" << "1,%o0" << endl;
-            out << "L" << label << ":" << endl;
-            store(o0, q->sym3);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "fcmpes" << "\t" << "%f0,%f1" << '\n';
+            out << "\t\t" << "nop" << '\n';
+            out << "\t\t" << "fbuge,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+            out << "\t\t" << "mov" << "\t" << "1," << reg[d] << '\n';
+            out << "L" << label << ":" << '\n';
+            store(d, q->sym3);
             break;
 
         case q_ilt:
             label = sym_tab->get_next_label();
-            fetch(q->sym1, o0);
-            fetch(q->sym2, o1);
-            out << "\t\t" << "cmp" << "\t" << "%o0,%o1" << endl;
-            out << "\t\t" << "bge,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "0,%o0" << endl;
-            out << "\t\t" << "mov" << "\t" << "1,%o0" << endl;
-            out << "L" << label << ":" << endl;
-            store(o0, q->sym3);
+            a = source(q->sym1, o0);
+            rhs = operand(q->sym2, o1);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "cmp" << "\t" << reg[a] << "," << rhs << '\n';
+            out << "\t\t" << "bge,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+            out << "\t\t" << "mov" << "\t" << "1," << reg[d] << '\n';
+            out << "L" << label << ":" << '\n';
+            store(d, q->sym3);
             break;
 
         case q_rgt:
             label = sym_tab->get_next_label();
             fetch(q->sym1, f0);
             fetch(q->sym2, f1);
-            out << "\t\t" << "fcmpes" << "\t" << "%f0,%f1" << endl;
-            out << "\t\t" << "nop" << endl;
-            out << "\t\t" << "fbule,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "0,%o0" << endl;
-            out << "\t\t" << "mov" << "\t" << "1,%o0" << endl;
-            out << "L" << label << ":" << endl;
-            store(o0, q->sym3);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "fcmpes" << "\t" << "%f0,%f1" << '\n';
+            out << "\t\t" << "nop" << '\n';
+            out << "\t\t" << "fbule,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+            out << "\t\t" << "mov" << "\t" << "1," << reg[d] << '\n';
+            out << "L" << label << ":" << '\n';
+            store(d, q->sym3);
             break;
 
         case q_igt:
             label = sym_tab->get_next_label();
-            fetch(q->sym1, o0);
-            fetch(q->sym2, o1);
-            out << "\t\t" << "cmp" << "\t" << "%o0,%o1" << endl;
-            out << "\t\t" << "ble,a" << "\t" << "L" << label << endl;
-            out << "\t\t" << "mov" << "\t" << "0,%o0" << endl;
-            out << "\t\t" << "mov" << "\t" << "1,%o0" << endl;
-            out << "L" << label << ":" << endl;
-            store(o0, q->sym3);
+            a = source(q->sym1, o0);
+            rhs = operand(q->sym2, o1);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "cmp" << "\t" << reg[a] << "," << rhs << '\n';
+            out << "\t\t" << "ble,a" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "mov" << "\t" << "0," << reg[d] << '\n';
+            out << "\t\t" << "mov" << "\t" << "1," << reg[d] << '\n';
+            out << "L" << label << ":" << '\n';
+            store(d, q->sym3);
             break;
 
         case q_rstore:
         case q_istore:
-            fetch(q->sym1, o0);
-            fetch(q->sym3, o1);
-            out << "\t\t" << "st" << "\t" << "%o0,[%o1]" << endl;
+            a = source(q->sym1, o0);
+            b = source(q->sym3, o1);
+            out << "\t\t" << "st" << "\t" << reg[a] << ",[" << reg[b] << "]"
+                << '\n';
             break;
 
         case q_rassign:
         case q_iassign:
-            fetch(q->sym1, o0);
-            store(o0, q->sym3);
+            d = target(q->sym3, o0);
+            if (q->op_code == q_iassign && immediate(q->sym1, &k))
+                out << "\t\t" << "set" << "\t" << k << "," << reg[d] << '\n';
+            else
+                fetch(q->sym1, d);
+            store(d, q->sym3);
             break;
 
         case q_param:
@@ -627,49 +1529,51 @@ void code_generator::expand(quad_list *q_list)
 
         case q_call:
             /* Your code here. */
-            funcall(q);
+            funcall(q, q_list->is_tail_call(ql_iterator->get_index()));
             break;
 
         case q_rreturn:
         case q_ireturn:
             fetch(q->sym2, i0);
-            out << "\t\t" << "ba" << "\t" << "L" << q->int1 << endl;
-            out << "\t\t" << "nop" << endl;
+            out << "\t\t" << "ba" << "\t" << "L" << q->int1 << '\n';
+            out << "\t\t" << "nop" << '\n';
             break;
 
         case q_lindex:
-            fetch(q->sym2, o1);
+            b = source(q->sym2, o1);
             array_address(q->sym1, o0);
-            out << "\t\t" << "sll" << "\t" << "%o1,2,%o1" << endl;
-            out << "\t\t" << "add" << "\t" << "%o0,%o1,%o0" << endl;
-            store(o0, q->sym3);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "sll" << "\t" << reg[b] << ",2,%o1" << '\n';
+            out << "\t\t" << "add" << "\t" << "%o0,%o1," << reg[d] << '\n';
+            store(d, q->sym3);
             break;
 
         case q_rrindex:
         case q_irindex:
-            fetch(q->sym2, o1);
+            b = source(q->sym2, o1);
             array_address(q->sym1, o0);
-            out << "\t\t" << "sll" << "\t" << "%o1,2,%o1" << endl;
-            out << "\t\t" << "ld" << "\t" << "[%o0+%o1],%o0" << endl;
-            store(o0, q->sym3);
+            d = target(q->sym3, o0);
+            out << "\t\t" << "sll" << "\t" << reg[b] << ",2,%o1" << '\n';
+            out << "\t\t" << "ld" << "\t" << "[%o0+%o1]," << reg[d] << '\n';
+            store(d, q->sym3);
             break;
 
         case q_itor:
             fetch(q->sym1, f0);
-            out << "\t\t" << "fitos" << "\t" << "%f0,%f1" << endl;
+            out << "\t\t" << "fitos" << "\t" << "%f0,%f1" << '\n';
             store(f1, q->sym3);
             break;
 
         case q_jmp:
-            out << "\t\t" << "ba" << "\t" << "L" << q->int1 << endl;
-            out << "\t\t" << "nop" << endl;
+            out << "\t\t" << "ba" << "\t" << "L" << q->int1 << '\n';
+            out << "\t\t" << "nop" << '\n';
             break;
 
         case q_jmpf:
-            fetch(q->sym2, o0);
-            out << "\t\t" << "tst" << "\t" << "%o0" << endl;
-            out << "\t\t" << "be" << "\t" << "L" << q->int1 << endl;
-            out << "\t\t" << "nop" << endl;
+            a = source(q->sym2, o0);
+            out << "\t\t" << "tst" << "\t" << reg[a] << '\n';
+            out << "\t\t" << "be" << "\t" << "L" << q->int1 << '\n';
+            out << "\t\t" << "nop" << '\n';
             break;
 
         case q_labl:
@@ -685,7 +1589,4 @@ void code_generator::expand(quad_list *q_list)
         // Get the next quad from the list.
         q = ql_iterator->get_next();
     }
-
-    // Flush the generated code to file.
-    out << flush;
 }
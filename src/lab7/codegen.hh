@@ -3,7 +3,12 @@
 
 
 #include <fstream>
+#include <sstream>
 #include <stack>
+#include <map>
+#include <set>
+#include "regalloc.hh"
+#include "peephole.hh"
 using namespace std;
 
 
@@ -24,6 +29,33 @@ const register_type f0 = 7;
 const register_type f1 = 8;
 const register_type f2 = 9;
 
+/* These are handed out by the register allocator. %l0 is kept as a scratch
+   register for large offsets and constants, %i0 for return values, and the
+   rest of the %i registers have been saved to the stack by the prologue. */
+const register_type l1 = 10;
+const register_type l2 = 11;
+const register_type l3 = 12;
+const register_type l4 = 13;
+const register_type l5 = 14;
+const register_type l6 = 15;
+const register_type l7 = 16;
+const register_type i1 = 17;
+const register_type i2 = 18;
+const register_type i3 = 19;
+const register_type i4 = 20;
+const register_type i5 = 21;
+
+/* The scratch register for large offsets and constants. */
+const register_type l0 = 22;
+
+const int NR_REGISTERS = 23;
+const int NR_ALLOCATABLE_REGISTERS = 12;   // l1 and up.
+
+/* A leaf routine runs in its caller's register window, so it can only use
+   the %o registers: l0 becomes %o5, i0 %o0, and the first LEAF_REGISTERS
+   allocatable ones %o3 and up. See code_generator::find_frame(). */
+const int LEAF_REGISTERS = 2;
+
 
 // The old display register is stored at [%fp+DISPLAY_REG_OFFSET].
 const int DISPLAY_REG_OFFSET = 64;
@@ -38,6 +70,9 @@ const int MIN_FRAME_SIZE = 92;
 const int MAX_PARAMETERS = 127;
 const int PARAMETER_STACK_SIZE = 128;
 
+// The assembler file is written in chunks of this many bytes.
+const int OUTPUT_CHUNK_SIZE = 65536;
+
 
 
 /* Prototypes required for code_generator interface (the arguments). */
@@ -46,34 +81,147 @@ class symbol;
 
 
 
+/* The assembler output file. The backends write the code for a block to a
+   string buffer, and hand the finished block to write(). Blocks are
+   collected here until there is at least OUTPUT_CHUNK_SIZE bytes, which
+   are then written out at once, so a big program takes a few write() calls
+   rather than one for every line. A backend thread's file has no name and
+   is never written out; the pipeline take()s the code and writes it to the
+   real file in source order, see pipeline.hh. */
+class assembler_file
+{
+private:
+    ofstream file;
+    string   buffer;                                  // Not yet written.
+    string  *copy;                                    // See capture().
+
+    void     write_out();
+
+public:
+    assembler_file(const char *);
+    assembler_file();                                 // In memory only.
+    ~assembler_file();
+
+    void     write(const string &);
+    void     flush();
+    string   take();                                  // Empty the buffer.
+    void     capture(string *c) { copy = c; }         // Append everything
+                                                      // written to c too.
+};
+
+
+
+/* This is the interface parser.y uses to hand a finished quad list over to
+   a backend. main.cc decides which concrete backend code_gen points to. */
+class assembler_backend
+{
+protected:
+    assembler_file *object_file;                      // Output file, or NULL
+                                                      // for the interpreter.
+    ostream        *log;                              // Where messages go.
+
+    // Helpers for the backends that generate assembler, see codegen.cc.
+    static void count_temp_uses(quad_list *, symbol *, map<sym_index, int> &);
+    static bool is_jump_on(quadruple *, quadruple *, map<sym_index, int> &);
+
+public:
+    // The file is deleted, and so written out, by the destructor.
+    assembler_backend(assembler_file *f = NULL) : object_file(f), log(message_stream) {}
+    virtual ~assembler_backend() { delete object_file; }
+    virtual void generate_assembler(quad_list *, symbol *env) = 0;
+
+    // For the backend threads of -J, see pipeline.hh. A backend of the same
+    // kind as this one that keeps the code in memory, or NULL if this one
+    // can't be run in parallel.
+    virtual assembler_backend *new_buffered() { return NULL; }
+    void   set_log(ostream *o)             { log = o; }
+    string take_code()                     { return object_file->take(); }
+    void   write_code(const string &text)  { object_file->write(text); }
+
+    // For the include unit cache, see units.hh.
+    void   capture_code(string *c)
+    {
+        if (object_file != NULL)
+            object_file->capture(c);
+    }
+};
+
+
+
 /* This class generates assembler code for the Sun Sparc architecture. */
-class code_generator
+class code_generator : public assembler_backend
 {
 private:
-    register_type reg[10][4];                         // Register array.
+    register_type reg[NR_REGISTERS][4];               // Register array.
 
-    ofstream      out;                                // Output file stream.
+    ostringstream out;                                // Code for the current
+                                                      // block, see
+                                                      // flush_block().
     
     stack<sym_index> arg_stack;                       // Argument stack
 
+    register_allocator  allocator;                    // Decides what goes in
+    map<sym_index, int> home_reg;                     // which register.
+
+    peephole_optimizer  peephole;                     // Cleans up the code
+                                                      // for a block.
+
+    map<sym_index, int> temp_uses;                    // Reads of each
+                                                      // temporary.
+    map<sym_index, int> constant_temps;               // Temporaries that
+    set<sym_index>      unneeded_loads;               // hold a constant.
+
+    int  frame_size;                                  // The current block's
+    int  frame_level;                                 // activation record
+    bool leaf;                                        // and what it needs,
+    bool keep_display;                                // see find_frame().
+
     int  align(int);                                  // Align a stack frame.
     void prologue(symbol *);                          // Initialize new env.
     void epilogue(symbol *);                          // Leave env.
     void expand(quad_list *q);                        // Quadlist -> assembler.
     void find(sym_index, int *, int *);               // Get variable/parameter
     // level & offset.
+    string frame_base(int, int *);                    // Register to address
+                                                      // a level through.
+    void find_frame(quad_list *, symbol *);           // Leaf and display
+                                                      // analysis.
+    bool calls(quadruple *, symbol *, bool *);        // Does a quad call?
     void fetch(sym_index, const register_type);       // memory -> register.
     void store(const register_type, sym_index);       // register -> memory.
+    int  home(sym_index);                             // Allocated register.
+    void find_constants(quad_list *);                 // Fill constant_temps.
+    int  power_of_two(sym_index);                     // log2 of a constant.
+    int  power_of_two_operand(quadruple *, sym_index *); // Strength reduction.
+    bool immediate(sym_index, int *);                 // A simm13 constant.
+    int  immediate_operands(quadruple *, sym_index *); // Operands expand()
+                                                      // uses as immediates.
+    string operand(sym_index, const register_type);   // Immediate or register.
+    register_type source(sym_index, const register_type); // Operand register.
+    register_type target(sym_index, const register_type); // Result register.
     void array_address(sym_index, const register_type); // get array base addr.
-    void funcall(quadruple *);
+    void funcall(quadruple *, bool);                  // Call, or tail call.
+    void round_to_zero(register_type, int);           // For division by 2^k.
+    string signed_divide(register_type, sym_index);   // Set up a V8 sdiv.
+    void jump_on(quadruple *, int);                   // Compare and branch.
+    void flush_block(symbol *);                       // Optimize and write out
+                                                      // the current block.
 
 public:
-    // Constructor. Arg = filename of assembler outfile.
-    code_generator(const char *);
+    // Constructor. Args = filename of assembler outfile, or NULL to keep the
+    // code in memory, and whether it is a whole program, which starts with
+    // the glue code, or just a block, see new_buffered().
+    code_generator(const char *, bool whole_program = true);
 
     // Destructor.
-    ~code_generator();
-    void generate_assembler(quad_list *, symbol *env); // Interface.
+    virtual ~code_generator();
+    virtual void generate_assembler(quad_list *, symbol *env); // Interface.
+    virtual assembler_backend *new_buffered();
 };
 
+
+extern __thread assembler_backend *code_gen; // Defined in codegen.cc.
+extern int no_register_allocation;  // Defined in main.cc.
+extern int sparc_v8;                // Defined in main.cc.
+
 #endif
@@ -0,0 +1,741 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include "symtab.hh"
+#include "quads.hh"
+#include "codegen_x86.hh"
+
+using namespace std;
+
+
+extern int assembler_trace; // Defined in main.cc.
+
+
+// Constructor.
+x86_code_generator::x86_code_generator(const char *object_file_name,
+                                       bool whole_program)
+{
+    current_level = 0;
+
+    if (object_file_name == NULL)
+        object_file = new assembler_file();
+    else
+        object_file = new assembler_file(object_file_name);
+    if (!whole_program)
+        return;
+
+    // The glue calls the main program by this name.
+    ostringstream main_label;
+    main_label << "\t.set\tdiesel_main,L" << MAIN_PROGRAM_LABEL << "\n";
+    object_file->write(main_label.str());
+
+    // Contains the preinstalled diesel functions: read, write, trunc, as
+    // well as the display and the process entry point.
+    object_file->write("\t.include\t\"diesel_glue_x86.s\"\n");
+    object_file->write("\t.text\n");
+}
+
+
+
+/* Destructor. The file is written out by assembler_backend. */
+x86_code_generator::~x86_code_generator()
+{
+}
+
+
+
+/* A code generator of our own for a backend thread. */
+assembler_backend *x86_code_generator::new_buffered()
+{
+    return new x86_code_generator(NULL, false);
+}
+
+
+
+/* This method is called from parser.y when code generation is to start.
+   The argument is a quad_list representing the body of the procedure, and
+   the symbol for the environment for which code is being generated. */
+void x86_code_generator::generate_assembler(quad_list *q, symbol *env)
+{
+    out.str("");
+    count_temp_uses(q, env, temp_uses);
+    prologue(env);
+    expand(q);
+    epilogue(env);
+
+    // The code for the block is collected in out, and written to the
+    // object file in one piece.
+    object_file->write(out.str());
+    out.str("");
+}
+
+
+
+/* This method aligns a frame size on a 16-byte boundary, which is what the
+   System V ABI demands of %rsp at every call site. */
+int x86_code_generator::align(int frame_size)
+{
+    return ((frame_size + 15) / 16) * 16;
+}
+
+
+
+/* This method generates assembler code for initialisating a procedure or
+   function. */
+void x86_code_generator::prologue(symbol *new_env)
+{
+    int ar_size;                // Activation record size.
+    int label_nr;               // Assembler label nr.
+
+    if (new_env->tag == SYM_PROC)
+    {
+        procedure_symbol *proc = new_env->get_procedure_symbol();
+        ar_size = align(proc->ar_size + X86_DISPLAY_SAVE_OFFSET);
+        label_nr = proc->label_nr;
+    }
+    else if (new_env->tag == SYM_FUNC)
+    {
+        function_symbol *func = new_env->get_function_symbol();
+        ar_size = align(func->ar_size + X86_DISPLAY_SAVE_OFFSET);
+        label_nr = func->label_nr;
+    }
+    else
+    {
+        fatal("x86_code_generator::prologue() called for non-proc/func");
+        return;
+    }
+
+    // Locals, temporaries and parameters of this block all live one level
+    // below the procedure symbol itself.
+    current_level = new_env->level + 1;
+
+    out << "L" << label_nr << ":" << "\t\t\t" << "# "
+        << sym_tab->pool_view(new_env->id) << '\n';
+
+    if (assembler_trace)
+        out << "\t" << "# PROLOGUE (" << short_symbols << new_env
+            << long_symbols << ")" << '\n';
+
+    // Create the AR. %rsp is 8 mod 16 on entry, so after pushing %rbp and
+    // subtracting an aligned frame it is 16-byte aligned again.
+    out << "\t\t" << "pushq" << "\t" << "%rbp" << '\n';
+    out << "\t\t" << "movq" << "\t" << "%rsp,%rbp" << '\n';
+    out << "\t\t" << "subq" << "\t" << "$" << ar_size << ",%rsp" << '\n';
+
+    // Save display
+    out << "\t\t" << "movq" << "\t" << "display+"
+        << current_level * X86_DISPLAY_ENTRY_SIZE << "(%rip),%rax" << '\n';
+    out << "\t\t" << "movq" << "\t" << "%rax,-" << X86_DISPLAY_SAVE_OFFSET
+        << "(%rbp)" << '\n';
+
+    // Update display
+    out << "\t\t" << "movq" << "\t" << "%rbp,display+"
+        << current_level * X86_DISPLAY_ENTRY_SIZE << "(%rip)" << '\n';
+
+    // The arguments are already in place above the return address, so
+    // unlike the Sparc version there is nothing to spill here.
+}
+
+
+
+/* This method generates assembler code for leaving a procedure or function. */
+void x86_code_generator::epilogue(symbol *old_env)
+{
+    if (assembler_trace)
+        out << "\t" << "# EPILOGUE (" << short_symbols << old_env
+            << long_symbols << ")" << '\n';
+
+    // Restore display. %eax holds a possible return value, so use %rcx.
+    out << "\t\t" << "movq" << "\t" << "-" << X86_DISPLAY_SAVE_OFFSET
+        << "(%rbp),%rcx" << '\n';
+    out << "\t\t" << "movq" << "\t" << "%rcx,display+"
+        << current_level * X86_DISPLAY_ENTRY_SIZE << "(%rip)" << '\n';
+
+    // Return
+    out << "\t\t" << "leave" << '\n';
+    out << "\t\t" << "ret" << '\n';
+}
+
+
+
+/* This function finds the display level and %rbp-relative offset for a
+   variable or a parameter. Note the pass-by-reference arguments. */
+void x86_code_generator::find(sym_index sym_p, int *level, int *offset)
+{
+    symbol *sym = sym_tab->get_symbol(sym_p);
+    if (sym->tag == SYM_PARAM)
+    {
+        *level = sym->level;
+        *offset = sym->offset + X86_FIRST_ARG_OFFSET;
+    }
+    else if (sym->tag == SYM_ARRAY)
+    {
+        array_symbol *arr_sym = sym->get_array_symbol();
+        *level = arr_sym->level;
+        *offset = -X86_DISPLAY_SAVE_OFFSET - arr_sym->offset -
+            sym_tab->get_size(arr_sym->type) * arr_sym->array_cardinality;
+    }
+    else if (sym->tag == SYM_VAR)
+    {
+        *level = sym->level;
+        *offset = -X86_DISPLAY_SAVE_OFFSET - sym->offset -
+            sym_tab->get_size(sym->type);
+    }
+    else
+    {
+        cout << sym->tag << endl;
+        fatal("Wrong tag in x86_code_generator::find");
+    }
+}
+
+
+
+/* This function returns the name of a register holding the frame pointer
+   for a given block level. Our own frame is always in %rbp; anything else
+   has to be fetched from the display first. */
+const char *x86_code_generator::frame_base(int level)
+{
+    if (level == current_level)
+        return "%rbp";
+
+    out << "\t\t" << "movq" << "\t" << "display+"
+        << level * X86_DISPLAY_ENTRY_SIZE << "(%rip),%r11" << '\n';
+    return "%r11";
+}
+
+
+
+/* This function fetches the value of a variable or a constant into a 32-bit
+   general purpose register. Reals are fetched as their ieee bit pattern. */
+void x86_code_generator::fetch(sym_index sym_p, const char *dest)
+{
+    int level, offset;
+
+    if (sym_tab->get_symbol_tag(sym_p) == SYM_CONST)
+    {
+        constant_symbol *sym = sym_tab->get_symbol(sym_p)->get_constant_symbol();
+        int value;
+
+        if (sym->type == real_type)
+            value = sym_tab->ieee(sym->const_value.rval);
+        else
+            value = sym->const_value.ival;
+
+        out << "\t\t" << "movl" << "\t" << "$" << value << "," << dest << '\n';
+        return;
+    }
+
+    find(sym_p, &level, &offset);
+    const char *base = frame_base(level);
+    out << "\t\t" << "movl" << "\t" << offset << "(" << base << "),"
+        << dest << '\n';
+}
+
+
+
+/* This function fetches the value of a real variable or constant into an
+   xmm register. */
+void x86_code_generator::fetch_real(sym_index sym_p, const char *dest)
+{
+    int level, offset;
+
+    if (sym_tab->get_symbol_tag(sym_p) == SYM_CONST)
+    {
+        fetch(sym_p, "%eax");
+        out << "\t\t" << "movd" << "\t" << "%eax," << dest << '\n';
+        return;
+    }
+
+    find(sym_p, &level, &offset);
+    const char *base = frame_base(level);
+    out << "\t\t" << "movss" << "\t" << offset << "(" << base << "),"
+        << dest << '\n';
+}
+
+
+
+/* This function stores the value of a 32-bit register into a variable. */
+void x86_code_generator::store(const char *src, sym_index sym_p)
+{
+    int level, offset;
+    find(sym_p, &level, &offset);
+    const char *base = frame_base(level);
+    out << "\t\t" << "movl" << "\t" << src << "," << offset << "("
+        << base << ")" << '\n';
+}
+
+
+
+/* This function stores the value of an xmm register into a real variable. */
+void x86_code_generator::store_real(const char *src, sym_index sym_p)
+{
+    int level, offset;
+    find(sym_p, &level, &offset);
+    const char *base = frame_base(level);
+    out << "\t\t" << "movss" << "\t" << src << "," << offset << "("
+        << base << ")" << '\n';
+}
+
+
+
+/* This function fetches the base address of an array into a 64-bit
+   register. */
+void x86_code_generator::array_address(sym_index sym_p, const char *dest)
+{
+    int level, offset;
+    find(sym_p, &level, &offset);
+    const char *base = frame_base(level);
+    out << "\t\t" << "leaq" << "\t" << offset << "(" << base << "),"
+        << dest << '\n';
+}
+
+
+
+/* Arguments are passed in an aligned block of 4-byte slots at the top of
+   the caller's stack, first argument lowest, and the result comes back in
+   %eax (reals as their bit pattern). */
+void x86_code_generator::funcall(quadruple *q)
+{
+    int i;
+    int label;
+    pool_index name_id;
+    sym_index sym = q->sym1;
+    if (sym_tab->get_symbol_tag(sym) == SYM_FUNC)
+    {
+        function_symbol *func_sym = sym_tab->get_symbol(sym)->get_function_symbol();
+        name_id = func_sym->id;
+        label = func_sym->label_nr;
+    }
+    else
+    {
+        procedure_symbol *proc_sym = sym_tab->get_symbol(sym)->get_procedure_symbol();
+        name_id = proc_sym->id;
+        label = proc_sym->label_nr;
+    }
+
+    int arg_size = align(q->int2 * 4);
+    if (arg_size > 0)
+        out << "\t\t" << "subq" << "\t" << "$" << arg_size << ",%rsp" << '\n';
+
+    for (i = 0; i < q->int2; ++i)
+    {
+        sym_index current_arg = arg_stack.top();
+        arg_stack.pop();
+
+        fetch(current_arg, "%eax");
+        out << "\t\t" << "movl" << "\t" << "%eax," << i * 4 << "(%rsp)"
+            << '\n';
+    }
+
+    out << "\t\t" << "call" << "\t" << "L" << label << "\t# "
+        << sym_tab->pool_view(name_id) << '\n';
+
+    if (arg_size > 0)
+        out << "\t\t" << "addq" << "\t" << "$" << arg_size << ",%rsp" << '\n';
+
+    if (sym_tab->get_symbol_tag(sym) == SYM_FUNC)
+    {
+        store("%eax", q->sym3);
+    }
+}
+
+
+
+/* Expand an integer relation into a 0/1 value. The argument is the setcc
+   condition suffix that should yield 1. */
+void x86_code_generator::compare(quadruple *q, const char *cond)
+{
+    fetch(q->sym1, "%eax");
+    fetch(q->sym2, "%ecx");
+    out << "\t\t" << "cmpl" << "\t" << "%ecx,%eax" << '\n';
+    out << "\t\t" << "set" << cond << "\t" << "%al" << '\n';
+    out << "\t\t" << "movzbl" << "\t" << "%al,%eax" << '\n';
+    store("%eax", q->sym3);
+}
+
+
+
+/* Same as above for reals. Note that comiss sets the flags the way an
+   unsigned integer compare would, and that it sets CF for a NaN, so "below"
+   would be true for one. a < b is done as b > a instead, so that it is
+   false for a NaN, like the other relations. */
+void x86_code_generator::compare_real(quadruple *q, const char *cond)
+{
+    fetch_real_operands(q);
+    out << "\t\t" << "comiss" << "\t" << "%xmm1,%xmm0" << '\n';
+    out << "\t\t" << "set" << cond << "\t" << "%al" << '\n';
+    out << "\t\t" << "movzbl" << "\t" << "%al,%eax" << '\n';
+    store("%eax", q->sym3);
+}
+
+
+
+/* Fetch the operands of a real < or > into %xmm0 and %xmm1, so that the
+   relation is %xmm0 > %xmm1, see compare_real(). */
+void x86_code_generator::fetch_real_operands(quadruple *q)
+{
+    if (q->op_code == q_rlt)
+    {
+        fetch_real(q->sym2, "%xmm0");
+        fetch_real(q->sym1, "%xmm1");
+    }
+    else
+    {
+        fetch_real(q->sym1, "%xmm0");
+        fetch_real(q->sym2, "%xmm1");
+    }
+}
+
+
+
+/* Compare the operands of a relation, and jump to a label if it is false.
+   For reals, a NaN makes every relation but <> false, as above. */
+void x86_code_generator::jump_on(quadruple *q, int label)
+{
+    const char *jump;
+    int         skip;
+
+    switch (q->op_code)
+    {
+    case q_ieq:
+        jump = "jne";
+        break;
+    case q_ine:
+        jump = "je";
+        break;
+    case q_ilt:
+        jump = "jge";
+        break;
+    case q_igt:
+        jump = "jle";
+        break;
+    case q_rlt:
+    case q_rgt:
+        jump = "jbe";
+        break;
+    case q_req:
+    case q_rne:
+        fetch_real(q->sym1, "%xmm0");
+        fetch_real(q->sym2, "%xmm1");
+        out << "\t\t" << "ucomiss" << "\t" << "%xmm1,%xmm0" << '\n';
+        if (q->op_code == q_req)
+        {
+            out << "\t\t" << "jne" << "\t" << "L" << label << '\n';
+            out << "\t\t" << "jp" << "\t" << "L" << label << '\n';
+        }
+        else
+        {
+            skip = sym_tab->get_next_label();
+            out << "\t\t" << "jp" << "\t" << "L" << skip << '\n';
+            out << "\t\t" << "je" << "\t" << "L" << label << '\n';
+            out << "L" << skip << ":" << '\n';
+        }
+        return;
+    default:
+        fatal("x86_code_generator::jump_on(): not a relation");
+        return;
+    }
+
+    if (q->op_code == q_rlt || q->op_code == q_rgt)
+    {
+        fetch_real_operands(q);
+        out << "\t\t" << "comiss" << "\t" << "%xmm1,%xmm0" << '\n';
+    }
+    else
+    {
+        fetch(q->sym1, "%eax");
+        fetch(q->sym2, "%ecx");
+        out << "\t\t" << "cmpl" << "\t" << "%ecx,%eax" << '\n';
+    }
+    out << "\t\t" << jump << "\t" << "L" << label << '\n';
+}
+
+
+
+/* This method expands a quad_list into assembler code, quad for quad. */
+void x86_code_generator::expand(quad_list *q_list)
+{
+    quadruple *q;           // Used to iterate through the list.
+
+    long quad_nr = 0;       // Just to make debug output easier to read.
+
+    // We use this iterator to loop through the quad list.
+    quad_list_iterator *ql_iterator = new quad_list_iterator(q_list);
+
+    q = ql_iterator->get_current(); // This is the head of the list.
+
+    while (q != NULL)
+    {
+        quad_nr++;
+
+        // We always do labels here so that a branch doesn't miss the
+        // trace code.
+        if (q->op_code == q_labl)
+            out << "L" << q->int1 << ":" << '\n';
+
+        // Debug output.
+        if (assembler_trace)
+            out << "\t" << "# QUAD " << quad_nr << ": "
+                << short_symbols << q << long_symbols << '\n';
+
+        // A relation that only decides the q_jmpf right after it becomes a
+        // compare and a branch, and the q_jmpf is skipped.
+        if (is_jump_on(q, ql_iterator->peek_next(), temp_uses))
+        {
+            jump_on(q, ql_iterator->peek_next()->int1);
+            quad_nr++;
+            ql_iterator->get_next();
+            q = ql_iterator->get_next();
+            continue;
+        }
+
+        // The main switch on quad type. This is where code is actually
+        // generated.
+        switch (q->op_code)
+        {
+        case q_iload:
+        case q_rload:
+            out << "\t\t" << "movl" << "\t" << "$" << q->int1 << ",%eax"
+                << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_inot:
+            fetch(q->sym1, "%eax");
+            out << "\t\t" << "testl" << "\t" << "%eax,%eax" << '\n';
+            out << "\t\t" << "sete" << "\t" << "%al" << '\n';
+            out << "\t\t" << "movzbl" << "\t" << "%al,%eax" << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_ruminus:
+            // Flip the sign bit of the ieee representation.
+            fetch(q->sym1, "%eax");
+            out << "\t\t" << "xorl" << "\t" << "$0x80000000,%eax" << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_iuminus:
+            fetch(q->sym1, "%eax");
+            out << "\t\t" << "negl" << "\t" << "%eax" << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_rplus:
+            fetch_real(q->sym1, "%xmm0");
+            fetch_real(q->sym2, "%xmm1");
+            out << "\t\t" << "addss" << "\t" << "%xmm1,%xmm0" << '\n';
+            store_real("%xmm0", q->sym3);
+            break;
+
+        case q_iplus:
+            fetch(q->sym1, "%eax");
+            fetch(q->sym2, "%ecx");
+            out << "\t\t" << "addl" << "\t" << "%ecx,%eax" << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_rminus:
+            fetch_real(q->sym1, "%xmm0");
+            fetch_real(q->sym2, "%xmm1");
+            out << "\t\t" << "subss" << "\t" << "%xmm1,%xmm0" << '\n';
+            store_real("%xmm0", q->sym3);
+            break;
+
+        case q_iminus:
+            fetch(q->sym1, "%eax");
+            fetch(q->sym2, "%ecx");
+            out << "\t\t" << "subl" << "\t" << "%ecx,%eax" << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_ior:
+            fetch(q->sym1, "%eax");
+            fetch(q->sym2, "%ecx");
+            out << "\t\t" << "orl" << "\t" << "%ecx,%eax" << '\n';
+            out << "\t\t" << "setne" << "\t" << "%al" << '\n';
+            out << "\t\t" << "movzbl" << "\t" << "%al,%eax" << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_iand:
+            fetch(q->sym1, "%eax");
+            fetch(q->sym2, "%ecx");
+            out << "\t\t" << "testl" << "\t" << "%eax,%eax" << '\n';
+            out << "\t\t" << "setne" << "\t" << "%al" << '\n';
+            out << "\t\t" << "testl" << "\t" << "%ecx,%ecx" << '\n';
+            out << "\t\t" << "setne" << "\t" << "%cl" << '\n';
+            out << "\t\t" << "andb" << "\t" << "%cl,%al" << '\n';
+            out << "\t\t" << "movzbl" << "\t" << "%al,%eax" << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_rmult:
+            fetch_real(q->sym1, "%xmm0");
+            fetch_real(q->sym2, "%xmm1");
+            out << "\t\t" << "mulss" << "\t" << "%xmm1,%xmm0" << '\n';
+            store_real("%xmm0", q->sym3);
+            break;
+
+        case q_imult:
+            fetch(q->sym1, "%eax");
+            fetch(q->sym2, "%ecx");
+            out << "\t\t" << "imull" << "\t" << "%ecx,%eax" << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_rdivide:
+            fetch_real(q->sym1, "%xmm0");
+            fetch_real(q->sym2, "%xmm1");
+            out << "\t\t" << "divss" << "\t" << "%xmm1,%xmm0" << '\n';
+            store_real("%xmm0", q->sym3);
+            break;
+
+        case q_idivide:
+            fetch(q->sym1, "%eax");
+            fetch(q->sym2, "%ecx");
+            out << "\t\t" << "cltd" << '\n';
+            out << "\t\t" << "idivl" << "\t" << "%ecx" << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_imod:
+            fetch(q->sym1, "%eax");
+            fetch(q->sym2, "%ecx");
+            out << "\t\t" << "cltd" << '\n';
+            out << "\t\t" << "idivl" << "\t" << "%ecx" << '\n';
+            store("%edx", q->sym3);
+            break;
+
+        case q_req:
+            // ucomiss reports NaN as "unordered" through the parity flag.
+            fetch_real(q->sym1, "%xmm0");
+            fetch_real(q->sym2, "%xmm1");
+            out << "\t\t" << "ucomiss" << "\t" << "%xmm1,%xmm0" << '\n';
+            out << "\t\t" << "sete" << "\t" << "%al" << '\n';
+            out << "\t\t" << "setnp" << "\t" << "%cl" << '\n';
+            out << "\t\t" << "andb" << "\t" << "%cl,%al" << '\n';
+            out << "\t\t" << "movzbl" << "\t" << "%al,%eax" << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_ieq:
+            compare(q, "e");
+            break;
+
+        case q_rne:
+            fetch_real(q->sym1, "%xmm0");
+            fetch_real(q->sym2, "%xmm1");
+            out << "\t\t" << "ucomiss" << "\t" << "%xmm1,%xmm0" << '\n';
+            out << "\t\t" << "setne" << "\t" << "%al" << '\n';
+            out << "\t\t" << "setp" << "\t" << "%cl" << '\n';
+            out << "\t\t" << "orb" << "\t" << "%cl,%al" << '\n';
+            out << "\t\t" << "movzbl" << "\t" << "%al,%eax" << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_ine:
+            compare(q, "ne");
+            break;
+
+        case q_rlt:
+            compare_real(q, "a");
+            break;
+
+        case q_ilt:
+            compare(q, "l");
+            break;
+
+        case q_rgt:
+            compare_real(q, "a");
+            break;
+
+        case q_igt:
+            compare(q, "g");
+            break;
+
+        case q_rstore:
+        case q_istore:
+            // Addresses are kept relative to diesel_stack_base so that they
+            // fit in a 4-byte temporary. See q_lindex below.
+            fetch(q->sym1, "%eax");
+            fetch(q->sym3, "%ecx");
+            out << "\t\t" << "movslq" << "\t" << "%ecx,%rcx" << '\n';
+            out << "\t\t" << "addq" << "\t" << "diesel_stack_base(%rip),%rcx"
+                << '\n';
+            out << "\t\t" << "movl" << "\t" << "%eax,(%rcx)" << '\n';
+            break;
+
+        case q_rassign:
+        case q_iassign:
+            fetch(q->sym1, "%eax");
+            store("%eax", q->sym3);
+            break;
+
+        case q_param:
+            arg_stack.push(q->sym1);
+            break;
+
+        case q_call:
+            funcall(q);
+            break;
+
+        case q_rreturn:
+        case q_ireturn:
+            fetch(q->sym2, "%eax");
+            out << "\t\t" << "jmp" << "\t" << "L" << q->int1 << '\n';
+            break;
+
+        case q_lindex:
+            // All arrays live on the stack, so an element address always
+            // fits in 32 bits once it is made relative to the stack base.
+            fetch(q->sym2, "%ecx");
+            out << "\t\t" << "movslq" << "\t" << "%ecx,%rcx" << '\n';
+            array_address(q->sym1, "%rax");
+            out << "\t\t" << "leaq" << "\t" << "(%rax,%rcx,4),%rax" << '\n';
+            out << "\t\t" << "subq" << "\t" << "diesel_stack_base(%rip),%rax"
+                << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_rrindex:
+        case q_irindex:
+            fetch(q->sym2, "%ecx");
+            out << "\t\t" << "movslq" << "\t" << "%ecx,%rcx" << '\n';
+            array_address(q->sym1, "%rax");
+            out << "\t\t" << "movl" << "\t" << "(%rax,%rcx,4),%eax" << '\n';
+            store("%eax", q->sym3);
+            break;
+
+        case q_itor:
+            fetch(q->sym1, "%eax");
+            out << "\t\t" << "cvtsi2ss" << "\t" << "%eax,%xmm0" << '\n';
+            store_real("%xmm0", q->sym3);
+            break;
+
+        case q_jmp:
+            out << "\t\t" << "jmp" << "\t" << "L" << q->int1 << '\n';
+            break;
+
+        case q_jmpf:
+            fetch(q->sym2, "%eax");
+            out << "\t\t" << "testl" << "\t" << "%eax,%eax" << '\n';
+            out << "\t\t" << "je" << "\t" << "L" << q->int1 << '\n';
+            break;
+
+        case q_labl:
+            // We handled this one above already.
+            break;
+
+        case q_nop:
+            // q_nop quads should never be generated.
+            fatal("x86_code_generator::expand(): q_nop quadruple produced.");
+            return;
+        }
+
+        // Get the next quad from the list.
+        q = ql_iterator->get_next();
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef __CODEGEN_X86_HH__
+#define __CODEGEN_X86_HH__
+
+
+#include <fstream>
+#include <sstream>
+#include <stack>
+#include "codegen.hh"
+using namespace std;
+
+
+/* The frame layout used by the x86-64 backend. Every procedure keeps %rbp
+   as its frame pointer. The old display entry is saved just below it, the
+   local variables and temporaries follow below that, and the arguments are
+   found above the return address:
+
+       %rbp+16+4*n   argument n
+       %rbp+8        return address
+       %rbp          caller's %rbp
+       %rbp-8        saved display entry
+       %rbp-8-...    locals and temporaries (ar_size bytes)
+*/
+
+// The old display entry is stored at [%rbp-X86_DISPLAY_SAVE_OFFSET].
+const int X86_DISPLAY_SAVE_OFFSET = 8;
+
+// %rbp+X86_FIRST_ARG_OFFSET points at the first arg.
+const int X86_FIRST_ARG_OFFSET = 16;
+
+// The display holds one frame pointer per block level, see diesel_glue_x86.s.
+const int X86_DISPLAY_ENTRY_SIZE = 8;
+
+
+
+/* This class generates assembler code (GNU as, AT&T syntax) for x86-64
+   System V hosts. It expands the same quad lists as the Sparc
+   code_generator, but keeps the display in memory instead of in global
+   registers since x86-64 doesn't have any registers to spare for it. */
+class x86_code_generator : public assembler_backend
+{
+private:
+    ostringstream out;                                // Code for the current
+                                                      // block.
+
+    stack<sym_index> arg_stack;                       // Argument stack
+
+    block_level   current_level;                      // Level of the block
+                                                      // being expanded.
+
+    map<sym_index, int> temp_uses;                    // Reads of each
+                                                      // temporary.
+
+    int  align(int);                                  // Align a stack frame.
+    void prologue(symbol *);                          // Initialize new env.
+    void epilogue(symbol *);                          // Leave env.
+    void expand(quad_list *q);                        // Quadlist -> assembler.
+    void find(sym_index, int *, int *);               // Get variable/parameter
+                                                      // level & offset.
+    const char *frame_base(int);                      // Display -> register.
+    void fetch(sym_index, const char *);              // memory -> register.
+    void fetch_real(sym_index, const char *);         // memory -> xmm register.
+    void store(const char *, sym_index);              // register -> memory.
+    void store_real(const char *, sym_index);         // xmm register -> memory.
+    void array_address(sym_index, const char *);      // get array base addr.
+    void funcall(quadruple *);
+    void compare(quadruple *, const char *);          // Integer relation.
+    void compare_real(quadruple *, const char *);     // Real relation.
+    void fetch_real_operands(quadruple *);            // For compare_real().
+    void jump_on(quadruple *, int);                   // Compare and branch.
+
+public:
+    // Constructor. Args = filename of assembler outfile, or NULL to keep the
+    // code in memory, and whether it is a whole program, which starts with
+    // the glue code, or just a block, see new_buffered().
+    x86_code_generator(const char *, bool whole_program = true);
+
+    // Destructor.
+    virtual ~x86_code_generator();
+    virtual void generate_assembler(quad_list *, symbol *env); // Interface.
+    virtual assembler_backend *new_buffered();
+};
+
+#endif
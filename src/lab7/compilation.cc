@@ -0,0 +1,318 @@
+#include <sstream>
+#include "compilation.hh"
+#include "semantic.hh"
+#include "optimize.hh"
+#include "quadopt.hh"
+#include "codegen.hh"
+#include "codegen_x86.hh"
+#include "pipeline.hh"
+#include "profile.hh"
+#include "preprocess.hh"
+#include "units.hh"
+#include "parser.hh"
+#include "mutex.hh"
+
+/*** This file contains the compilation context, and compile_batch(). See
+     compilation.hh. ***/
+
+
+extern int target_x86;          // Defined in main.cc.
+extern int backend_threads;     // Defined in main.cc.
+extern int print_profile;       // Defined in main.cc.
+extern int print_symtab;        // Defined in main.cc.
+
+// From scanner.l output. The scanner is reentrant, and yyextra is the
+// compilation it belongs to.
+extern int  yylex_init_extra(compilation *, void **);
+extern void yyset_in(FILE *, void *);
+extern int  yylex_destroy(void *);
+
+// The compilation bound to this thread, if any.
+__thread compilation *current_compilation = NULL;
+
+// See snapshot_symbols().
+static symbol_table *pristine_symbols = NULL;
+
+
+/* Constructor. Creates a symbol table, with the predefined symbols, and
+   the other parts of the compiler, except the backend. */
+compilation::compilation(ostream &m, ostream &d) :
+    program_arena()
+{
+    sym_tab = NULL;
+    type_checker = NULL;
+    optimizer = NULL;
+    quad_opt = NULL;
+    code_gen = NULL;
+    pipeline = NULL;
+    profiler = NULL;
+    preproc = NULL;
+    units = NULL;
+    messages = &m;
+    diagnostics = &d;
+    error_count = 0;
+    column = 0;
+    nr_outer_arenas = 0;
+    void_type = integer_type = real_type = 0;
+
+    // The symbol table constructor allocates in the block arena, and sets
+    // the types on this thread.
+    bind();
+    if (pristine_symbols != NULL)
+        sym_tab = new symbol_table(*pristine_symbols);
+    else
+        sym_tab = new symbol_table();
+    void_type = ::void_type;
+    integer_type = ::integer_type;
+    real_type = ::real_type;
+
+    type_checker = new semantic();
+    optimizer = new ast_optimizer();
+    quad_opt = new quad_optimizer();
+    pipeline = new backend_pipeline();
+    profiler = new compile_profiler();
+    preproc = new preprocessor();
+    units = new unit_compiler();
+    if (print_profile)
+        profiler->enable();
+    bind();
+}
+
+
+
+/* Destructor. Waits for the backend threads, if any. */
+compilation::~compilation()
+{
+    delete pipeline;
+    delete units;
+    delete preproc;
+    delete profiler;
+    delete quad_opt;
+    delete optimizer;
+    delete type_checker;
+    delete sym_tab;
+    program_arena.release_all();
+
+    if (current_compilation == this)
+    {
+        current_compilation = NULL;
+        ::sym_tab = NULL;
+        ::type_checker = NULL;
+        ::optimizer = NULL;
+        ::quad_opt = NULL;
+        ::code_gen = NULL;
+        ::pipeline = NULL;
+        ::profiler = NULL;
+        ::preproc = NULL;
+        ::units = NULL;
+        message_stream = &cout;
+        diagnostic_stream = &cerr;
+        block_arena = NULL;
+    }
+}
+
+
+
+/* Make the pristine symbol table, see compilation.hh. Its constructor
+   needs a block arena for the position of the predefined symbols, which
+   isn't kept. */
+void compilation::snapshot_symbols()
+{
+    arena  positions = arena();
+    arena *saved = block_arena;
+
+    if (pristine_symbols != NULL)
+        return;
+    block_arena = &positions;
+    pristine_symbols = new symbol_table();
+    block_arena = saved;
+    positions.release_all();
+}
+
+
+
+/* Point the per thread globals at this compilation. */
+void compilation::bind()
+{
+    current_compilation = this;
+    ::sym_tab = sym_tab;
+    ::type_checker = type_checker;
+    ::optimizer = optimizer;
+    ::quad_opt = quad_opt;
+    ::code_gen = code_gen;
+    ::pipeline = pipeline;
+    ::profiler = profiler;
+    ::preproc = preproc;
+    ::units = units;
+    message_stream = messages;
+    diagnostic_stream = diagnostics;
+    ::error_count = error_count;
+    ::void_type = void_type;
+    ::integer_type = integer_type;
+    ::real_type = real_type;
+    block_arena = &program_arena;
+}
+
+
+
+/* Decide where the code goes. The backend must be set before parse(), and
+   outlive it. */
+void compilation::set_backend(assembler_backend *backend)
+{
+    code_gen = backend;
+    bind();
+}
+
+
+
+/* Compile the file: parse it, and hand each block to the backend as it is
+   finished. */
+int compilation::parse(FILE *input, const char *name)
+{
+    void *scanner;
+
+    bind();
+    column = 0;
+    preproc->set_source(name);
+    pipeline->start(backend_threads);
+    profiler->begin_run();
+
+    yylex_init_extra(this, &scanner);
+    yyset_in(input, scanner);
+
+    // After a fatal() the rest of the file is skipped. The blocks handed
+    // to the backend before it are still written out.
+    fatal_catchers++;
+    try
+    {
+        yyparse(scanner);
+    }
+    catch (fatal_error &)
+    {
+    }
+    fatal_catchers--;
+    yylex_destroy(scanner);
+
+    pipeline->finish();
+
+    // A syntax error or a fatal() may have left blocks open. The backend
+    // is done with them now.
+    while (nr_outer_arenas > 0)
+    {
+        block_arena->release_all();
+        delete block_arena;
+        block_arena = outer_arenas[--nr_outer_arenas];
+    }
+    error_count = ::error_count;
+    return error_count;
+}
+
+
+
+/* The files of a compile_batch(), and the first one not yet taken. */
+class batch_queue {
+public:
+    vector<batch_file> *files;
+    unsigned           next;
+    pthread_mutex_t    lock;
+};
+
+
+/* Compile one file of a batch, on the calling thread. */
+static void compile_file(batch_file &file)
+{
+    ostringstream messages, diagnostics;
+    FILE          *input = fopen(file.source.c_str(), "r");
+
+    if (input == NULL)
+    {
+        file.error_count = 1;
+        file.diagnostics = file.source + ": can't open the file\n";
+        return;
+    }
+
+    compilation       *c = new compilation(messages, diagnostics);
+    assembler_backend *backend;
+    const char        *output = NULL;       // In memory.
+
+    if (!file.output.empty())
+        output = file.output.c_str();
+    if (target_x86)
+        backend = new x86_code_generator(output);
+    else
+        backend = new code_generator(output);
+    c->set_backend(backend);
+    c->parse(input, file.source.c_str());
+    fclose(input);
+
+    // Closes the assembler output file, before the clock is stopped.
+    if (output == NULL)
+        file.code = backend->take_code();
+    delete backend;
+    c->set_backend(NULL);
+    c->profiler->end_run();
+    if (print_symtab)
+    {
+        sym_tab->print(2);
+        sym_tab->print(1);
+    }
+    if (c->profiler->is_enabled())
+        c->profiler->report(messages);
+
+    file.error_count = c->error_count;
+    delete c;
+    file.messages = messages.str();
+    file.diagnostics = diagnostics.str();
+}
+
+
+/* The body of a compile_batch() thread. */
+static void *batch_main(void *arg)
+{
+    batch_queue *queue = static_cast<batch_queue *>(arg);
+
+    for (;;)
+    {
+        batch_file *file;
+        {
+            mutex_lock guard(&queue->lock);
+            if (queue->next == queue->files->size())
+                return NULL;
+            file = &(*queue->files)[queue->next++];
+        }
+        compile_file(*file);
+    }
+}
+
+
+
+/* Compile the files, see compilation.hh. With one thread they are compiled
+   on the calling thread. */
+int compile_batch(vector<batch_file> &files, int threads)
+{
+    batch_queue       queue;
+    vector<pthread_t> workers;
+    int               errors = 0;
+
+    compilation::snapshot_symbols();
+    queue.files = &files;
+    queue.next = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+
+    if (threads <= 1)
+        batch_main(&queue);
+    else
+    {
+        workers.resize(threads);
+        for (int i = 0; i < threads; i++)
+            if (pthread_create(&workers[i], NULL, batch_main, &queue) != 0)
+                fatal("compile_batch: can't create a thread");
+        for (int i = 0; i < threads; i++)
+            pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+
+    for (unsigned i = 0; i < files.size(); i++)
+        errors += files[i].error_count;
+    return errors;
+}
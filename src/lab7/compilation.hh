@@ -0,0 +1,103 @@
+#ifndef __COMPILATION_HH__
+#define __COMPILATION_HH__
+
+
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "symtab.hh"
+using namespace std;
+
+
+/* Prototypes, see semantic.hh, optimize.hh, quadopt.hh, codegen.hh,
+   pipeline.hh, profile.hh, preprocess.hh and units.hh. */
+class semantic;
+class ast_optimizer;
+class quad_optimizer;
+class assembler_backend;
+class backend_pipeline;
+class compile_profiler;
+class preprocessor;
+class unit_compiler;
+
+
+/* Everything that belongs to the compilation of one source file. The rest
+   of the compiler reaches these through the globals sym_tab, code_gen,
+   error_count and so on, which are per thread: bind() points them at a
+   compilation. So any number of files can be compiled in one process, each
+   on a thread of its own, see compile_batch(). A compilation is run on the
+   thread that created it. The backend threads of -J bind it too, but only
+   read it, see pipeline.hh.
+
+   The command line options (the globals in main.cc) are shared by all
+   compilations, and so are the include units they compile, see units.hh. */
+class compilation {
+public:
+    symbol_table      *sym_tab;
+    semantic          *type_checker;
+    ast_optimizer     *optimizer;
+    quad_optimizer    *quad_opt;
+    assembler_backend *code_gen;        // Set with set_backend().
+    backend_pipeline  *pipeline;
+    compile_profiler  *profiler;
+    preprocessor      *preproc;
+    unit_compiler     *units;
+    arena             program_arena;    // For the global level.
+    ostream           *messages;        // Where the compiler's messages
+    ostream           *diagnostics;     //   and its error messages go.
+    int               error_count;      // Up to date after parse().
+    int               column;           // The scanner's, see scanner.l.
+
+    // The arenas of the blocks enclosing the open procedure or function,
+    // see parser.y. symbol_table::open_scope() makes sure there are no
+    // more of them than there are block levels.
+    arena             *outer_arenas[MAX_BLOCK + 1];
+    int               nr_outer_arenas;
+
+    // The types the symbol table installed, see symtab.cc.
+    sym_index         void_type;
+    sym_index         integer_type;
+    sym_index         real_type;
+
+    // The compilation is bound to the calling thread when created.
+    compilation(ostream &m = cout, ostream &d = cerr);
+    ~compilation();
+
+    // Install the predefined symbols once, in a table that the symbol
+    // tables of the compilations created after this are copies of, which
+    // is quicker. Called before any threads are started.
+    static void snapshot_symbols();
+
+    void bind();                        // Bind it to the calling thread.
+    void set_backend(assembler_backend *); // Not deleted by us.
+    int  parse(FILE *, const char *name); // Compile. The name is that of
+                                        // the file, or NULL for stdin.
+                                        // Returns error_count.
+};
+
+
+extern __thread compilation *current_compilation; // Defined in
+                                                  //   compilation.cc.
+
+
+/* A source file for compile_batch(), and what became of it. */
+class batch_file {
+public:
+    string source;                      // The Diesel file,
+    string output;                      //   and the assembler to write,
+    string code;                        //   or the assembler itself, if
+                                        //   output is empty.
+    int    error_count;
+    string messages;                    // What was written to messages
+    string diagnostics;                 //   and diagnostics.
+};
+
+
+/* The library entry point: compiles the files on the given number of
+   threads, each file start to finish on one of them. The backend is chosen
+   by the same options as on the command line. Returns the total number of
+   errors. */
+extern int compile_batch(vector<batch_file> &, int threads);
+
+#endif
@@ -20,7 +20,7 @@ main:				! this is where the process starts
 	std	%g2,[%o1+8]
 	std	%g4,[%o1+16]
 	std	%g6,[%o1+24]
-	call	L3,0		! L3 is the DIESEL main program label
+	call	diesel_main,0	! the DIESEL main program, see symtab.hh
 	nop
 	ret
 	restore
@@ -52,7 +52,7 @@ L0:			! read
 	save	%sp,-64,%sp
 	call	swap_display,0
 	nop
-	call	getchar,0
+	call	myreadchar,0	! in diesel_rts.o
 	nop
 	call	swap_display,0
 	nop
@@ -86,6 +86,32 @@ L2:			! trunc
 	.type	L2,#function
 	.size	L2,(.-L2)
 
+L3:			! writeint
+	save	%sp,-96,%sp
+	call	swap_display,0
+	nop
+	call	mywriteint,1	! in diesel_rts.o
+	mov	%i0,%o0
+	call	swap_display,0
+	nop
+	ret
+	restore
+	.type	L3,#function
+	.size	L3,(.-L3)
+
+L4:			! writereal
+	save	%sp,-96,%sp
+	call	swap_display,0
+	nop
+	call	mywritereal,1	! in diesel_rts.o
+	mov	%i0,%o0
+	call	swap_display,0
+	nop
+	ret
+	restore
+	.type	L4,#function
+	.size	L4,(.-L4)
+
 Mul:
 	save	%sp,-96,%sp
 	call	swap_display,0
@@ -0,0 +1,81 @@
+# diesel_glue_x86.s
+# assembly code for some DIESEL run-time support, x86-64 version
+# (this should be included by d.out when compiling with -x)
+#
+# Calling convention used by the generated code: the caller reserves an
+# aligned block of 4-byte argument slots at the top of its stack, first
+# argument lowest, so the callee finds argument n at 8+4*n(%rsp) on entry.
+# Results come back in %eax; reals are passed around as their ieee bits.
+
+	.bss
+	.align	8
+	.globl	display
+display:
+	.skip	128
+	.type	display,@object
+	.size	display,128
+
+	.align	8
+	.globl	diesel_stack_base
+diesel_stack_base:			# array addresses are stored relative
+	.skip	8			# to this, see codegen_x86.cc
+	.type	diesel_stack_base,@object
+	.size	diesel_stack_base,8
+
+	.text
+	.globl	main
+	.type	main,@function
+main:				# this is where the process starts
+	pushq	%rbp
+	movq	%rsp,%rbp
+	movq	%rsp,diesel_stack_base(%rip)
+	call	diesel_main	# the DIESEL main program, see symtab.hh
+	xorl	%eax,%eax
+	popq	%rbp
+	ret
+	.size	main,(.-main)
+
+L0:			# read
+	subq	$8,%rsp
+	call	myreadchar@PLT	# in diesel_rts.o
+	addq	$8,%rsp
+	ret
+	.type	L0,@function
+	.size	L0,(.-L0)
+
+L1:			# write
+	movl	8(%rsp),%edi
+	subq	$8,%rsp
+	call	myputchar@PLT	# in diesel_rts.o
+	addq	$8,%rsp
+	ret
+	.type	L1,@function
+	.size	L1,(.-L1)
+
+L2:			# trunc
+	movss	8(%rsp),%xmm0
+	cvttss2si	%xmm0,%eax
+	ret
+	.type	L2,@function
+	.size	L2,(.-L2)
+
+L3:			# writeint
+	movl	8(%rsp),%edi
+	subq	$8,%rsp
+	call	mywriteint@PLT	# in diesel_rts.o
+	addq	$8,%rsp
+	ret
+	.type	L3,@function
+	.size	L3,(.-L3)
+
+L4:			# writereal
+	movl	8(%rsp),%edi
+	subq	$8,%rsp
+	call	mywritereal@PLT	# in diesel_rts.o
+	addq	$8,%rsp
+	ret
+	.type	L4,@function
+	.size	L4,(.-L4)
+
+	.section	.note.GNU-stack,"",@progbits
+	.text
@@ -1,9 +1,54 @@
 /* diesel_rts.c */
 #include <stdio.h>
 
+/* Output goes through the stdio buffer of stdout, which is written out
+   when it fills up, when the program exits, and before each read() so
+   that a prompt is seen before the program waits for input. */
+
 void myputchar(ch)
     int ch;
 {
     putc(ch, stdout);
+}
+
+int myreadchar()
+{
     fflush(stdout);
+    return getchar();
+}
+
+/* writeint() and writereal() format a whole number at once. They print the
+   same thing as write_int() and write_real() in testpgm/stdio.d. */
+
+void mywriteint(val)
+    int val;
+{
+    char buf[12];
+    char *p = buf + sizeof(buf);
+    unsigned int u = val < 0 ? -(unsigned int)val : (unsigned int)val;
+
+    *--p = '\0';
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u > 0);
+    if (val < 0)
+        *--p = '-';
+    fputs(p, stdout);
+}
+
+/* A real is passed around by the generated code as its IEEE bits. */
+void mywritereal(bits)
+    int bits;
+{
+    union { int i; float f; } v;
+    int whole;
+    float frac;
+
+    v.i = bits;
+    whole = (int)v.f;
+    frac = (v.f - (float)whole) * 1e6f;   /* can only warrant 7 digits */
+    mywriteint(whole);
+    putc('.', stdout);
+    mywriteint((int)frac);
 }
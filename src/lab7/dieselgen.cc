@@ -0,0 +1,291 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*** This is a generator for synthetic Diesel programs, used by the
+     'benchmark' script to measure how the compiler scales. The programs
+     are meant to be compiled rather than run, but they are valid Diesel
+     that runs to completion: loops are bounded, array indexes are in range
+     and nothing is divided by zero. The program writes a letter computed
+     from its results at the end, so the backends can be checked against
+     each other. The same options and seed always give
+     the same program. ***/
+
+
+/* The shape of the generated program. */
+static int nr_procedures = 20;     // Top level procedures.
+static int nesting = 2;            // Levels of procedures inside them.
+static int children = 2;           // Procedures declared in each of those.
+static int nr_statements = 20;     // Statements in each body.
+static int nr_variables = 6;       // Local variables in each block.
+static int expr_length = 6;        // Operators in each expression.
+static int nr_constants = 50;      // Global constants.
+static int array_size = 100;       // Size of the global array.
+static unsigned long seed = 1;
+
+/* Procedures can't nest deeper than the display registers allow. The
+   program is at level 1, so the top level procedures are at level 2 and
+   %g7 is the display register of the innermost ones. */
+static const int MAX_NESTING = 5;
+
+
+/* A small linear congruential generator, so that the output doesn't depend
+   on the C library. */
+static int random_int(int n)
+{
+    seed = seed * 1103515245 + 12345;
+    return (int)((seed >> 16) % (unsigned long)n);
+}
+
+
+/* Write an integer expression with n operators, using the variables of
+   the block and the global constants and array. */
+static void expression(ostream &o, int n, const vector<string> &vars)
+{
+    if (n == 0)
+    {
+        switch (random_int(4))
+        {
+        case 0:
+            o << random_int(1000);
+            break;
+        case 1:
+            if (nr_constants > 0)
+            {
+                o << "C" << random_int(nr_constants);
+                break;
+            }
+            // Fall through.
+        case 2:
+            o << "a[" << random_int(array_size) << "]";
+            break;
+        default:
+            o << vars[random_int(vars.size())];
+            break;
+        }
+        return;
+    }
+
+    int left = random_int(n);
+    o << "(";
+    expression(o, left, vars);
+    switch (random_int(5))
+    {
+    case 0:
+        o << " + ";
+        break;
+    case 1:
+        o << " - ";
+        break;
+    case 2:
+        o << " * ";
+        break;
+    case 3:
+        // Only divide by constants that can't be zero.
+        o << " div " << 1 + random_int(9) << " + ";
+        break;
+    default:
+        o << " mod " << 1 + random_int(99) << " + ";
+        break;
+    }
+    expression(o, n - 1 - left, vars);
+    o << ")";
+}
+
+
+/* Write a condition for an if or while. */
+static void condition(ostream &o, const vector<string> &vars)
+{
+    static const char *relations[] = { "<", ">", "=", "<>" };
+
+    expression(o, expr_length / 2, vars);
+    o << " " << relations[random_int(4)] << " ";
+    expression(o, expr_length / 2, vars);
+}
+
+
+/* Write the statements of a block. The first variable is reserved as a loop
+   counter, so that loops always terminate. */
+static void statements(ostream &o, const string &indent,
+                       const vector<string> &vars,
+                       const vector<string> &callees)
+{
+    for (int i = 0; i < nr_statements; i++)
+    {
+        const string &v = vars[1 + random_int(vars.size() - 1)];
+
+        switch (random_int(6))
+        {
+        case 0:
+            o << indent << vars[0] << " := 0;\n";
+            o << indent << "while " << vars[0] << " < "
+              << 1 + random_int(array_size < 10 ? array_size : 10) << " do\n";
+            o << indent << "    a[" << vars[0] << "] := ";
+            expression(o, expr_length, vars);
+            o << ";\n";
+            o << indent << "    " << vars[0] << " := " << vars[0]
+              << " + 1;\n";
+            o << indent << "end;\n";
+            break;
+        case 1:
+            o << indent << "if ";
+            condition(o, vars);
+            o << " then\n" << indent << "    " << v << " := ";
+            expression(o, expr_length, vars);
+            o << ";\n" << indent << "elsif ";
+            condition(o, vars);
+            o << " then\n" << indent << "    " << v << " := ";
+            expression(o, expr_length, vars);
+            o << ";\n" << indent << "else\n" << indent << "    " << v
+              << " := ";
+            expression(o, expr_length, vars);
+            o << ";\n" << indent << "end;\n";
+            break;
+        case 2:
+            o << indent << "a[" << random_int(array_size) << "] := ";
+            expression(o, expr_length, vars);
+            o << ";\n";
+            break;
+        default:
+            o << indent << v << " := ";
+            expression(o, expr_length, vars);
+            o << ";\n";
+            break;
+        }
+    }
+
+    // Each procedure is called once, by the block that declares it.
+    for (unsigned i = 0; i < callees.size(); i++)
+        o << indent << callees[i] << "(" << random_int(100) << ");\n";
+}
+
+
+/* Write a procedure and the procedures nested in it. */
+static void procedure(ostream &o, const string &name, int depth)
+{
+    string indent(4 * depth, ' ');
+    vector<string> vars;
+    vector<string> callees;
+    int i;
+
+    o << indent << "procedure " << name << "(x : integer);\n";
+    o << indent << "var\n";
+    for (i = 0; i < nr_variables; i++)
+    {
+        ostringstream v;
+        v << "v" << i;
+        o << indent << "    " << v.str() << " : integer;\n";
+        vars.push_back(v.str());
+    }
+    vars.push_back("x");
+
+    if (depth < nesting)
+    {
+        for (i = 0; i < children; i++)
+        {
+            ostringstream child;
+            child << name << "_" << i;
+            procedure(o, child.str(), depth + 1);
+            callees.push_back(child.str());
+        }
+    }
+
+    o << indent << "begin\n";
+    for (i = 0; i < nr_variables; i++)
+        o << indent << "    " << vars[i] << " := x + " << i << ";\n";
+    statements(o, indent + "    ", vars, callees);
+    o << indent << "end;\n\n";
+}
+
+
+static void usage(const char *program_name)
+{
+    cerr << "Usage: " << program_name << " [options]\n"
+         << "Writes a synthetic Diesel program to stdout.\n"
+         << "Options:\n"
+         << "  -p n    Top level procedures (" << nr_procedures << ").\n"
+         << "  -n n    Levels of nested procedures, at most "
+         << MAX_NESTING << " (" << nesting << ").\n"
+         << "  -k n    Procedures nested in each procedure ("
+         << children << ").\n"
+         << "  -s n    Statements per block (" << nr_statements << ").\n"
+         << "  -v n    Variables per block (" << nr_variables << ").\n"
+         << "  -e n    Operators per expression (" << expr_length << ").\n"
+         << "  -c n    Global constants (" << nr_constants << ").\n"
+         << "  -a n    Size of the global array (" << array_size << ").\n"
+         << "  -r n    Random seed (" << seed << ").\n";
+    exit(1);
+}
+
+
+int main(int argc, char **argv)
+{
+    int option;
+
+    while ((option = getopt(argc, argv, "p:n:k:s:v:e:c:a:r:h?")) != EOF)
+    {
+        switch (option)
+        {
+        case 'p': nr_procedures = atoi(optarg); break;
+        case 'n': nesting = atoi(optarg); break;
+        case 'k': children = atoi(optarg); break;
+        case 's': nr_statements = atoi(optarg); break;
+        case 'v': nr_variables = atoi(optarg); break;
+        case 'e': expr_length = atoi(optarg); break;
+        case 'c': nr_constants = atoi(optarg); break;
+        case 'a': array_size = atoi(optarg); break;
+        case 'r': seed = strtoul(optarg, NULL, 10); break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if (nesting > MAX_NESTING)
+        nesting = MAX_NESTING;
+    if (nesting < 0 || nr_procedures < 0 || children < 0 ||
+        nr_statements < 0 || nr_variables < 1 || expr_length < 0 ||
+        nr_constants < 0 || array_size < 1)
+        usage(argv[0]);
+
+    ostringstream o;
+    vector<string> globals;
+    int i;
+
+    o << "program bench;\n\n";
+    if (nr_constants > 0)
+    {
+        o << "const\n";
+        for (i = 0; i < nr_constants; i++)
+            o << "    C" << i << " = " << random_int(10000) << ";\n";
+        o << "\n";
+    }
+    o << "var\n";
+    o << "    a : array[" << array_size << "] of integer;\n";
+    o << "    i : integer;\n";
+    o << "    g : integer;\n\n";
+
+    for (i = 0; i < nr_procedures; i++)
+    {
+        ostringstream name;
+        name << "p" << i;
+        procedure(o, name.str(), 0);
+        globals.push_back(name.str());
+    }
+
+    vector<string> vars;
+    vars.push_back("i");
+    vars.push_back("g");
+    o << "begin\n";
+    o << "    g := 1;\n";
+    statements(o, "    ", vars, globals);
+    o << "    write(65 + (g mod 26 + 26) mod 26);\n";
+    o << "    write(10);\n";
+    o << "end.\n";
+
+    cout << o.str();
+    return 0;
+}
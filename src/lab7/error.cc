@@ -7,13 +7,22 @@
    isn't really necessary - bison provides the yynerrs variable which counts
    errors, right? - Yes, but we also want to keep track of semantic errors
    and the like, which bison can't detect. */
-int error_count = 0;
+__thread int error_count = 0;
+
+
+/* The number of enclosing scopes that catch fatal_error, see error.hh. */
+__thread int fatal_catchers = 0;
+
+
+/* The output streams, see error.hh. */
+__thread ostream *message_stream = &cout;
+__thread ostream *diagnostic_stream = &cerr;
 
 
 /* General error outstream. */
 ostream& error(char *header) {
     error_count++;
-    return cerr << header;
+    return *diagnostic_stream << header;
 }
 
 
@@ -24,19 +33,23 @@ ostream& error(position_information *pos) {
 }
 
 
-/* Abort program with error message. */
+/* Abort compiling with error message: the compilation if someone catches
+   fatal_error, else the program. */
 void fatal(char *msg) {
     error() << "Fatal: " << msg << endl << flush;
+    if(fatal_catchers > 0)
+	throw fatal_error();
     abort();
 }
 
 
-/* Used for parser errors. Bison uses this for parse errors not caught by
-   the grammar, so it's useful to at least include the line number. Since
-   the error is not one we've accounted for, we don't have access to any
+/* Used for scanner and parser errors. Bison uses this (through parser.y)
+   for parse errors not caught by the grammar, so it's useful to at least
+   include the line number, which is the scanner's current line. Since the
+   error is not one we've accounted for, we don't have access to any
    position_information. NOTE: Fix scanner.l so it catches weird syntax? */
-void yyerror(char *msg) {
-    error() << "line " << yylineno << ": " << msg << endl << flush;
+void yyerror(int line, char *msg) {
+    error() << "line " << line << ": " << msg << endl << flush;
 }
 
 /* Type conflict error outstream. */
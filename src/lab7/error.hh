@@ -5,6 +5,7 @@
 #include <sstream>
 #include <ostream>
 #include "stdlib.h"
+#include "arena.hh"
 
 using namespace std;
 
@@ -13,8 +14,13 @@ using namespace std;
      classes and files. Breaking the OO paradigm for the sake of convenience...
      So sue me. ***/
 
-extern int error_count;    // Defined in error.cc.
-extern int yylineno;       // Defined in scanner.cc (the generated file)
+extern __thread int error_count;   // Defined in error.cc.
+
+/* Where the compiler's messages and its error messages go. Normally cout
+   and cerr, but a compilation may have streams of its own, see
+   compilation.hh. */
+extern __thread ostream *message_stream;    // Defined in error.cc.
+extern __thread ostream *diagnostic_stream; // Defined in error.cc.
 
 /* This class contains (starting) line and column of a token, and is used to
    report the positions of errors in the code. */
@@ -26,16 +32,35 @@ private:
 public:
     position_information();
     position_information(int l, int c);
+
+    // These are allocated in the block arena, see arena.hh.
+    void *operator new(size_t size) { return block_arena->allocate(size); }
+    void operator delete(void *) {}
+
     int get_line();
     int get_column();
 };
    
 
+/* What fatal() throws, within a compilation, so that only the file being
+   compiled is given up, not the whole process: a batch goes on with the
+   next file, and the compile server with the next request. The message has
+   been printed, and counted as an error, when it is thrown. Caught by
+   compilation::parse() and the backend threads of -J, which increment
+   fatal_catchers while they are ready to; elsewhere fatal() aborts. */
+class fatal_error {
+};
+
+extern __thread int fatal_catchers; // Defined in error.cc.
+
+
 /* Various methods for printing things, with or without position info. 
    They are all defined for real in error.cc. */
-extern void      fatal(char *);     // Prints message, aborts compiling.
-extern void      yyerror(char *);   // This must be defined, but using
-                                    // error(pos) << "foo" is preferrable.
+extern void      fatal(char *);     // Prints message, aborts compiling,
+                                    // see fatal_error.
+extern void      yyerror(int,       // Scanner and parser errors, on the
+                         char *);   // given line. error(pos) << "foo" is
+                                    // preferrable.
 extern ostream&  error(char *header = "Error: ");
 extern ostream&  error(position_information *);
 extern ostream&  type_error();
@@ -0,0 +1,564 @@
+#include <iostream>
+#include <stdio.h>
+#include "symtab.hh"
+#include "quads.hh"
+#include "interpreter.hh"
+
+using namespace std;
+
+
+/*** This file contains a quad interpreter. Instead of expanding the quad
+     lists into assembler, each block is decoded into an array of
+     vm_instructions which are then run directly. The run-time memory is one
+     big array of 4-byte words. A frame looks like this, with the display
+     entry for the block level pointing at 'base':
+
+         base-1-n     parameter n
+         base+k       local variable/temporary at byte offset 4*k
+
+     Reals are kept as their ieee bit pattern throughout, just like in the
+     generated assembler. Addresses (from q_lindex) are word indexes into the
+     run-time memory, so they fit in an ordinary temporary. ***/
+
+
+/* Information about an active call, used when returning from it. */
+class vm_call {
+public:
+    int        return_pc;      // Where to continue in the caller.
+    int        level;          // Block level of the callee.
+    int        saved_display;  // The callee level's old display entry.
+    int        saved_top;      // First free word before the call.
+    vm_operand result;         // Where a function's result goes.
+};
+
+
+/* Converts between the ieee bit pattern and a float. */
+static float to_real(int bits)
+{
+    constant_value v;
+    v.ival = bits;
+    return v.rval;
+}
+
+static int from_real(float f)
+{
+    constant_value v;
+    v.rval = f;
+    return v.ival;
+}
+
+
+/* writeint() and writereal(), which print the same as write_int() and
+   write_real() in testpgm/stdio.d (and diesel_rts.c). */
+static void write_int(int val)
+{
+    unsigned int u = val < 0 ? -(unsigned int)val : (unsigned int)val;
+    char buf[12];
+    char *p = buf + sizeof(buf);
+
+    *--p = '\0';
+    do
+    {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u > 0);
+    if (val < 0)
+        *--p = '-';
+    fputs(p, stdout);
+}
+
+static void write_real(float val)
+{
+    int whole = (int)val;
+    float frac = (val - (float)whole) * 1e6f;
+
+    write_int(whole);
+    putchar('.');
+    write_int((int)frac);
+}
+
+
+// Constructor.
+quad_interpreter::quad_interpreter() :
+    main_proc(-1)
+{
+}
+
+
+
+/* Turn a quad argument into an operand. Constants become immediate values,
+   everything else a (level, word offset) pair. */
+vm_operand quad_interpreter::decode_operand(sym_index sym_p)
+{
+    vm_operand o;
+    symbol *sym = sym_tab->get_symbol(sym_p);
+
+    if (sym == NULL)
+    {
+        o.level = VM_UNUSED;
+        o.offset = 0;
+        return o;
+    }
+
+    switch (sym->tag)
+    {
+    case SYM_CONST:
+    {
+        constant_symbol *con = sym->get_constant_symbol();
+        if (con->type == real_type)
+            return immediate(sym_tab->ieee(con->const_value.rval));
+        return immediate(con->const_value.ival);
+    }
+    case SYM_VAR:
+    case SYM_ARRAY:
+        o.level = sym->level;
+        o.offset = sym->offset / 4;
+        return o;
+    case SYM_PARAM:
+        o.level = sym->level;
+        o.offset = -1 - sym->offset / 4;
+        return o;
+    default:
+        fatal("quad_interpreter::decode_operand(): bad operand");
+        return o;
+    }
+}
+
+
+/* An operand holding a value directly. */
+vm_operand quad_interpreter::immediate(int value)
+{
+    vm_operand o;
+    o.level = VM_IMMEDIATE;
+    o.offset = value;
+    return o;
+}
+
+
+/* Return the procs index for a procedure symbol. The preinstalled read,
+   write, trunc, writeint and writereal have no quads; they are recognised by their label number
+   (see symtab.cc and diesel_glue.s) and added the first time they're used. */
+int quad_interpreter::lookup_proc(sym_index sym_p)
+{
+    symbol *sym = sym_tab->get_symbol(sym_p);
+    map<symbol *, int>::iterator it = proc_index.find(sym);
+    if (it != proc_index.end())
+        return it->second;
+
+    int label;
+    if (sym->tag == SYM_FUNC)
+        label = sym->get_function_symbol()->label_nr;
+    else
+        label = sym->get_procedure_symbol()->label_nr;
+
+    vm_procedure proc;
+    proc.sym = sym;
+    proc.level = sym->level + 1;
+    switch (label)
+    {
+    case 0:
+        proc.entry = VM_BUILTIN_READ;
+        break;
+    case 1:
+        proc.entry = VM_BUILTIN_WRITE;
+        break;
+    case 2:
+        proc.entry = VM_BUILTIN_TRUNC;
+        break;
+    case 3:
+        proc.entry = VM_BUILTIN_WRITEINT;
+        break;
+    case 4:
+        proc.entry = VM_BUILTIN_WRITEREAL;
+        break;
+    default:
+        fatal("quad_interpreter: call to a procedure without code");
+        return -1;
+    }
+
+    procs.push_back(proc);
+    proc_index[sym] = procs.size() - 1;
+    return procs.size() - 1;
+}
+
+
+/* The number of words of locals and temporaries in a procedure's frame.
+   This is only final once the block's quads have been generated. */
+int quad_interpreter::frame_words(int proc)
+{
+    symbol *sym = procs[proc].sym;
+    if (sym->tag == SYM_FUNC)
+        return (sym->get_function_symbol()->ar_size + 3) / 4;
+    return (sym->get_procedure_symbol()->ar_size + 3) / 4;
+}
+
+
+
+/* This method is called from parser.y for each finished block. The block's
+   quads are decoded and appended to the code array. Jumps are resolved once
+   the whole block has been seen, calls only when the program is run since
+   the callee might be an enclosing block that isn't finished yet. */
+void quad_interpreter::generate_assembler(quad_list *q_list, symbol *env)
+{
+    quadruple *q;
+    vm_procedure proc;
+    int first = code.size();
+
+    proc.sym = env;
+    proc.level = env->level + 1;
+    proc.entry = first;
+
+    quad_list_iterator *ql_iterator = new quad_list_iterator(q_list);
+    for (q = ql_iterator->get_current(); q != NULL; q = ql_iterator->get_next())
+    {
+        vm_instruction i;
+        i.op = q->op_code;
+        i.target = 0;
+        i.count = 0;
+
+        switch (q->op_code)
+        {
+        case q_labl:
+            label_pc[q->int1] = code.size();
+            continue;
+        case q_iload:
+        case q_rload:
+            i.a = immediate(q->int1);
+            i.b = decode_operand(NULL_SYM);
+            i.c = decode_operand(q->sym3);
+            break;
+        case q_jmp:
+            i.target = q->int1;
+            i.a = i.b = i.c = decode_operand(NULL_SYM);
+            break;
+        case q_jmpf:
+        case q_ireturn:
+        case q_rreturn:
+            i.target = q->int1;
+            i.a = decode_operand(NULL_SYM);
+            i.b = decode_operand(q->sym2);
+            i.c = decode_operand(NULL_SYM);
+            break;
+        case q_call:
+            i.target = q->sym1;
+            i.count = q->int2;
+            i.a = i.b = decode_operand(NULL_SYM);
+            i.c = decode_operand(q->sym3);
+            break;
+        case q_nop:
+            fatal("quad_interpreter: q_nop quadruple produced.");
+            return;
+        default:
+            i.a = decode_operand(q->sym1);
+            i.b = decode_operand(q->sym2);
+            i.c = decode_operand(q->sym3);
+            break;
+        }
+        code.push_back(i);
+    }
+    delete ql_iterator;
+
+    // Falling off the end of the block returns from it.
+    vm_instruction ret;
+    ret.op = q_nop;
+    ret.a = ret.b = ret.c = decode_operand(NULL_SYM);
+    ret.target = ret.count = 0;
+    code.push_back(ret);
+
+    // Resolve the jumps. All labels a block jumps to are inside it.
+    for (unsigned int pc = first; pc < code.size(); pc++)
+    {
+        switch (code[pc].op)
+        {
+        case q_jmp:
+        case q_jmpf:
+        case q_ireturn:
+        case q_rreturn:
+            code[pc].target = label_pc[code[pc].target];
+            break;
+        default:
+            break;
+        }
+    }
+
+    procs.push_back(proc);
+    proc_index[env] = procs.size() - 1;
+
+    // The global level is the last block to be finished.
+    main_proc = procs.size() - 1;
+}
+
+
+
+// Accessors for operands, see the frame layout at the top of this file.
+#define SLOT(o)  (stack[display[(o).level] + (o).offset])
+#define VALUE(o) ((o).level == VM_IMMEDIATE ? (o).offset : SLOT(o))
+#define REAL(o)  (to_real(VALUE(o)))
+
+// Integer arithmetic is done in unsigned, where overflow is defined, and
+// wraps around like it does on the targets.
+#define WRAP(u)  ((int)(unsigned)(u))
+
+
+/* Run the program. */
+int quad_interpreter::execute()
+{
+    vector<int>     memory(VM_INITIAL_STACK_SIZE);
+    vector<int>     args;                      // Pending q_param values.
+    vector<vm_call> calls;                     // Active calls.
+    int             display[MAX_BLOCK + 2];
+    int             retval = 0;                // Last returned value.
+    int             top;                       // First free word.
+    int            *stack;
+    int             pc;
+
+    if (main_proc < 0)
+        return 0;
+
+    // Calls can be linked now that every block has been decoded.
+    for (unsigned int i = 0; i < code.size(); i++)
+    {
+        if (code[i].op == q_call)
+            code[i].target = lookup_proc(code[i].target);
+    }
+
+    for (int i = 0; i < MAX_BLOCK + 2; i++)
+        display[i] = 0;
+
+    stack = &memory[0];
+    display[procs[main_proc].level] = 0;
+    top = frame_words(main_proc);
+    pc = procs[main_proc].entry;
+
+    for (;;)
+    {
+        const vm_instruction &i = code[pc++];
+
+        switch (i.op)
+        {
+        case q_iload:
+        case q_rload:
+        case q_iassign:
+        case q_rassign:
+            SLOT(i.c) = VALUE(i.a);
+            break;
+
+        case q_inot:
+            SLOT(i.c) = !VALUE(i.a);
+            break;
+
+        case q_ruminus:
+            SLOT(i.c) = from_real(-REAL(i.a));
+            break;
+
+        case q_iuminus:
+            SLOT(i.c) = WRAP(0u - VALUE(i.a));
+            break;
+
+        case q_rplus:
+            SLOT(i.c) = from_real(REAL(i.a) + REAL(i.b));
+            break;
+
+        case q_iplus:
+            SLOT(i.c) = WRAP((unsigned)VALUE(i.a) + VALUE(i.b));
+            break;
+
+        case q_rminus:
+            SLOT(i.c) = from_real(REAL(i.a) - REAL(i.b));
+            break;
+
+        case q_iminus:
+            SLOT(i.c) = WRAP((unsigned)VALUE(i.a) - VALUE(i.b));
+            break;
+
+        case q_ior:
+            SLOT(i.c) = VALUE(i.a) || VALUE(i.b);
+            break;
+
+        case q_iand:
+            SLOT(i.c) = VALUE(i.a) && VALUE(i.b);
+            break;
+
+        case q_rmult:
+            SLOT(i.c) = from_real(REAL(i.a) * REAL(i.b));
+            break;
+
+        case q_imult:
+            SLOT(i.c) = WRAP((unsigned)VALUE(i.a) * VALUE(i.b));
+            break;
+
+        case q_rdivide:
+            SLOT(i.c) = from_real(REAL(i.a) / REAL(i.b));
+            break;
+
+        case q_idivide:
+        case q_imod:
+            if (VALUE(i.b) == 0)
+            {
+                error() << "Run-time error: division by zero" << endl;
+                return 1;
+            }
+            // The smallest integer divided by -1 doesn't fit, and traps
+            // on x86. The quotient wraps around, like the other
+            // operations, and the remainder is 0.
+            if (VALUE(i.b) == -1)
+                SLOT(i.c) = i.op == q_idivide ? WRAP(0u - VALUE(i.a)) : 0;
+            else if (i.op == q_idivide)
+                SLOT(i.c) = VALUE(i.a) / VALUE(i.b);
+            else
+                SLOT(i.c) = VALUE(i.a) % VALUE(i.b);
+            break;
+
+        case q_req:
+            SLOT(i.c) = REAL(i.a) == REAL(i.b);
+            break;
+
+        case q_ieq:
+            SLOT(i.c) = VALUE(i.a) == VALUE(i.b);
+            break;
+
+        case q_rne:
+            SLOT(i.c) = REAL(i.a) != REAL(i.b);
+            break;
+
+        case q_ine:
+            SLOT(i.c) = VALUE(i.a) != VALUE(i.b);
+            break;
+
+        case q_rlt:
+            SLOT(i.c) = REAL(i.a) < REAL(i.b);
+            break;
+
+        case q_ilt:
+            SLOT(i.c) = VALUE(i.a) < VALUE(i.b);
+            break;
+
+        case q_rgt:
+            SLOT(i.c) = REAL(i.a) > REAL(i.b);
+            break;
+
+        case q_igt:
+            SLOT(i.c) = VALUE(i.a) > VALUE(i.b);
+            break;
+
+        case q_rstore:
+        case q_istore:
+            stack[VALUE(i.c)] = VALUE(i.a);
+            break;
+
+        case q_lindex:
+            SLOT(i.c) = display[i.a.level] + i.a.offset + VALUE(i.b);
+            break;
+
+        case q_rrindex:
+        case q_irindex:
+            SLOT(i.c) = stack[display[i.a.level] + i.a.offset + VALUE(i.b)];
+            break;
+
+        case q_itor:
+            SLOT(i.c) = from_real((float)VALUE(i.a));
+            break;
+
+        case q_jmp:
+            pc = i.target;
+            break;
+
+        case q_jmpf:
+            if (!VALUE(i.b))
+                pc = i.target;
+            break;
+
+        case q_ireturn:
+        case q_rreturn:
+            retval = VALUE(i.b);
+            pc = i.target;
+            break;
+
+        case q_param:
+            args.push_back(VALUE(i.a));
+            break;
+
+        case q_call:
+        {
+            const vm_procedure &callee = procs[i.target];
+
+            if (callee.entry < 0)
+            {
+                // The predefined procedures and functions.
+                switch (callee.entry)
+                {
+                case VM_BUILTIN_READ:
+                    fflush(stdout);
+                    retval = getchar();
+                    break;
+                case VM_BUILTIN_WRITE:
+                    putchar(args.back());
+                    break;
+                case VM_BUILTIN_TRUNC:
+                    retval = (int)to_real(args.back());
+                    break;
+                case VM_BUILTIN_WRITEINT:
+                    write_int(args.back());
+                    break;
+                case VM_BUILTIN_WRITEREAL:
+                    write_real(to_real(args.back()));
+                    break;
+                }
+                args.resize(args.size() - i.count);
+                if (i.c.level != VM_UNUSED)
+                    SLOT(i.c) = retval;
+                break;
+            }
+
+            // The first argument is on top of the args stack, and ends up
+            // closest to the new frame base.
+            int base = top + i.count;
+            int words = frame_words(i.target);
+            if (base + words > (int)memory.size())
+            {
+                memory.resize(2 * (base + words));
+                stack = &memory[0];
+            }
+            for (int k = 0; k < i.count; k++)
+                stack[base - 1 - k] = args[args.size() - 1 - k];
+            args.resize(args.size() - i.count);
+
+            vm_call call;
+            call.return_pc = pc;
+            call.level = callee.level;
+            call.saved_display = display[callee.level];
+            call.saved_top = top;
+            call.result = i.c;
+            calls.push_back(call);
+
+            display[callee.level] = base;
+            top = base + words;
+            pc = callee.entry;
+            break;
+        }
+
+        case q_nop:
+        {
+            // Return from the current procedure.
+            if (calls.empty())
+            {
+                fflush(stdout);
+                return 0;
+            }
+
+            const vm_call &call = calls.back();
+            display[call.level] = call.saved_display;
+            top = call.saved_top;
+            pc = call.return_pc;
+            if (call.result.level != VM_UNUSED)
+                SLOT(call.result) = retval;
+            calls.pop_back();
+            break;
+        }
+
+        case q_labl:
+            // Labels are removed while decoding.
+            break;
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef __INTERPRETER_HH__
+#define __INTERPRETER_HH__
+
+
+#include <vector>
+#include <map>
+#include "symtab.hh"
+#include "quads.hh"
+#include "codegen.hh"
+using namespace std;
+
+
+/* This marks an operand that holds its value directly instead of referring
+   to a frame slot. Used for constants. */
+const int VM_IMMEDIATE = -1;
+
+/* Marks a '-' operand, ie, one that the quad doesn't use. */
+const int VM_UNUSED = -2;
+
+/* The number of words the interpreter stack initially holds. It grows on
+   demand, so this is just to avoid reallocating for small programs. */
+const int VM_INITIAL_STACK_SIZE = 64 * 1024;
+
+
+/* A quad operand after decoding. Variables and temporaries are addressed as
+   a word offset from the frame base of their block level, which is looked
+   up in the display at run time. */
+class vm_operand {
+public:
+    int level;    // Block level, or VM_IMMEDIATE/VM_UNUSED.
+    int offset;   // Word offset from the frame base, or the value itself.
+};
+
+
+/* A pre-decoded quad. Labels have been resolved into instruction indexes,
+   and q_labl quads are dropped since they don't do anything. A q_nop in
+   the decoded code means "return from the current procedure"; the quad
+   generator never produces real q_nops. */
+class vm_instruction {
+public:
+    quad_op_type op;
+    vm_operand   a;       // sym1 (or the value of int1 for loads)
+    vm_operand   b;       // sym2
+    vm_operand   c;       // sym3
+    int          target;  // Jump destination, or callee for q_call.
+    int          count;   // Number of arguments for q_call.
+};
+
+
+/* What the interpreter knows about a procedure or function. */
+class vm_procedure {
+public:
+    symbol      *sym;        // The procedure in the symbol table.
+    int          level;      // Block level of its locals.
+    int          entry;      // Index of its first instruction, or one of the
+                             // VM_BUILTIN_* values for the predefined ones.
+};
+
+const int VM_BUILTIN_READ = -1;
+const int VM_BUILTIN_WRITE = -2;
+const int VM_BUILTIN_TRUNC = -3;
+const int VM_BUILTIN_WRITEINT = -4;
+const int VM_BUILTIN_WRITEREAL = -5;
+
+
+/* This class executes quad lists directly instead of generating assembler
+   for them. Each block handed to generate_assembler() is decoded into a
+   compact instruction array; when the whole program has been parsed,
+   execute() runs it, starting with the global level block. */
+class quad_interpreter : public assembler_backend
+{
+private:
+    vector<vm_instruction> code;                 // All decoded blocks.
+    vector<vm_procedure>   procs;                // All decoded procedures.
+    map<symbol *, int>     proc_index;           // symbol -> procs index.
+    map<long, int>         label_pc;             // Label -> instruction index.
+    int                    main_proc;            // Index of the global block.
+
+    vm_operand decode_operand(sym_index);        // sym_index -> operand.
+    vm_operand immediate(int);                   // int -> operand.
+    int        lookup_proc(sym_index);           // Find or add a builtin.
+    int        frame_words(int);                 // Locals+temps of a proc.
+
+public:
+    // Constructor.
+    quad_interpreter();
+
+    virtual void generate_assembler(quad_list *, symbol *env); // Interface.
+
+    // Runs the program. Returns 0 on success, 1 on a run-time error.
+    int execute();
+};
+
+#endif
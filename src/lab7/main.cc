@@ -1,4 +1,6 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -6,10 +8,15 @@
 
 #include "ast.hh"
 #include "parser.hh"
+#include "codegen.hh"
+#include "codegen_x86.hh"
+#include "interpreter.hh"
+#include "profile.hh"
+#include "compilation.hh"
+#include "server.hh"
 
 using namespace std;
 
-extern void yyparse();
 extern int yydebug;
 int assembler_trace = 0;
 int print_ast = 0;
@@ -18,101 +25,335 @@ int no_typecheck = 0;
 int no_optimize = 0;
 int no_quads = 0;
 int no_assembler = 0;
+int no_register_allocation = 0;
+int target_x86 = 0;
+int sparc_v8 = 0;
+int short_circuit = 0;
+int interpret = 0;
+int backend_threads = 0;
+int print_profile = 0;
+int print_symtab = 0;
+const char *assembler_file_name = "d.out";
+vector<string> include_path;            // -I, -D and -U, see
+vector<string> defined_macros;          //   preprocess.hh.
+vector<string> undefined_macros;
 
-void usage(const char *program_name) {
-    cerr << "Usage:\n"
-	 << program_name << " [-acdfpqsty] inputfile\n"
+// The options only main() needs, set by read_options() too.
+static int output_given = 0;
+static int batch_threads = 1;
+static const char *server_socket = NULL;
+
+void usage(const char *program_name, ostream &out) {
+    out << "Usage:\n"
+	 << program_name << " [-8acdfijpqrstTxy] [-Dname[=value]] [-Idir] [-Uname]\n"
+	 << "            [-J threads] [-o outfile] inputfile\n"
+	 << program_name << " [-8acdfjqrstTxy] [-Dname[=value]] [-Idir] [-Uname]\n"
+	 << "            [-J threads] [-P threads] inputfile...\n"
+	 << program_name << " -S socket\n"
+	 << program_name << " -C socket [options] inputfile\n"
 	 << program_name << " [-h?]\n"
 	 << "Options:\n"
 	 << "  -h, -?            Shows this message.\n"
+	 << "  -8                Use the Sparc V8 multiply and divide\n"
+	 << "                    instructions.\n"
 	 << "  -a                Print AST (abstract syntax tree).\n"
 	 << "  -c                Disable type checking.\n"
+	 << "  -C socket         Have the compile server on socket compile\n"
+	 << "                    the file. Must be the first option.\n"
 	 << "  -d                Turn on parser debugging.\n"
+	 << "  -D name[=value]   Define a macro, as if by #define. The value\n"
+	 << "                    is 1 if none is given.\n"
 	 << "  -f                Don't optimize.\n"
+	 << "  -i                Run the program instead of generating assembler.\n"
+	 << "  -I dir            Look for include files in dir too.\n"
+	 << "  -j                Short-circuit and/or in the conditions of\n"
+	 << "                    if, elsif and while.\n"
+	 << "  -J threads        Optimize and generate code for the blocks on\n"
+	 << "                    this many threads, while parsing goes on.\n"
+	 << "  -o outfile        Write the assembler code to outfile instead\n"
+	 << "                    of d.out.\n"
+	 << "  -P threads        Compile the input files on this many threads.\n"
+	 << "                    With several input files, the code for foo.d\n"
+	 << "                    is written to foo.s.\n"
 	 << "  -p                Don't generate quads.\n"
 	 << "  -q                Print quad lists.\n"
+	 << "  -r                Don't keep variables in registers.\n"
 	 << "  -s                Don't generate assembler code.\n"
+	 << "  -S socket         Be a compile server, listening on socket.\n"
 	 << "  -t                Include trace printouts in assembler code.\n"
+	 << "  -T                Print a compile-time profile, and write it\n"
+	 << "                    to profile.json.\n"
+	 << "  -U name           Undefine a macro given with -D.\n"
+	 << "  -x                Generate x86-64 assembler instead of Sparc.\n"
 	 << "  -y                Print symbol table.\n";    
-    exit(1);
 }
     
 
-int main(int argc, char **argv) {
-    const char *options = "acdfpqstyh?";
+/* Compile several files at once, see compile_batch(). Their messages are
+   printed in the order the files were given. Returns 1 if there were
+   errors in any of them. */
+int compile_batch_files(int nr_files, char **names, int threads) {
+    vector<batch_file> files(nr_files);
+
+    for(int i = 0; i < nr_files; i++) {
+	string name = names[i];
+	files[i].source = name;
+	if(name.size() > 2 && name.compare(name.size() - 2, 2, ".d") == 0)
+	    name.erase(name.size() - 2);
+	files[i].output = name + ".s";
+    }
+
+    int errors = compile_batch(files, threads);
+
+    for(int i = 0; i < nr_files; i++) {
+	cout << files[i].messages << flush;
+	cerr << files[i].diagnostics << flush;
+	if(files[i].error_count > 0)
+	    cerr << files[i].source << ": " << files[i].error_count
+		 << " errors.\n" << flush;
+    }
+    return errors > 0 ? 1 : 0;
+}
+
+
+/* Set the options from the command line, and tell what they do on out.
+   They are all reset first, since the compile server does this once for
+   every request. Returns the index of the first file in argv, or -1 if
+   the command line is wrong. */
+int read_options(int argc, char **argv, ostream &out) {
+    const char *options = "8acdD:fiI:jJ:o:P:pqrsS:tTU:xyh?";
     int option;
-    int print_symtab = 0;
-    
-    extern  FILE *yyin;
-    
+
+    assembler_trace = print_ast = print_quads = no_typecheck = no_optimize = 0;
+    no_quads = no_assembler = no_register_allocation = target_x86 = 0;
+    sparc_v8 = short_circuit = interpret = backend_threads = 0;
+    print_profile = print_symtab = output_given = 0;
+    batch_threads = 1;
+    assembler_file_name = "d.out";
+    server_socket = NULL;
+    include_path.clear();
+    defined_macros.clear();
+    undefined_macros.clear();
+    yydebug = 0;
+
     opterr = 0;
     optopt = '?';
+    optind = 0;                         // Start over.
     
     // Check for options.
     while((option = getopt(argc, argv, options)) != EOF) {
 	switch(option) {
+	    case '8':
+		out << "Sparc V8 multiply and divide will be used.\n" << flush;
+		sparc_v8 = 1;
+		break;
 	    case 'a':
-		cout << "An AST will be printed for each block.\n" << flush;
+		out << "An AST will be printed for each block.\n" << flush;
 		print_ast = 1;
 		break;
 	    case 'c':
-		cout << "No type checking will be performed.\n" << flush;
+		out << "No type checking will be performed.\n" << flush;
 		no_typecheck = 1;
 		break;
 	    case 'd':
-		cout << "Bison debugging turned on.\n" << flush;
+		out << "Bison debugging turned on.\n" << flush;
 		yydebug = 1;
 		break;
+	    case 'D':
+		defined_macros.push_back(optarg);
+		break;
 	    case 'f':
-		cout << "No optimization will be done.\n" << flush;
+		out << "No optimization will be done.\n" << flush;
 		no_optimize = 1;
 		break;
+	    case 'i':
+		out << "The program will be run by the quad interpreter.\n"
+		     << flush;
+		interpret = 1;
+		break;
+	    case 'I':
+		include_path.push_back(optarg);
+		break;
+	    case 'j':
+		out << "Conditions will be short-circuited.\n" << flush;
+		short_circuit = 1;
+		break;
+	    case 'J':
+		backend_threads = atoi(optarg);
+		out << "The backend will run on " << backend_threads
+		     << " threads.\n" << flush;
+		break;
+	    case 'o':
+		assembler_file_name = optarg;
+		output_given = 1;
+		break;
+	    case 'S':
+		server_socket = optarg;
+		break;
+	    case 'P':
+		batch_threads = atoi(optarg);
+		out << "The input files will be compiled on " << batch_threads
+		     << " threads.\n" << flush;
+		break;
 	    case 'p':
-		cout << "No quads will be generated.\n" << flush;
+		out << "No quads will be generated.\n" << flush;
 		no_quads = 1;
 		break;
 	    case 'q':
-		cout << "A quad list will be printed for each block.\n"
+		out << "A quad list will be printed for each block.\n"
 		     << flush;
 		print_quads = 1;
 		break;
+	    case 'r':
+		out << "No register allocation will be done.\n" << flush;
+		no_register_allocation = 1;
+		break;
 	    case 's':
-		cout << "No assembler code will be generated.\n" << flush;
+		out << "No assembler code will be generated.\n" << flush;
 		no_assembler = 1;
 		break;
 	    case 't':
-		cout << "Assembler code will contain quad labels.\n" << flush;
+		out << "Assembler code will contain quad labels.\n" << flush;
 		assembler_trace = 1;
 		break;
+	    case 'T':
+		out << "A compile-time profile will be printed.\n" << flush;
+		print_profile = 1;
+		break;
+	    case 'U':
+		undefined_macros.push_back(optarg);
+		break;
+	    case 'x':
+		out << "x86-64 assembler code will be generated.\n" << flush;
+		target_x86 = 1;
+		break;
 	    case 'y':
-		cout << "Symbol table will be printed after compilation.\n";
+		out << "Symbol table will be printed after compilation.\n"
+		    << flush;
 		print_symtab = 1;
 		break;
 	    case 'h':
 	    case '?':
-		usage(argv[0]);
-		break;
+		return -1;
 	    default:
 		break;
 	}
     }
 
-    if(optind > argc || optind < argc-1) {
-	usage(argv[0]);
+    return optind;
+}
+
+
+/* Compile a file for a client of the compile server, see server.hh. It is
+   compiled by compile_batch(), with its code kept in memory. */
+void compile_for_client(compile_request &request) {
+    vector<char *> argv;
+    ostringstream messages, diagnostics;
+
+    argv.push_back((char *)"compiler");
+    for(unsigned i = 0; i < request.args.size(); i++)
+	argv.push_back((char *)request.args[i].c_str());
+    argv.push_back(NULL);
+
+    int first = read_options(argv.size() - 1, &argv[0], messages);
+    if(first < 0 || first != (int)argv.size() - 2) {
+	usage("compiler -C socket", diagnostics);
+	request.diagnostics = diagnostics.str();
+	request.status = 1;
+	return;
+    }
+    if(interpret || yydebug || batch_threads > 1 || server_socket != NULL) {
+	request.diagnostics = "The compile server can't do -d, -i, -P or -S.\n";
+	request.status = 1;
+	return;
+    }
+
+    vector<batch_file> files(1);
+    files[0].source = argv[first];
+    compile_batch(files, 1);
+
+    request.messages = messages.str() + files[0].messages;
+    request.diagnostics = files[0].diagnostics;
+    request.status = files[0].error_count > 0 ? 1 : 0;
+
+    // Nothing is written if the file couldn't be read.
+    if(!files[0].code.empty()) {
+	request.output = assembler_file_name;
+	request.code = files[0].code;
+    }
+}
+
+
+int main(int argc, char **argv) {
+    FILE *input;
+
+    // The client has the server do all of it.
+    if(argc > 2 && strcmp(argv[1], "-C") == 0)
+	exit(run_client(argv[2], argc - 3, argv + 3));
+
+    if(read_options(argc, argv, cout) < 0) {
+	usage(argv[0], cerr);
+	exit(1);
+    }
+
+    if(server_socket != NULL) {
+	if(optind != argc) {
+	    usage(argv[0], cerr);
+	    exit(1);
+	}
+	compilation::snapshot_symbols();
+	exit(run_server(server_socket, compile_for_client));
+    }
+
+    // Several files are compiled with compile_batch(), see compilation.hh.
+    if(optind < argc-1 || batch_threads > 1) {
+	if(optind == argc || interpret || output_given) {
+	    usage(argv[0], cerr);
+	    exit(1);
+	}
+	exit(compile_batch_files(argc - optind, argv + optind, batch_threads));
+    }
+
+    if(optind > argc) {
+	usage(argv[0], cerr);
+	exit(1);
     } else if(optind == argc) {
-	yyin = stdin;
+	input = stdin;
     } else {
-	yyin = fopen(argv[optind], "r");
-	if(yyin == NULL) {
+	input = fopen(argv[optind], "r");
+	if(input == NULL) {
 	    perror(argv[optind]);
 	    exit(1);
 	}
     }
 
-    // Start the compilation. This is where all the magic is done.
-    // This function resides in parser.cc, which is generated by bison from
+    // Everything that belongs to this compilation, such as the symbol table
+    // with the predefined symbols.
+    compilation *comp = new compilation();
+
+    // Pick the backend parser.y will hand the quad lists to.
+    quad_interpreter *interpreter = NULL;
+    if(interpret) {
+	interpreter = new quad_interpreter();
+	comp->set_backend(interpreter);
+    } else if(target_x86) {
+	comp->set_backend(new x86_code_generator(assembler_file_name));
+    } else {
+	comp->set_backend(new code_generator(assembler_file_name));
+    }
+
+    // Start the compilation. This is where all the magic is done. The
+    // parser resides in parser.cc, which is generated by bison from
     // parser.y.
-    yyparse();
+    comp->parse(input, optind < argc ? argv[optind] : NULL);
+
+    // Closes the assembler output file, before the clock is stopped so that
+    // the last write is measured too.
+    if(interpreter == NULL) {
+	delete code_gen;
+	comp->set_backend(NULL);
+    }
+    profiler->end_run();
 
     // If given the appropriate flag, prints the symbol table after the input
     // has been parsed.
@@ -120,8 +361,25 @@ int main(int argc, char **argv) {
 	sym_tab->print(2);
 	sym_tab->print(1);
     }
+
+    // If given the -T flag, prints where the compile time went.
+    if(profiler->is_enabled()) {
+	profiler->report(cout);
+	ofstream json("profile.json");
+	profiler->write_json(json);
+    }
+
+    // Run the program if it compiled without errors.
+    if(interpreter != NULL && error_count == 0) {
+	exit(interpreter->execute());
+    }
+
+    // Only the interpreter can be left at this point.
+    delete code_gen;
+    delete comp;
     
-    exit(0);
+    // Nonzero after any error, such as a fatal() that gave up the file.
+    exit(error_count > 0 ? 1 : 0);
 }
     
     
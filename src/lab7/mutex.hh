@@ -0,0 +1,21 @@
+#ifndef __MUTEX_HH__
+#define __MUTEX_HH__
+
+
+#include <pthread.h>
+
+
+/* Holds a mutex for as long as it exists, so that every return out of a
+   function that locks one unlocks it too. Used by the symbol table and the
+   backend pipeline, which are shared with the worker threads of -J. */
+class mutex_lock
+{
+private:
+    pthread_mutex_t *mutex;
+
+public:
+    mutex_lock(pthread_mutex_t *m) : mutex(m) { pthread_mutex_lock(mutex); }
+    ~mutex_lock() { pthread_mutex_unlock(mutex); }
+};
+
+#endif
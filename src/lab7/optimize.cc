@@ -8,7 +8,8 @@
      implemented, only methods in this file should need to be changed. ***/
 
 
-ast_optimizer *optimizer = new ast_optimizer();
+// The AST optimizer of the compilation on this thread, see compilation.hh.
+__thread ast_optimizer *optimizer = NULL;
 
 
 /* The optimizer's interface method. Starts a recursive optimize call down
@@ -15,7 +15,7 @@
 class ast_optimizer;
 
 
-extern ast_optimizer *optimizer; // Defined in optimize.cc.
+extern __thread ast_optimizer *optimizer; // Defined in optimize.cc.
 
 
 class ast_optimizer {
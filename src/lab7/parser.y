@@ -2,19 +2,19 @@
 #include <iostream>
 #include "semantic.hh"
 #include "optimize.hh"
+#include "quadopt.hh"
+#include "profile.hh"
 #include "codegen.hh"
+#include "pipeline.hh"
+#include "units.hh"
+#include "compilation.hh"
     
-extern char	      *yytext;           /* Defined in parser.cc */
-extern int             error_count;      /* Nr of errors encountered so far.
-					    Only generate quads & assembler if
-					    error_count == 0. Defined in
-					    error.cc. */
-extern symbol_table   *sym_tab;          /* Defined in symtab.cc. */
-extern semantic       *type_checker;     /* Defined in semantic.cc. */
-extern code_generator *code_gen;         /* Defined in codegen.cc. */ 
-extern int	       yylex();          /* From scanner.l output. */
-
-extern void	       yyerror(char *);  /* Defined in error.hh. */
+/* The compiler's state, such as error_count (the nr of errors encountered
+   so far; only generate quads & assembler if error_count == 0) and sym_tab,
+   is per thread, see compilation.hh. The parser is pure, and the scanner it
+   is given is reentrant, so that several files can be parsed at once. */
+extern char	      *yyget_text(void *); /* From scanner.l output. */
+extern int	       yyget_lineno(void *);
 
 extern int             print_ast;        /* All these defined in main.cc. */
 extern int             print_quads;      /* They represent some of the flags */
@@ -31,6 +31,15 @@ extern int             no_assembler;
 					    wish. Not mandatory. */
 %}
 
+%define api.pure
+%parse-param {void *scanner}
+%lex-param {void *scanner}
+
+/* parser.hh is included by the scanner, which only passes the units on. */
+%code requires {
+class include_unit;
+}
+
 
 
 /* The different semantic values that can be returned within the AST. This is
@@ -59,7 +68,31 @@ extern int             no_assembler;
     float                 rval;
     pool_index            str;
     pool_index            pool_p;
+    include_unit         *unit;
+}
+
+%{
+extern int	       yylex(YYSTYPE *,  /* From scanner.l output. */
+			     YYLTYPE *,
+			     void *);
+
+/* The parser gets its tokens through this, so that the profiler can tell
+   scanning time from parsing time. See profile.hh. */
+static int profiled_yylex(YYSTYPE *lval, YYLTYPE *lloc, void *scanner)
+{
+    profiler->start(PHASE_SCAN);
+    int token = yylex(lval, lloc, scanner);
+    profiler->stop(PHASE_SCAN);
+    return token;
+}
+#define yylex profiled_yylex
+
+/* Bison reports parse errors through this. See error.cc. */
+static void yyerror(YYLTYPE *, void *scanner, const char *msg)
+{
+    yyerror(yyget_lineno(scanner), (char *)msg);
 }
+%}
 
 /* Here are return types for all productions that return AST nodes (ie, the
    return type of the bison $$ construct). Again, reading the bison manual
@@ -91,6 +124,8 @@ extern int             no_assembler;
 %token <pool_p> T_IDENT T_PROGRAM T_PROCEDURE T_FUNCTION
 %token <ival> T_INTNUM
 %token <rval> T_REALNUM
+%token <unit> T_INCLUDE
+%token T_UNIT_END
 
 /* Associative rules for operators. */
 %nonassoc T_LESSTHAN T_GREATERTHAN T_EQ T_NOTEQ
@@ -117,40 +152,42 @@ program		: prog_decl subprog_part comp_stmt T_DOT
 		    // The status variables here depend on what flags were
 		    // passed to the compiler. See the 'diesel' script for
 		    // more information.
-		    if(!no_typecheck)
+		    if(!no_typecheck) {
+			profiler->start(PHASE_TYPECHECK);
 			type_checker->do_typecheck(env, $3);
+			profiler->stop(PHASE_TYPECHECK);
+		    }
 		    
 		    if(print_ast) {
-			cout << "\nUnoptimized AST for global level" << endl;
-			cout << (ast_stmt_list *)$3 << endl;
+			*message_stream << "\nUnoptimized AST for global level" << endl;
+			*message_stream << (ast_stmt_list *)$3 << endl;
 		    }
 			
 		    if(!no_optimize) {
+			profiler->start(PHASE_OPTIMIZE);
 			optimizer->do_optimize($3);
+			profiler->stop(PHASE_OPTIMIZE);
 			if(print_ast) {
-			    cout << "\nOptimized AST for global level" << endl;
-			    cout << (ast_stmt_list *)$3 << endl;
+			    *message_stream << "\nOptimized AST for global level" << endl;
+			    *message_stream << (ast_stmt_list *)$3 << endl;
 			}
 		    }
 		    if(error_count == 0) {
 			if(!no_quads) {
+			    profiler->start(PHASE_QUADS);
 			    quad_list *q = $1->do_quads($3);
-			    if(print_quads) {
-				cout << "\nQuad list for global level" << endl;
-				cout << (quad_list *)q << endl;
-			    }
-			    
-			    if(!no_assembler) {
-				cout << "Generating assembler, global level"
-				     << endl;
-				code_gen->generate_assembler(q, env);
-			    }
+			    profiler->stop(PHASE_QUADS);
+
+			    // The quad optimizer and code generator.
+			    pipeline->compile(q, $1->sym_p);
 			}
 		    } else {
-			cout << "Found " << error_count << " errors. "
+			*message_stream << "Found " << error_count << " errors. "
 			     << "Compilation aborted.\n";
 		    }
 		    
+		    profiler->end_block(env);
+
 		    // We close the global scope.		    
 		    sym_tab->close_scope();
 		}
@@ -237,7 +274,7 @@ const_decl	: T_IDENT T_EQ integer T_SEMICOLON
 		    // paranoia never hurts) the compiler would crash.
 		    if(tmp == NULL || tmp->tag != SYM_CONST)
 			type_error(pos) << "bad index in const declaration: "
-				        << yytext << endl << flush;
+				        << yyget_text(scanner) << endl << flush;
 		    else {
 				constant_symbol *con = tmp->get_constant_symbol();
 				if(con->type == integer_type) {
@@ -319,7 +356,7 @@ var_decl	: T_IDENT T_COLON type_id T_SEMICOLON
 		    // paranoia never hurts) the compiler would crash.
 		    if(tmp == NULL || tmp->tag != SYM_CONST)
 			type_error(pos) << "bad index in array declaration: "
-				        << yytext << endl << flush;
+				        << yyget_text(scanner) << endl << flush;
 		    else {
 			constant_symbol *con = tmp->get_constant_symbol();
 			if(con->type == integer_type) {
@@ -354,94 +391,122 @@ subprog_decl	: proc_decl subprog_part comp_stmt T_SEMICOLON
 		    
 		    symbol *env = sym_tab->get_symbol($1->sym_p);
 
-		    if(!no_typecheck)
+		    if(!no_typecheck) {
+			profiler->start(PHASE_TYPECHECK);
 			type_checker->do_typecheck(env, $3);
+			profiler->stop(PHASE_TYPECHECK);
+		    }
 		    
 		    if(print_ast) {
-			cout << "\nUnoptimized AST for \"" 
-			     << sym_tab->pool_lookup(env->id)
+			*message_stream << "\nUnoptimized AST for \"" 
+			     << sym_tab->pool_view(env->id)
 			     << "\"" << endl;
-			cout << (ast_stmt_list *)$3 << endl;
+			*message_stream << (ast_stmt_list *)$3 << endl;
 		    }
 
 		    if(!no_optimize) {
+			profiler->start(PHASE_OPTIMIZE);
 			optimizer->do_optimize($3);
+			profiler->stop(PHASE_OPTIMIZE);
 			if(print_ast) {
-			    cout << "\nOptimized AST for \"" 
-				 << sym_tab->pool_lookup(env->id)
+			    *message_stream << "\nOptimized AST for \"" 
+				 << sym_tab->pool_view(env->id)
 				 << "\"" << endl;
-			    cout << (ast_stmt_list*)$3 << endl;
+			    *message_stream << (ast_stmt_list*)$3 << endl;
 			}
 		    }
 		    
                     if(error_count == 0) {
 			if(!no_quads) {
+			    profiler->start(PHASE_QUADS);
 			    quad_list *q = $1->do_quads($3);
-			    if(print_quads) {
-				cout << "\nQuad list for \""
-				     << sym_tab->pool_lookup(env->id)
-				     << "\"" << endl;
-				cout << (quad_list *)q << endl;
-			    }
-			    
-			    if(!no_assembler) {			
-				cout << "Generating assembler for procedure \""
-				     << sym_tab->pool_lookup(env->id)
-				     << "\"" << endl;
-				code_gen->generate_assembler(q, env);
-			    }
+			    profiler->stop(PHASE_QUADS);
+
+			    // The quad optimizer and code generator.
+			    pipeline->compile(q, $1->sym_p);
 			}
 		    }
                     
+		    profiler->end_block(env);
+
 		    // Close the current scope.
 		    sym_tab->close_scope();
+
+		    // Nothing refers to this block's AST or quads anymore,
+		    // once the backend is done with it.
+		    pipeline->release(block_arena);
+		    block_arena = current_compilation->outer_arenas[
+			--current_compilation->nr_outer_arenas];
 		}
 		| func_decl subprog_part comp_stmt T_SEMICOLON
 		{
 		    
 		    symbol *env = sym_tab->get_symbol($1->sym_p);
 
-		    if(!no_typecheck)
+		    if(!no_typecheck) {
+			profiler->start(PHASE_TYPECHECK);
 			type_checker->do_typecheck(env, $3);
+			profiler->stop(PHASE_TYPECHECK);
+		    }
 		    
 		    if(print_ast) {
-			cout << "\nUnoptimized AST for \"" 
-			     << sym_tab->pool_lookup(env->id)
+			*message_stream << "\nUnoptimized AST for \"" 
+			     << sym_tab->pool_view(env->id)
 			     << "\"" << endl;
-			cout << (ast_stmt_list *)$3 << endl;
+			*message_stream << (ast_stmt_list *)$3 << endl;
 		    }
 		    
 		    if(!no_optimize) {
+			profiler->start(PHASE_OPTIMIZE);
 			optimizer->do_optimize($3);
+			profiler->stop(PHASE_OPTIMIZE);
 			if(print_ast) {			
-			    cout << "\nOptimized AST for \"" 
-				 << sym_tab->pool_lookup(env->id)
+			    *message_stream << "\nOptimized AST for \"" 
+				 << sym_tab->pool_view(env->id)
 				 << "\"" << endl;
-			    cout << (ast_stmt_list *)$3 << endl;
+			    *message_stream << (ast_stmt_list *)$3 << endl;
 			}
 		    }
 
 		    if(error_count == 0) {
 			if(!no_quads) {
+			    profiler->start(PHASE_QUADS);
 			    quad_list *q = $1->do_quads($3);
-			    if(print_quads) {
-				cout << "\nQuad list for \""
-				     << sym_tab->pool_lookup(env->id)
-				     << "\"" << endl;
-				cout << (quad_list *)q << endl;
-			    }
-			    
-			    if(!no_assembler) {			
-				cout << "Generating assembler for function \""
-				     << sym_tab->pool_lookup(env->id) << "\""
-				     << endl;
-				code_gen->generate_assembler(q, env);
-			    }
+			    profiler->stop(PHASE_QUADS);
+
+			    // The quad optimizer and code generator.
+			    pipeline->compile(q, $1->sym_p);
 			}
 		    }
                     
+		    profiler->end_block(env);
+
 		    // Close the current scope.
 		    sym_tab->close_scope();
+
+		    // Nothing refers to this block's AST or quads anymore,
+		    // once the backend is done with it.
+		    pipeline->release(block_arena);
+		    block_arena = current_compilation->outer_arenas[
+			--current_compilation->nr_outer_arenas];
+		}
+		| unit_decl
+		;
+
+
+/* An include unit: the scanner returns the unit for an #include, and
+   T_UNIT_END at the end of it. If it has been compiled before, the end
+   comes at once, see units.hh. */
+unit_decl	: T_INCLUDE
+		{
+		    position_information *pos =
+			new position_information(@1.first_line,
+			                         @1.first_column);
+		    units->begin($1, pos);
+		}
+		  subprog_part T_UNIT_END
+		{
+		    units->end($1);
 		}
 		;
 
@@ -464,6 +529,12 @@ func_decl	: func_head opt_param_list T_COLON type_id T_SEMICOLON const_part vari
 
 proc_head	: T_PROCEDURE T_IDENT
 		{
+		    // Each block gets an arena of its own for its AST, quads and
+		    // position information, see arena.hh and pipeline.hh.
+		    compilation *c = current_compilation;
+		    c->outer_arenas[c->nr_outer_arenas++] = block_arena;
+		    block_arena = new arena();
+
 		    position_information *pos =
 			new position_information(@1.first_line,
 			                         @1.first_column);
@@ -484,6 +555,12 @@ proc_head	: T_PROCEDURE T_IDENT
 
 func_head	: T_FUNCTION T_IDENT
 		{
+		    // Each block gets an arena of its own for its AST, quads and
+		    // position information, see arena.hh and pipeline.hh.
+		    compilation *c = current_compilation;
+		    c->outer_arenas[c->nr_outer_arenas++] = block_arena;
+		    block_arena = new arena();
+
 		    position_information *pos =
 			new position_information(@1.first_line,
 			                         @1.first_column);
@@ -1002,7 +1079,7 @@ type_id		: id
 		    if(sym_tab->get_symbol_tag($1->sym_p) != SYM_NAMETYPE)
 			type_error($1->pos) << "not declared "
 					    << "as type: "
-					    << yytext << endl << flush;
+					    << yyget_text(scanner) << endl << flush;
 		    $$ = $1;
 		}
 		;
@@ -1015,7 +1092,7 @@ const_id	: id
 		    if(sym_tab->get_symbol_tag($1->sym_p) != SYM_CONST)
 			type_error($1->pos) << "not declared "
 					    << "as constant: "
-					    << yytext << flush;
+					    << yyget_text(scanner) << flush;
 		    $$ = $1;
 		}
 		;
@@ -1029,7 +1106,7 @@ lvar_id		: id
 		       sym_tab->get_symbol_tag($1->sym_p) != SYM_PARAM)
 			type_error($1->pos) << "not declared "
 					    << "as variable or parameter: "
-					    << yytext << endl << flush;
+					    << yyget_text(scanner) << endl << flush;
 		    $$ = $1;
 		}
 		;
@@ -1043,7 +1120,7 @@ rvar_id		: id
 			type_error($1->pos) << "not declared "
 					    << "as variable, parameter or "
 					    << "constant: "
-					    << yytext << endl << flush;
+					    << yyget_text(scanner) << endl << flush;
 		    $$ = $1;
 		}
 		;
@@ -1056,7 +1133,7 @@ proc_id		: id
 		    if(sym_tab->get_symbol_tag($1->sym_p) != SYM_PROC)
 			type_error($1->pos) << "not declared "
 					    << "as procedure: "
-					    << yytext << endl << flush;
+					    << yyget_text(scanner) << endl << flush;
 		    $$ = $1;
 		}
 		;
@@ -1069,7 +1146,7 @@ func_id		: id
 		    if(sym_tab->get_symbol_tag($1->sym_p) != SYM_FUNC)
 			type_error($1->pos) << "not declared "
 					    << "as function: "
-					    << yytext << endl << flush;
+					    << yyget_text(scanner) << endl << flush;
 		    $$ = $1;
 		}
 		;
@@ -1082,7 +1159,7 @@ array_id	: id
 		    if(sym_tab->get_symbol_tag($1->sym_p) != SYM_ARRAY)
 			type_error($1->pos) << "not declared "
 					    << "as array: "
-					    << yytext << endl << flush;
+					    << yyget_text(scanner) << endl << flush;
 		    $$ = $1;
 		}
 		;
@@ -1097,10 +1174,11 @@ id		: T_IDENT
 
 		    // Make sure the symbol was declared before it is used.
 		    sym_p = sym_tab->lookup_symbol($1);
+		    units->use(sym_p);
 		    
 		    if(sym_p == NULL_SYM)
 			type_error(pos) << "not declared: "
-				        << yytext << endl << flush;
+				        << yyget_text(scanner) << endl << flush;
 		    // Create a new ast_id node with pos, symptr.
 		    $$ = new ast_id(pos,
 				    sym_p);
@@ -0,0 +1,405 @@
+#include <stdlib.h>
+#include "peephole.hh"
+
+using namespace std;
+
+
+/* Returns true if a string is a constant that fits in the 13 bit signed
+   immediate field of a Sparc instruction. */
+static bool is_simm13(const string &s, long *value)
+{
+    char *end;
+
+    if (s.empty())
+        return false;
+    *value = strtol(s.c_str(), &end, 10);
+    return *end == '\0' && *value >= -4096 && *value <= 4095;
+}
+
+
+/* Returns true for a floating point register. */
+static bool is_float_reg(const string &s)
+{
+    return s.size() >= 3 && s[0] == '%' && s[1] == 'f' && s[2] != 'p';
+}
+
+
+/* Split a line up into label, mnemonic, operands and comment. */
+asm_line::asm_line(const string &line) :
+    text(line),
+    label(false),
+    deleted(false)
+{
+    if (line.empty())
+        return;
+    if (line[0] != '\t' && line[0] != ' ')
+    {
+        label = true;
+        return;
+    }
+
+    string::size_type pos = line.find_first_not_of(" \t");
+    if (pos == string::npos || line[pos] == '!')
+        return;
+
+    string::size_type end = line.find_first_of(" \t", pos);
+    op = line.substr(pos, end - pos);
+    if (end == string::npos)
+        return;
+
+    string rest = line.substr(end);
+    string::size_type bang = rest.find('!');
+    if (bang != string::npos)
+    {
+        comment = rest.substr(bang + 1);
+        rest = rest.substr(0, bang);
+    }
+
+    string arg;
+    for (string::size_type i = 0; i < rest.size(); i++)
+    {
+        if (rest[i] == ',')
+        {
+            args.push_back(arg);
+            arg = "";
+        }
+        else if (rest[i] != ' ' && rest[i] != '\t')
+            arg += rest[i];
+    }
+    if (!arg.empty())
+        args.push_back(arg);
+}
+
+
+/* Write the line out again after op or args have been changed. */
+void asm_line::rebuild()
+{
+    text = "\t\t" + op;
+    for (unsigned i = 0; i < args.size(); i++)
+        text += (i == 0 ? "\t" : ",") + args[i];
+    if (!comment.empty())
+        text += "\t!" + comment;
+}
+
+
+
+/* Return the index of the next instruction after line i, or -1 if a label
+   or the end of the block comes first. */
+int peephole_optimizer::next_insn(int i)
+{
+    for (i++; i < (int)lines->size(); i++)
+    {
+        asm_line &l = (*lines)[i];
+        if (l.deleted)
+            continue;
+        if (l.label)
+            return -1;
+        if (!l.op.empty())
+            return i;
+    }
+    return -1;
+}
+
+
+/* Return the index of the instruction before line i, or -1 if there is a
+   label (or nothing) in between. A label on line i itself doesn't count. */
+int peephole_optimizer::prev_insn(int i)
+{
+    if ((*lines)[i].label)
+        return -1;
+    for (i--; i >= 0; i--)
+    {
+        asm_line &l = (*lines)[i];
+        if (l.deleted)
+            continue;
+        if (!l.op.empty())
+            return l.label ? -1 : i;
+        if (l.label)
+            return -1;
+    }
+    return -1;
+}
+
+
+/* Returns true for instructions that may change the flow of control or
+   the register window. */
+bool peephole_optimizer::is_transfer(const asm_line &l)
+{
+    const string &op = l.op;
+
+    if (op == "call" || op == "ret" || op == "retl" || op == "jmp" ||
+        op == "jmpl" || op == "save" || op == "restore")
+        return true;
+    if (op[0] == 'b' && op != "btst" && op != "bset" && op != "bclr")
+        return true;
+    return op.size() > 2 && op[0] == 'f' && op[1] == 'b';
+}
+
+
+/* Returns true if the instruction on line i is in the delay slot of the
+   one before it. It may then be annulled, so it can't be combined with the
+   instruction after it. */
+bool peephole_optimizer::in_delay_slot(int i)
+{
+    int h = prev_insn(i);
+
+    return h != -1 && is_transfer((*lines)[h]);
+}
+
+
+/* Returns true for instructions that set the condition codes. */
+bool peephole_optimizer::sets_cc(const asm_line &l)
+{
+    const string &op = l.op;
+
+    return op == "cmp" || op == "tst" || op[0] == 'f' ||
+        (op.size() > 2 && op.compare(op.size() - 2, 2, "cc") == 0);
+}
+
+
+/* Returns true for the simple instructions that can be moved into the delay
+   slot of the call or branch right after them. */
+bool peephole_optimizer::is_movable(const asm_line &l)
+{
+    const string &op = l.op;
+    long value;
+
+    for (unsigned i = 0; i < l.args.size(); i++)
+        if (l.args[i].find("%o7") != string::npos)
+            return false;
+
+    // A set of a big constant is really two instructions.
+    if (op == "set")
+        return l.args.size() == 2 && is_simm13(l.args[0], &value);
+
+    return op == "mov" || op == "add" || op == "sub" || op == "and" ||
+        op == "or" || op == "xor" || op == "sll" || op == "srl" ||
+        op == "sra" || op == "neg" || op == "ld" || op == "st";
+}
+
+
+/* Returns true if an instruction reads a register. */
+bool peephole_optimizer::reads(const asm_line &l, const string &reg)
+{
+    int n = l.args.size();
+
+    // Everything but the last operand is read, and so is the last one if
+    // it is a memory address or the instruction doesn't write anything.
+    for (int i = 0; i < n; i++)
+    {
+        if (l.args[i].find(reg) == string::npos)
+            continue;
+        if (i < n - 1 || l.args[i][0] == '[' || l.op == "cmp" ||
+            l.op == "tst" || l.op == "st" || n == 1)
+            return true;
+    }
+    return false;
+}
+
+
+/* Returns true if an instruction writes a register. */
+bool peephole_optimizer::writes(const asm_line &l, const string &reg)
+{
+    if (l.args.empty() || l.op == "cmp" || l.op == "tst" || l.op == "st" ||
+        is_transfer(l))
+        return false;
+    return l.args.back() == reg;
+}
+
+
+/* Returns true if the value in a register isn't needed after line i. %l0 is
+   only ever used as scratch by codegen.cc, right after it has been set, so
+   it is always dead. Otherwise we look ahead for a write to the register,
+   giving up at the first label or jump. */
+bool peephole_optimizer::dead_after(int i, const string &reg)
+{
+    if (reg == "%l0")
+        return true;
+
+    for (i = next_insn(i); i != -1; i = next_insn(i))
+    {
+        asm_line &l = (*lines)[i];
+        if (reads(l, reg) || is_transfer(l))
+            return false;
+        if (writes(l, reg))
+            return true;
+    }
+    return false;
+}
+
+
+
+/* Remove loads of a value that was just stored:
+       st  %o0,[%g2-8]             st  %o0,[%g2-8]
+       ld  [%g2-8],%o0      =>
+   or turn them into a move if the registers differ. */
+bool peephole_optimizer::remove_reloads()
+{
+    bool changed = false;
+
+    for (int i = 0; i < (int)lines->size(); i++)
+    {
+        asm_line &st = (*lines)[i];
+        if (st.deleted || st.op != "st" || st.args.size() != 2 ||
+            in_delay_slot(i))
+            continue;
+
+        int j = next_insn(i);
+        if (j == -1)
+            continue;
+        asm_line &ld = (*lines)[j];
+        if (ld.op != "ld" || ld.args.size() != 2 || ld.args[0] != st.args[1])
+            continue;
+
+        if (ld.args[1] == st.args[0])
+        {
+            ld.deleted = true;
+            changed = true;
+        }
+        else if (!is_float_reg(ld.args[1]) && !is_float_reg(st.args[0]))
+        {
+            ld.op = "mov";
+            ld.args[0] = st.args[0];
+            ld.rebuild();
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+
+/* Use constants as immediate operands:
+       set 1,%l0
+       add %l1,%l0,%l1      =>     add %l1,1,%l1
+   and the same for a move, or a store of zero (using %g0). */
+bool peephole_optimizer::fuse_constants()
+{
+    bool changed = false;
+    long value;
+
+    for (int i = 0; i < (int)lines->size(); i++)
+    {
+        asm_line &set = (*lines)[i];
+        if (set.deleted || set.op != "set" || set.args.size() != 2 ||
+            !is_simm13(set.args[0], &value) || in_delay_slot(i))
+            continue;
+
+        int j = next_insn(i);
+        if (j == -1)
+            continue;
+        asm_line &use = (*lines)[j];
+        const string &reg = set.args[1];
+        const string &op = use.op;
+
+        if (op == "mov" && use.args.size() == 2 && use.args[0] == reg)
+        {
+            if (use.args[1] != reg && !dead_after(j, reg))
+                continue;
+            use.op = "set";
+            use.args[0] = set.args[0];
+        }
+        else if (op == "st" && value == 0 && use.args.size() == 2 &&
+                 use.args[0] == reg && use.args[1].find(reg) == string::npos)
+        {
+            if (!dead_after(j, reg))
+                continue;
+            use.args[0] = "%g0";
+        }
+        else if ((op == "add" || op == "sub" || op == "and" || op == "or" ||
+                  op == "xor" || op == "sll" || op == "srl" || op == "sra" ||
+                  op == "smul" || op == "sdiv" || op == "cmp") &&
+                 use.args.size() >= 2)
+        {
+            // The commutative ones can have the constant on either side.
+            if (use.args[0] == reg && use.args[1] != reg &&
+                (op == "add" || op == "and" || op == "or" || op == "xor" ||
+                 op == "smul"))
+                swap(use.args[0], use.args[1]);
+            if (use.args[1] != reg || use.args[0] == reg)
+                continue;
+            if ((use.args.size() < 3 || use.args[2] != reg) &&
+                !dead_after(j, reg))
+                continue;
+            use.args[1] = set.args[0];
+        }
+        else
+            continue;
+
+        use.rebuild();
+        set.deleted = true;
+        changed = true;
+    }
+
+    return changed;
+}
+
+
+/* Fill the delay slot of a call or branch with the instruction before it:
+       set 43,%o0
+       call L1              =>     call L1
+       nop                         set 43,%o0
+   A conditional branch can't take an instruction that sets the condition
+   codes it tests, and an annulled one doesn't have a nop to replace. */
+bool peephole_optimizer::fill_delay_slots()
+{
+    bool changed = false;
+
+    for (int j = 0; j < (int)lines->size(); j++)
+    {
+        asm_line &branch = (*lines)[j];
+        if (branch.deleted || branch.label || branch.op.empty() ||
+            !is_transfer(branch) || branch.op.find(',') != string::npos)
+            continue;
+        if (branch.op != "call" && branch.op[0] != 'b')
+            continue;
+
+        int k = next_insn(j);
+        int i = prev_insn(j);
+        if (k == -1 || (*lines)[k].op != "nop" || i == -1)
+            continue;
+
+        asm_line &insn = (*lines)[i];
+        if (!is_movable(insn) || (branch.op != "call" && sets_cc(insn)))
+            continue;
+
+        if (in_delay_slot(i))
+            continue;
+
+        (*lines)[k] = insn;
+        insn.deleted = true;
+        changed = true;
+    }
+
+    return changed;
+}
+
+
+
+/* The optimizer's interface method. */
+int peephole_optimizer::optimize(vector<asm_line> &block)
+{
+    int before = 0, after = 0;
+    unsigned i;
+
+    lines = &block;
+
+    for (i = 0; i < block.size(); i++)
+        if (!block[i].op.empty())
+            before++;
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = remove_reloads();
+        if (fuse_constants())
+            changed = true;
+    }
+    fill_delay_slots();
+
+    for (i = 0; i < block.size(); i++)
+        if (!block[i].deleted && !block[i].op.empty())
+            after++;
+
+    return before - after;
+}
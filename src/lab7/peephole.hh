@@ -0,0 +1,66 @@
+#ifndef __PEEPHOLE_HH__
+#define __PEEPHOLE_HH__
+
+
+#include <string>
+#include <vector>
+using namespace std;
+
+
+/* One line of Sparc assembler output, split up so the peephole optimizer
+   can look at it. Labels, comments and blank lines only have their text. */
+class asm_line {
+public:
+    string         text;        // The line as it will be written.
+    string         op;          // Mnemonic, or "" if not an instruction.
+    vector<string> args;        // The comma separated operands.
+    string         comment;     // Trailing comment, without the "!".
+    bool           label;       // Starts with a label.
+    bool           deleted;     // Removed by the optimizer.
+
+    asm_line(const string &);
+
+    void rebuild();             // Make text agree with op and args.
+};
+
+
+/* This class does peephole optimization on the assembler code for one
+   block, as generated by code_generator. It knows the shapes of code that
+   codegen.cc produces, and only matches instructions that are next to each
+   other with no label in between, so it never needs to know where jumps
+   go. It does the following:
+
+   - A load from the address that the previous instruction stored to is
+     removed, or turned into a register move.
+   - A constant that is set into a register only to be used as the last
+     operand of the next instruction is put in that instruction as an
+     immediate, if it fits and the register isn't needed afterwards.
+   - The nop in the delay slot of a call or branch is replaced by the
+     instruction before the call or branch, when that is safe. */
+class peephole_optimizer {
+private:
+    vector<asm_line> *lines;
+
+    int  next_insn(int);                     // Next instruction, or -1 if
+    int  prev_insn(int);                     //   there is a label first.
+
+    bool is_transfer(const asm_line &);      // Branch, call, ret, ...
+    bool in_delay_slot(int);
+    bool sets_cc(const asm_line &);
+    bool is_movable(const asm_line &);       // Can go in a delay slot.
+    bool reads(const asm_line &, const string &);
+    bool writes(const asm_line &, const string &);
+    bool dead_after(int, const string &);
+
+    bool remove_reloads();
+    bool fuse_constants();
+    bool fill_delay_slots();
+
+public:
+    // Optimize the lines of a block in place (deleted lines are marked,
+    // not removed). Returns the number of instructions eliminated.
+    int  optimize(vector<asm_line> &);
+};
+
+
+#endif
@@ -0,0 +1,330 @@
+#include "pipeline.hh"
+#include "compilation.hh"
+#include "mutex.hh"
+
+/*** This file contains the backend pipeline. See pipeline.hh for how the
+     work is divided between the parser thread and the backend threads. ***/
+
+
+extern int print_quads;     // Defined in main.cc.
+extern int no_optimize;     // Defined in main.cc.
+extern int no_assembler;    // Defined in main.cc.
+
+// The pipeline of the compilation on this thread, see compilation.hh.
+__thread backend_pipeline *pipeline = NULL;
+
+
+// Constructor. No threads are started until start() is called.
+backend_pipeline::backend_pipeline()
+{
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&work_ready, NULL);
+    pthread_cond_init(&work_done, NULL);
+    context = NULL;
+    next_job = 0;
+    stopping = false;
+}
+
+
+
+/* Destructor. */
+backend_pipeline::~backend_pipeline()
+{
+    finish();
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&work_ready);
+    pthread_cond_destroy(&work_done);
+}
+
+
+
+/* Start the backend threads, once code_gen has been created. With no
+   threads, or a backend that can't be copied (the interpreter), blocks are
+   compiled on the parser thread as they come. */
+void backend_pipeline::start(int threads)
+{
+    context = current_compilation;
+    for (int i = 0; i < threads; i++)
+    {
+        assembler_backend *backend = code_gen->new_buffered();
+        if (backend == NULL)
+            return;
+
+        backend_worker *worker = new backend_worker();
+        worker->owner = this;
+        worker->backend = backend;
+        workers.push_back(worker);
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0)
+            fatal("backend_pipeline: can't create a backend thread");
+    }
+}
+
+
+
+/* Wait for the backend to finish all blocks, write them out and stop the
+   backend threads. */
+void backend_pipeline::finish()
+{
+    if (workers.empty())
+        return;
+
+    write_finished(0);
+
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&lock);
+
+    for (unsigned i = 0; i < workers.size(); i++)
+    {
+        pthread_join(workers[i]->thread, NULL);
+        delete workers[i]->backend;
+        delete workers[i];
+    }
+    workers.clear();
+}
+
+
+
+/* Wait for the backend to finish the blocks handed to it so far, and write
+   them out. Used by units.cc, which needs to know which code is whose. */
+void backend_pipeline::write_out()
+{
+    if (!workers.empty())
+        write_finished(0);
+}
+
+
+
+/* Hand the quads of a finished block to the backend. */
+void backend_pipeline::compile(quad_list *q, sym_index env_p)
+{
+    backend_job *job = new backend_job();
+
+    job->q = q;
+    job->env_p = env_p;
+    job->memory = block_arena;
+    job->block = profiler->next_block();
+    job->done = false;
+    job->free_memory = false;
+    job->error_count = 0;
+
+    if (workers.empty())
+    {
+        run(job, quad_opt, code_gen, *message_stream);
+        profiler->add_backend(job->block, job->time, job->quads);
+        free_job(job);
+        return;
+    }
+
+    // Write out the blocks that are done before queueing this one, so that
+    // it isn't written out before the profiler is done with it. If too
+    // many blocks are waiting, wait for the backend to catch up.
+    write_finished(workers.size() * MAX_JOBS_PER_THREAD - 1);
+
+    mutex_lock guard(&lock);
+    jobs.push_back(job);
+    pthread_cond_signal(&work_ready);
+}
+
+
+
+/* The block that used a is done with. If the backend still has to compile
+   it, it is freed when the block is written out. */
+void backend_pipeline::release(arena *a)
+{
+    {
+        mutex_lock guard(&lock);
+        for (unsigned i = 0; i < jobs.size(); i++)
+        {
+            if (jobs[i]->memory == a)
+            {
+                jobs[i]->free_memory = true;
+                return;
+            }
+        }
+    }
+    a->release_all();
+    delete a;
+}
+
+
+
+/* Run the backend on a block, writing messages to out. */
+void backend_pipeline::run(backend_job *job, quad_optimizer *optimizer,
+                           assembler_backend *backend, ostream &out)
+{
+    quad_list *q = job->q;
+    symbol    *env = sym_tab->get_symbol(job->env_p);
+    bool      global = env->level == 0;
+    bool      timed = profiler->is_enabled();
+    double    start = 0;
+
+    for (int p = 0; p < NR_PHASES; p++)
+        job->time[p] = 0;
+
+    if (print_quads)
+    {
+        out << "\nQuad list for ";
+        if (global)
+            out << "global level" << endl;
+        else
+            out << "\"" << sym_tab->pool_view(env->id) << "\"" << endl;
+        out << q << endl;
+    }
+
+    if (!no_optimize)
+    {
+        if (timed)
+            start = profiler->now();
+        int removed = optimizer->do_optimize(q, job->env_p);
+        if (timed)
+            job->time[PHASE_OPTIMIZE] += profiler->now() - start;
+
+        out << "Quad optimizer removed " << removed << " quads";
+        if (global)
+            out << ", global level" << endl;
+        else
+            out << " from \"" << sym_tab->pool_view(env->id) << "\"" << endl;
+        if (print_quads)
+        {
+            out << "\nOptimized quad list for ";
+            if (global)
+                out << "global level" << endl;
+            else
+                out << "\"" << sym_tab->pool_view(env->id) << "\"" << endl;
+            out << q << endl;
+        }
+    }
+
+    if (timed)
+        start = profiler->now();
+    q->share_temp_slots(job->env_p);
+    if (timed)
+        job->time[PHASE_QUADS] += profiler->now() - start;
+    job->quads = q->size();
+
+    if (!no_assembler)
+    {
+        out << "Generating assembler";
+        if (global)
+            out << ", global level" << endl;
+        else if (env->tag == SYM_FUNC)
+            out << " for function \"" << sym_tab->pool_view(env->id)
+                << "\"" << endl;
+        else
+            out << " for procedure \"" << sym_tab->pool_view(env->id)
+                << "\"" << endl;
+
+        if (timed)
+            start = profiler->now();
+        backend->generate_assembler(q, env);
+        if (timed)
+            job->time[PHASE_CODEGEN] += profiler->now() - start;
+    }
+}
+
+
+
+/* The body of a backend thread. */
+void *backend_pipeline::worker_main(void *arg)
+{
+    backend_worker *worker = static_cast<backend_worker *>(arg);
+
+    worker->owner->context->bind();
+    worker->owner->work(worker);
+    return NULL;
+}
+
+
+
+/* Take the oldest job nobody has taken, until stopping. The quads that the
+   optimizer adds go in the arena of the block, like the others. */
+void backend_pipeline::work(backend_worker *worker)
+{
+    pthread_mutex_lock(&lock);
+    for (;;)
+    {
+        while (next_job == jobs.size() && !stopping)
+            pthread_cond_wait(&work_ready, &lock);
+        if (next_job == jobs.size())
+            break;
+        backend_job *job = jobs[next_job++];
+        pthread_mutex_unlock(&lock);
+
+        block_arena = job->memory;
+        worker->backend->set_log(&job->log);
+        diagnostic_stream = &job->errors;
+        error_count = 0;
+
+        // A fatal() only gives up this block. The parser thread counts
+        // the error when it writes the block out, and compiles no more
+        // blocks after that.
+        fatal_catchers++;
+        try
+        {
+            run(job, &worker->optimizer, worker->backend, job->log);
+        }
+        catch (fatal_error &)
+        {
+        }
+        fatal_catchers--;
+        job->text = worker->backend->take_code();
+        job->error_count = error_count;
+
+        pthread_mutex_lock(&lock);
+        job->done = true;
+        pthread_cond_broadcast(&work_done);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+
+
+/* Write out the blocks that are done, oldest first, until one that isn't is
+   found. Waits until no more than n blocks are left. Only the parser thread
+   writes to the messages and the object file. */
+void backend_pipeline::write_finished(unsigned n)
+{
+    vector<backend_job *> finished;
+
+    pthread_mutex_lock(&lock);
+    for (;;)
+    {
+        while (!jobs.empty() && jobs.front()->done)
+        {
+            finished.push_back(jobs.front());
+            jobs.pop_front();
+            next_job--;
+        }
+        if (jobs.size() <= n)
+            break;
+        pthread_cond_wait(&work_done, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+
+    for (unsigned i = 0; i < finished.size(); i++)
+    {
+        backend_job *job = finished[i];
+
+        *message_stream << job->log.str() << flush;
+        *diagnostic_stream << job->errors.str() << flush;
+        error_count += job->error_count;
+        code_gen->write_code(job->text);
+        profiler->add_backend(job->block, job->time, job->quads);
+        free_job(job);
+    }
+}
+
+
+
+/* Done with a job. */
+void backend_pipeline::free_job(backend_job *job)
+{
+    if (job->free_memory)
+    {
+        job->memory->release_all();
+        delete job->memory;
+    }
+    delete job;
+}
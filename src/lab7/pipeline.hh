@@ -0,0 +1,115 @@
+#ifndef __PIPELINE_HH__
+#define __PIPELINE_HH__
+
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+#include <string>
+#include <sstream>
+#include "symtab.hh"
+#include "quads.hh"
+#include "quadopt.hh"
+#include "profile.hh"
+#include "codegen.hh"
+using namespace std;
+
+
+class compilation;
+class backend_pipeline;
+
+
+/* The number of blocks per backend thread that may be waiting or in the
+   works before the parser waits for the backend to catch up. Every waiting
+   block holds on to its AST and quads. */
+const int MAX_JOBS_PER_THREAD = 4;
+
+
+/* A block handed to the backend: its quads, everything it printed and the
+   code that was generated for it. */
+class backend_job {
+public:
+    quad_list     *q;
+    sym_index     env_p;
+    arena         *memory;              // Where the block's quads live.
+    int           block;                // See compile_profiler::next_block().
+    ostringstream log;                  // Messages, in place of cout,
+    ostringstream errors;               //   and error messages, in place
+    int           error_count;          //   of cerr, and how many.
+    string        text;                 // The generated assembler.
+    double        time[NR_PHASES];      // Time spent in the backend.
+    long          quads;                // Quads that were left.
+    bool          done;
+    bool          free_memory;          // Release memory when written.
+};
+
+
+/* One backend thread, with a quad optimizer and code generator of its own,
+   since both keep state while working on a block. */
+class backend_worker {
+public:
+    backend_pipeline  *owner;
+    pthread_t         thread;
+    quad_optimizer    optimizer;
+    assembler_backend *backend;
+};
+
+
+/* This class runs everything that happens to a block after its quads have
+   been generated: the quad optimizer, stack slot sharing and the code
+   generator. parser.y calls compile() as each block is finished.
+
+   Normally that is done right away, on the parser thread. With -J the work
+   goes to a pool of backend threads instead, so that the parser can go on
+   with the next block. Blocks may then be finished in any order, so each
+   thread writes its assembler and messages to a buffer of its own, and the
+   parser thread writes them out in the order the blocks were handed over,
+   which is the order they would have been written in without -J. The
+   output is the same, except for the numbering of labels and temporaries,
+   and that the ASTs printed by -a may come before the messages of earlier
+   blocks, since the parser prints them.
+
+   The quads must be generated on the parser thread, since the temporaries
+   are created in the scope that is open. The backend threads bind the
+   compilation the pipeline belongs to, see compilation.hh, but only read
+   the symbol table, apart from generating labels and temporaries of their
+   own, which symbol_table locks for them. */
+class backend_pipeline
+{
+private:
+    compilation         *context;       // Whose blocks these are.
+    vector<backend_worker *> workers;   // Empty unless running parallel.
+    pthread_mutex_t     lock;           // For everything below.
+    pthread_cond_t      work_ready;     // A job was queued, or stopping.
+    pthread_cond_t      work_done;      // A job was done.
+    deque<backend_job *> jobs;          // In source order, oldest first.
+    unsigned            next_job;       // The first job not yet taken.
+    bool                stopping;
+
+    static void *worker_main(void *);
+    void        work(backend_worker *);
+    void        run(backend_job *, quad_optimizer *, assembler_backend *,
+                    ostream &);
+    void        write_finished(unsigned);
+    void        free_job(backend_job *);
+
+public:
+    backend_pipeline();
+    ~backend_pipeline();
+
+    void start(int threads);            // Called by compilation.cc.
+    void finish();
+    void write_out();                   // Write out every block so far.
+
+    // Called by parser.y. The block's quads are in block_arena.
+    void compile(quad_list *, sym_index env_p);
+
+    // The block whose arena this is is done with. It is freed once the
+    // backend is done with it too.
+    void release(arena *);
+};
+
+
+extern __thread backend_pipeline *pipeline; // Defined in pipeline.cc.
+
+#endif
@@ -0,0 +1,455 @@
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <sstream>
+#include "preprocess.hh"
+#include "units.hh"
+#include "error.hh"
+
+/*** This file contains the preprocessor. See preprocess.hh for what it
+     does, and scanner.l for how the scanner uses it. ***/
+
+
+extern vector<string> include_path;     // Defined in main.cc. The
+extern vector<string> defined_macros;   //   -I, -D and -U options.
+extern vector<string> undefined_macros;
+
+// The preprocessor of the compilation on this thread, see compilation.hh.
+__thread preprocessor *preproc = NULL;
+
+
+/* FNV-1a, used to tell include files by their contents. */
+static unsigned long hash_bytes(unsigned long h, const char *p, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+
+/* Skip blanks. */
+static const char *skip_blanks(const char *p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+
+/* Whether a path is one of paths. */
+static bool contains(const vector<string> &paths, const string &path)
+{
+    for (unsigned i = 0; i < paths.size(); i++)
+        if (paths[i] == path)
+            return true;
+    return false;
+}
+
+
+/* Whether a line is an #include, as scanner.l sees it, and if so the name
+   of the file. */
+static bool include_line(const char *line, string *name)
+{
+    const char *p = skip_blanks(line);
+
+    if (*p != '#')
+        return false;
+    p = skip_blanks(p + 1);
+    if (strncasecmp(p, "include", 7) != 0)
+        return false;
+    p = skip_blanks(p + 7);
+    if (*p != '"')
+        return false;
+
+    const char *end = strpbrk(p + 1, "\"\n");
+    if (end == NULL || *end != '"')
+        return false;
+    name->assign(p + 1, end - p - 1);
+    return true;
+}
+
+
+/* The macro name after the directive word, capitalized, and where it ends. */
+static string directive_name(const char *directive, const char **end)
+{
+    const char *p = skip_blanks(skip_blanks(directive) + 1);
+    string      name;
+
+    while (isalpha(*p))
+        p++;
+    p = skip_blanks(p);
+    while (isalnum(*p) || *p == '_')
+        name += toupper(*p++);
+    *end = p;
+    return name;
+}
+
+
+
+/* Constructor. Applies -D and -U. */
+preprocessor::preprocessor()
+{
+    pending = PENDING_NONE;
+    pending_unit = NULL;
+
+    for (unsigned i = 0; i < defined_macros.size(); i++)
+    {
+        string name = defined_macros[i];
+        string value = "1";
+        size_t equals = name.find('=');
+
+        if (equals != string::npos)
+        {
+            value = name.substr(equals + 1);
+            name.erase(equals);
+        }
+        for (unsigned c = 0; c < name.size(); c++)
+            name[c] = toupper(name[c]);
+        macros[name] = value;
+    }
+    for (unsigned i = 0; i < undefined_macros.size(); i++)
+    {
+        string name = undefined_macros[i];
+        for (unsigned c = 0; c < name.size(); c++)
+            name[c] = toupper(name[c]);
+        macros.erase(name);
+    }
+}
+
+
+
+/* Destructor. Only has something to do if the parse was given up in the
+   middle of an include file. */
+preprocessor::~preprocessor()
+{
+    for (unsigned i = 0; i < frames.size(); i++)
+    {
+        if (frames[i].unit != NULL && frames[i].unit->file != NULL)
+        {
+            fclose(frames[i].unit->file);
+            frames[i].unit->file = NULL;
+        }
+    }
+}
+
+
+
+/* The name of the file being compiled, which its includes are relative to.
+   NULL for stdin. */
+void preprocessor::set_source(const char *name)
+{
+    source_name = name == NULL ? "" : name;
+}
+
+
+
+/* The directory part of a file name, with the slash. */
+string preprocessor::directory_of(const string &path)
+{
+    size_t slash = path.rfind('/');
+
+    if (slash == string::npos)
+        return "";
+    return path.substr(0, slash + 1);
+}
+
+
+
+/* Open an include file, see preprocess.hh for where it is looked for.
+   includer is the path of the file that includes it. */
+FILE *preprocessor::find(const string &name, const string &includer,
+                         string *path)
+{
+    vector<string> candidates;
+    FILE           *file;
+
+    if (name[0] == '/')
+        candidates.push_back(name);
+    else
+    {
+        candidates.push_back(directory_of(includer) + name);
+        for (unsigned i = 0; i < include_path.size(); i++)
+            candidates.push_back(include_path[i] + "/" + name);
+    }
+
+    for (unsigned i = 0; i < candidates.size(); i++)
+    {
+        file = fopen(candidates[i].c_str(), "r");
+        if (file != NULL)
+        {
+            *path = candidates[i];
+            return file;
+        }
+    }
+    return NULL;
+}
+
+
+
+/* The part of an include unit's key that comes from its files: a hash of
+   the contents of the file, and for each file it includes the path it is
+   found at and the same again. An #include can't be left out or changed by
+   a macro, so these are the files the unit reads when it is compiled, and
+   a unit that is reused must have the same ones: one of them may have been
+   changed since, or it may be another file, found in another directory or
+   with another -I. includers are the files on the way to this one, to stop
+   at an #include that is nested too deeply or includes itself, which is
+   an error anyway. */
+string preprocessor::file_key(FILE *file, const string &path,
+                              vector<string> &includers)
+{
+    string        text;
+    char          buffer[BUFSIZ];
+    size_t        n;
+    ostringstream key;
+
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, n);
+    rewind(file);
+    key << hex << hash_bytes(14695981039346656037UL, text.data(), text.size())
+        << "\n";
+
+    if ((int)includers.size() == MAX_INCLUDE_DEPTH)
+        return key.str();
+    includers.push_back(path);
+
+    for (size_t start = 0; start < text.size(); )
+    {
+        size_t end = text.find('\n', start);
+        string name;
+
+        if (end == string::npos)
+            end = text.size();
+        if (include_line(text.substr(start, end - start).c_str(), &name))
+        {
+            string nested_path;
+            FILE   *nested = find(name, path, &nested_path);
+
+            if (nested == NULL)
+                key << "#include " << name << " not found\n";
+            else
+            {
+                key << "#include " << nested_path << "\n";
+                if (contains(includers, nested_path))
+                    key << "again\n";
+                else
+                    key << file_key(nested, nested_path, includers);
+                fclose(nested);
+            }
+        }
+        start = end + 1;
+    }
+
+    includers.pop_back();
+    return key.str();
+}
+
+
+
+/* All macros and their values, for the key of an include unit. */
+string preprocessor::macro_state()
+{
+    string                        state;
+    map<string, string>::iterator i;
+
+    for (i = macros.begin(); i != macros.end(); i++)
+        state += i->first + "=" + i->second + "\n";
+    return state;
+}
+
+
+
+/* Define or undefine a macro. The include units being read remember it,
+   since whoever includes them gets the macro too. */
+void preprocessor::change_macro(const string &name, const string &value,
+                                bool defined)
+{
+    macro_change change;
+
+    change.name = name;
+    change.value = value;
+    change.defined = defined;
+
+    if (defined)
+        macros[name] = value;
+    else
+        macros.erase(name);
+
+    for (unsigned i = 0; i < frames.size(); i++)
+        if (frames[i].unit != NULL)
+            frames[i].unit->macros.push_back(change);
+}
+
+
+
+/* #include "file". Returns the include unit, or NULL if there is no such
+   file. The file is only opened, and read to find its key; what becomes of
+   it is decided by the parser. */
+include_unit *preprocessor::include(const char *directive, int line)
+{
+    const char    *start = strchr(directive, '"') + 1;
+    string         name(start, strchr(start, '"') - start);
+    string         path;
+    string         includer = source_name;
+    vector<string> includers;
+
+    for (unsigned i = 0; i < frames.size(); i++)
+    {
+        if (frames[i].unit != NULL)
+        {
+            includer = frames[i].unit->path;
+            includers.push_back(includer);
+        }
+    }
+    if ((int)includers.size() == MAX_INCLUDE_DEPTH)
+    {
+        error() << "line " << line << ": #include nested too deeply: \""
+                << name << "\"" << endl << flush;
+        return NULL;
+    }
+
+    FILE *file = find(name, includer, &path);
+    if (file == NULL)
+    {
+        error() << "line " << line << ": can't find the include file \""
+                << name << "\"" << endl << flush;
+        return NULL;
+    }
+
+    ostringstream key;
+    key << file_key(file, path, includers) << macro_state();
+
+    include_unit *unit = new include_unit();
+    unit->name = name;
+    unit->path = path;
+    unit->file = file;
+    unit->key = key.str();
+    return unit;
+}
+
+
+
+/* #define NAME value. */
+void preprocessor::define(const char *directive, int line)
+{
+    const char *value;
+    string      name = directive_name(directive, &value);
+    string      text = value;
+
+    if (name.empty())
+    {
+        error() << "line " << line << ": #define without a name"
+                << endl << flush;
+        return;
+    }
+
+    // The scanner gives us the line without its newline.
+    while (!text.empty() && isspace(text[text.size() - 1]))
+        text.erase(text.size() - 1);
+    change_macro(name, text, true);
+}
+
+
+
+/* #undef NAME. */
+void preprocessor::undefine(const char *directive, int line)
+{
+    const char *end;
+    string      name = directive_name(directive, &end);
+
+    if (name.empty())
+    {
+        error() << "line " << line << ": #undef without a name"
+                << endl << flush;
+        return;
+    }
+    change_macro(name, "", false);
+}
+
+
+
+/* See preprocess.hh. */
+const char *preprocessor::expand(const char *id)
+{
+    string name = id;
+
+    for (unsigned c = 0; c < name.size(); c++)
+        name[c] = toupper(name[c]);
+
+    map<string, string>::iterator macro = macros.find(name);
+    if (macro == macros.end())
+        return NULL;
+    for (unsigned i = 0; i < frames.size(); i++)
+        if (frames[i].unit == NULL && frames[i].macro == name)
+            return NULL;
+
+    source_frame frame;
+    frame.unit = NULL;
+    frame.macro = name;
+    frames.push_back(frame);
+    return macro->second.c_str();
+}
+
+
+
+/* See preprocess.hh. */
+pending_action preprocessor::take_pending(FILE **file)
+{
+    pending_action action = pending;
+
+    if (action == PENDING_READ)
+    {
+        source_frame frame;
+        frame.unit = pending_unit;
+        frames.push_back(frame);
+        *file = pending_unit->file;
+    }
+    pending = PENDING_NONE;
+    pending_unit = NULL;
+    return action;
+}
+
+
+
+/* See preprocess.hh. */
+buffer_end preprocessor::end_of_buffer()
+{
+    if (frames.empty())
+        return END_OF_INPUT;
+
+    source_frame frame = frames.back();
+    frames.pop_back();
+    if (frame.unit == NULL)
+        return END_OF_MACRO;
+
+    fclose(frame.unit->file);
+    frame.unit->file = NULL;
+    return END_OF_INCLUDE;
+}
+
+
+
+/* The unit is to be compiled, so the scanner reads it next. */
+void preprocessor::read_unit(include_unit *unit)
+{
+    pending = PENDING_READ;
+    pending_unit = unit;
+}
+
+
+
+/* The unit was compiled before, so the file isn't read. The macros it
+   defined are defined as if it had been. */
+void preprocessor::skip_unit(include_unit *unit, include_unit *compiled)
+{
+    fclose(unit->file);
+    unit->file = NULL;
+
+    for (unsigned i = 0; i < compiled->macros.size(); i++)
+        change_macro(compiled->macros[i].name, compiled->macros[i].value,
+                     compiled->macros[i].defined);
+    pending = PENDING_SKIP;
+}
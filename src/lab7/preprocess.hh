@@ -0,0 +1,107 @@
+#ifndef __PREPROCESS_HH__
+#define __PREPROCESS_HH__
+
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+using namespace std;
+
+
+/* Prototype, see units.hh. */
+class include_unit;
+
+
+/* How deep #include may nest. More than this is most likely a file that
+   includes itself. */
+const int MAX_INCLUDE_DEPTH = 32;
+
+
+/* What the scanner has to do before it reads the next token, see
+   preprocessor::take_pending(). */
+typedef enum {
+    PENDING_NONE,
+    PENDING_READ,                       // Read the include file.
+    PENDING_SKIP                        // Return T_UNIT_END at once.
+} pending_action;
+
+
+/* What came to an end when the scanner reached the end of a buffer. */
+typedef enum {
+    END_OF_INPUT,
+    END_OF_INCLUDE,
+    END_OF_MACRO
+} buffer_end;
+
+
+/* A buffer the scanner is reading on top of the source file: an include
+   file or the value of a macro. */
+class source_frame {
+public:
+    include_unit *unit;                 // The include file,
+    string        macro;                //   or the macro.
+};
+
+
+/* The preprocessor, which used to be cpp. It is part of the scanner: the
+   rules in scanner.l hand it the directives and the identifiers, and it
+   tells the scanner what to read next, which the scanner does with a stack
+   of flex buffers. So the #include and #define lines are handled as the
+   scanner comes to them, and line numbers are those of the file they are
+   in.
+
+   #define NAME value, #undef NAME and #include "file" are understood. The
+   value of a macro is the rest of its line. Macro names are caseless, like
+   the rest of Diesel, and a macro isn't expanded in its own value. Include
+   files are looked for in the directory of the file that includes them,
+   then in those given with -I, in order. -D and -U work as for cpp. An
+   #include is an include unit, see units.hh. */
+class preprocessor {
+private:
+    string               source_name;   // The file being compiled.
+    map<string, string>  macros;        // Name -> value.
+    vector<source_frame> frames;        // Innermost last.
+    pending_action       pending;
+    include_unit        *pending_unit;
+
+    string        directory_of(const string &);
+    FILE         *find(const string &, const string &includer,
+                        string *path);
+    string        file_key(FILE *, const string &path,
+                           vector<string> &includers);
+    string        macro_state();
+    void          change_macro(const string &, const string &, bool);
+
+public:
+    preprocessor();
+    ~preprocessor();
+
+    void          set_source(const char *);
+
+    // The directives, as matched by the scanner.
+    include_unit *include(const char *, int line);
+    void          define(const char *, int line);
+    void          undefine(const char *, int line);
+
+    // The value of a macro, if the identifier is one. The scanner then
+    // reads it before going on, and must call end_of_buffer() at its end.
+    const char   *expand(const char *);
+
+    // Called by the scanner as it starts on a token. The include file is
+    // returned in file.
+    pending_action take_pending(FILE **file);
+
+    // Called by the scanner at the end of each buffer.
+    buffer_end    end_of_buffer();
+
+    // What happens to an include unit, decided by unit_compiler::begin():
+    // it is read, or it has been compiled before, and only the macros it
+    // defined are needed.
+    void          read_unit(include_unit *);
+    void          skip_unit(include_unit *, include_unit *compiled);
+};
+
+extern __thread preprocessor *preproc; // Defined in preprocess.cc.
+
+#endif
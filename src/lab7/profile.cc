@@ -0,0 +1,227 @@
+#include <iomanip>
+#include <time.h>
+#include <sys/resource.h>
+#include "profile.hh"
+#include "symtab.hh"
+#include "quads.hh"
+#include "ast.hh"
+
+using namespace std;
+
+
+// The profiler of the compilation on this thread, see compilation.hh.
+__thread compile_profiler *profiler = NULL;
+
+
+/* The names of the phases, as used in the report and the JSON. */
+static const char *phase_names[NR_PHASES] = {
+    "scan", "parse", "typecheck", "optimize", "quads", "codegen"
+};
+
+
+
+/* Reset everything that was measured. */
+void block_profile::clear()
+{
+    name = "";
+    level = 0;
+    for (int p = 0; p < NR_PHASES; p++)
+        time[p] = 0.0;
+    nodes = quads = symbols = temps = 0;
+}
+
+
+
+/* Constructor. */
+compile_profiler::compile_profiler() :
+    enabled(false),
+    run_start(0.0),
+    run_time(0.0),
+    block_start(0.0),
+    nodes_mark(0),
+    symbols_mark(0),
+    temps_mark(0),
+    output_bytes(0),
+    output_writes(0)
+{
+    current.clear();
+}
+
+
+/* Return the time in seconds from some fixed point. */
+double compile_profiler::now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/* Start measuring the run. Anything before this (the predefined symbols
+   and types) isn't counted. */
+void compile_profiler::begin_run()
+{
+    if (!enabled)
+        return;
+
+    run_start = block_start = now();
+    nodes_mark = ast_node::nr_nodes;
+    symbols_mark = sym_tab->get_nr_symbols();
+    temps_mark = sym_tab->get_nr_temps();
+}
+
+
+/* The parser is done. */
+void compile_profiler::end_run()
+{
+    if (enabled)
+        run_time = now() - run_start;
+}
+
+
+/* Add the time the backend spent on a block, and the number of quads the
+   block ended up with. If the block isn't finished yet the backend ran on
+   the parser thread, and end_block() will take the time off parsing. */
+void compile_profiler::add_backend(int block, const double *time, long quads)
+{
+    if (!enabled)
+        return;
+
+    block_profile &b = block < (int)blocks.size() ? blocks[block] : current;
+    for (int p = 0; p < NR_PHASES; p++)
+        b.time[p] += time[p];
+    b.quads += quads;
+}
+
+
+/* The block env has been handed to the backend. Everything measured since
+   the previous block was finished is put on its account, and whatever time
+   isn't accounted for by the other phases was spent parsing. */
+void compile_profiler::end_block(symbol *env)
+{
+    if (!enabled)
+        return;
+
+    double t = now();
+    double parse = t - block_start;
+    for (int p = 0; p < NR_PHASES; p++)
+        if (p != PHASE_PARSE)
+            parse -= current.time[p];
+
+    pool_string id = sym_tab->pool_view(env->id);
+    current.name = string(id.str, id.length);
+    current.level = env->level;
+    current.time[PHASE_PARSE] = parse;
+    current.nodes = ast_node::nr_nodes - nodes_mark;
+    current.symbols = sym_tab->get_nr_symbols() - symbols_mark;
+    current.temps = sym_tab->get_nr_temps() - temps_mark;
+    blocks.push_back(current);
+
+    current.clear();
+    nodes_mark = ast_node::nr_nodes;
+    symbols_mark = sym_tab->get_nr_symbols();
+    temps_mark = sym_tab->get_nr_temps();
+    block_start = now();
+}
+
+
+/* Add up the blocks. */
+void compile_profiler::totals(block_profile &total)
+{
+    total.clear();
+    total.name = "total";
+    for (unsigned i = 0; i < blocks.size(); i++)
+    {
+        for (int p = 0; p < NR_PHASES; p++)
+            total.time[p] += blocks[i].time[p];
+        total.nodes += blocks[i].nodes;
+        total.quads += blocks[i].quads;
+        total.symbols += blocks[i].symbols;
+        total.temps += blocks[i].temps;
+    }
+}
+
+
+/* Print the per-block table, with times in milliseconds. */
+void compile_profiler::report(ostream &o)
+{
+    block_profile total;
+    unsigned      i;
+    int           p;
+
+    totals(total);
+
+    o << "\nCompile-time profile (times in ms)" << endl;
+    o << setw(20) << left << "block" << right;
+    for (p = 0; p < NR_PHASES; p++)
+        o << setw(10) << phase_names[p];
+    o << setw(9) << "nodes" << setw(9) << "quads" << setw(9) << "symbols"
+      << setw(9) << "temps" << endl;
+
+    for (i = 0; i <= blocks.size(); i++)
+    {
+        block_profile &b = i < blocks.size() ? blocks[i] : total;
+        string name = b.name;
+
+        if (i < blocks.size())
+            name = string(2 * b.level, ' ') + name;
+        o << setw(20) << left << name.substr(0, 19) << right;
+        o << fixed << setprecision(3);
+        for (p = 0; p < NR_PHASES; p++)
+            o << setw(10) << b.time[p] * 1000.0;
+        o << setw(9) << b.nodes << setw(9) << b.quads << setw(9) << b.symbols
+          << setw(9) << b.temps << endl;
+    }
+
+    o << "Wall time: " << run_time * 1000.0 << " ms" << endl;
+    o << "Assembler output: " << output_bytes << " bytes in "
+      << output_writes << " writes" << endl;
+    o.unsetf(ios::floatfield);
+    o << setprecision(6);
+}
+
+
+/* Write the counts of a block as JSON members. */
+void compile_profiler::write_counts(ostream &o, block_profile &b)
+{
+    o << "\"time\": {";
+    for (int p = 0; p < NR_PHASES; p++)
+        o << (p == 0 ? "" : ", ") << "\"" << phase_names[p] << "\": "
+          << b.time[p];
+    o << "}, \"nodes\": " << b.nodes << ", \"quads\": " << b.quads
+      << ", \"symbols\": " << b.symbols << ", \"temps\": " << b.temps;
+}
+
+
+/* Write a JSON summary of the run, with times in seconds. Identifiers are
+   plain letters and digits, so names need no escaping. */
+void compile_profiler::write_json(ostream &o)
+{
+    block_profile total;
+    struct rusage usage;
+
+    totals(total);
+    getrusage(RUSAGE_SELF, &usage);
+
+    o << setprecision(9);
+    o << "{" << endl;
+    o << "  \"wall\": " << run_time << "," << endl;
+    o << "  \"max_rss_kb\": " << usage.ru_maxrss << "," << endl;
+    o << "  \"output_bytes\": " << output_bytes << "," << endl;
+    o << "  \"output_writes\": " << output_writes << "," << endl;
+    o << "  \"total\": {";
+    write_counts(o, total);
+    o << "}," << endl;
+    o << "  \"blocks\": [" << endl;
+    for (unsigned i = 0; i < blocks.size(); i++)
+    {
+        o << "    {\"name\": \"" << blocks[i].name << "\", \"level\": "
+          << blocks[i].level << ", ";
+        write_counts(o, blocks[i]);
+        o << "}" << (i + 1 < blocks.size() ? "," : "") << endl;
+    }
+    o << "  ]" << endl;
+    o << "}" << endl;
+    o << setprecision(6);
+}
@@ -0,0 +1,105 @@
+#ifndef __PROFILE_HH__
+#define __PROFILE_HH__
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+/* Prototype, see symtab.hh. */
+class symbol;
+
+
+/* The phases of the compilation that are timed. Scanning happens on demand
+   while parsing, and the other phases are run from the parser.y actions
+   when a block is complete, so parsing is whatever time is left over. */
+typedef enum {
+    PHASE_SCAN,
+    PHASE_PARSE,
+    PHASE_TYPECHECK,
+    PHASE_OPTIMIZE,
+    PHASE_QUADS,
+    PHASE_CODEGEN,
+    NR_PHASES
+} compile_phase;
+
+
+/* What was measured for one block. Time and counts are for everything that
+   happened since the previous block was finished; for an outer block that
+   is the part of it that comes after its inner blocks. */
+class block_profile {
+public:
+    string name;
+    int    level;
+    double time[NR_PHASES];             // Seconds.
+    long   nodes;                       // AST nodes created.
+    long   quads;                       // Quads handed to the backend.
+    long   symbols;                     // Symbols installed.
+    long   temps;                       // Temporaries generated.
+
+    void   clear();
+};
+
+
+/* This class is the compile-time profiler enabled by the -T flag. It is
+   always there, but does nothing (except test a flag) unless enabled, so
+   the calls in parser.y can be left in unconditionally. At the end of the
+   run main.cc asks it for a per-block report and a JSON summary. */
+class compile_profiler {
+private:
+    bool                  enabled;
+    double                run_start;        // When begin_run() was called.
+    double                run_time;         // Total wall time of the run.
+    double                block_start;      // When the current block began.
+    double                phase_start[NR_PHASES];
+    block_profile         current;          // The block being compiled.
+    vector<block_profile> blocks;           // The finished ones.
+    long                  nodes_mark;       // Counters at block_start.
+    long                  symbols_mark;
+    long                  temps_mark;
+    long                  output_bytes;     // Assembler written, and the
+    long                  output_writes;    //   number of writes it took.
+
+    void                  totals(block_profile &);
+    void                  write_counts(ostream &, block_profile &);
+
+public:
+    compile_profiler();
+
+    double now();                            // Wall clock, in seconds.
+    void enable()               { enabled = true; }
+    bool is_enabled()           { return enabled; }
+
+    // Time a phase. These may not be nested for the same phase.
+    void start(compile_phase p) { if (enabled) phase_start[p] = now(); }
+    void stop(compile_phase p)
+    {
+        if (enabled)
+            current.time[p] += now() - phase_start[p];
+    }
+
+    void begin_run();                        // Called around yyparse().
+    void end_run();
+    void end_block(symbol *);                // The block is done.
+
+    // The quad optimizer and code generator may run after end_block() for
+    // the block, on a backend thread, so they report here instead. block is
+    // what next_block() said when the block was handed to the backend.
+    int  next_block()           { return blocks.size(); }
+    void add_backend(int block, const double *time, long quads);
+    void count_output(long bytes)            // Assembler was written.
+    {
+        output_bytes += bytes;
+        output_writes++;
+    }
+
+    void report(ostream &);                  // Human readable table.
+    void write_json(ostream &);              // Machine readable summary.
+};
+
+
+extern __thread compile_profiler *profiler; // Defined in profile.cc.
+
+#endif
@@ -0,0 +1,687 @@
+#include "quadopt.hh"
+
+/*** This file contains the quad optimizer. See quadopt.hh for what it
+     does. All the passes work on a snapshot of the indexes of the quads
+     that are on the list, see collect(), and remove quads from the list
+     as they go; only tail recursion elimination ever inserts any. ***/
+
+
+// The quad optimizer of the compilation on this thread, see
+// compilation.hh. The backend threads of -J have their own.
+__thread quad_optimizer *quad_opt = NULL;
+
+
+/* The passes are repeated until nothing changes, but never more than this
+   many times. */
+const int MAX_QUAD_OPT_ROUNDS = 10;
+
+
+/* Returns true for a temporary of the block being optimized. Temporaries
+   are the block's variables from first_temp and up, see quads.cc. */
+bool quad_optimizer::is_temp(sym_index sym_p)
+{
+    if (sym_p == NULL_SYM)
+        return false;
+
+    symbol *sym = sym_tab->get_symbol(sym_p);
+    return sym->tag == SYM_VAR && sym->level == level &&
+        sym->offset >= q_list->first_temp;
+}
+
+
+/* Returns true for a constant. */
+bool quad_optimizer::is_const(sym_index sym_p)
+{
+    return sym_p != NULL_SYM && sym_tab->get_symbol(sym_p)->tag == SYM_CONST;
+}
+
+
+/* Returns true if a quad computes a value from its arguments only (and, for
+   the array reads, memory), so that computing it again may be replaced by a
+   copy of the first result. */
+bool quad_optimizer::is_expression(quad_op_type op)
+{
+    switch (op)
+    {
+    case q_rstore:
+    case q_istore:
+    case q_rassign:
+    case q_iassign:
+    case q_call:
+    case q_rreturn:
+    case q_ireturn:
+    case q_jmp:
+    case q_jmpf:
+    case q_param:
+    case q_labl:
+    case q_nop:
+        return false;
+    default:
+        return true;
+    }
+}
+
+
+/* Return the symbol sym_p is currently a copy of, or sym_p itself. A q_param
+   argument isn't read until the q_call, so there only_stable asks for
+   temporaries and constants, which no call in between can change. */
+sym_index quad_optimizer::copy_of(sym_index sym_p, bool only_stable)
+{
+    map<sym_index, sym_index>::iterator it = copies.find(sym_p);
+
+    if (it == copies.end())
+        return sym_p;
+    if (only_stable && !is_temp(it->second) && !is_const(it->second))
+        return sym_p;
+    return it->second;
+}
+
+
+/* Forget everything we know that involves sym_p, which is about to get a
+   new value. */
+void quad_optimizer::kill(sym_index sym_p)
+{
+    map<sym_index, sym_index>::iterator it;
+    unsigned i;
+
+    for (it = copies.begin(); it != copies.end(); )
+    {
+        if (it->first == sym_p || it->second == sym_p)
+            copies.erase(it++);
+        else
+            ++it;
+    }
+
+    for (i = 0; i < exprs.size(); )
+    {
+        if (exprs[i].sym1 == sym_p || exprs[i].sym2 == sym_p ||
+            exprs[i].result == sym_p)
+        {
+            exprs[i] = exprs.back();
+            exprs.pop_back();
+        }
+        else
+            i++;
+    }
+}
+
+
+/* Forget the array reads, after something was stored to an array. */
+void quad_optimizer::kill_memory()
+{
+    unsigned i;
+
+    for (i = 0; i < exprs.size(); )
+    {
+        if (exprs[i].op == q_irindex || exprs[i].op == q_rrindex)
+        {
+            exprs[i] = exprs.back();
+            exprs.pop_back();
+        }
+        else
+            i++;
+    }
+}
+
+
+/* Forget everything that a call may change: anything involving a variable
+   or parameter (a callee can reach those of any enclosing block), and all
+   array reads. Temporaries and constants are safe. */
+void quad_optimizer::kill_nonlocal()
+{
+    map<sym_index, sym_index>::iterator it;
+    vector<sym_index> victims;
+    unsigned i;
+
+    kill_memory();
+
+    for (it = copies.begin(); it != copies.end(); ++it)
+    {
+        if (!is_temp(it->first) && !is_const(it->first))
+            victims.push_back(it->first);
+        if (!is_temp(it->second) && !is_const(it->second))
+            victims.push_back(it->second);
+    }
+
+    for (i = 0; i < exprs.size(); i++)
+    {
+        available_expr &e = exprs[i];
+        if (e.sym1 != NULL_SYM && !is_temp(e.sym1) && !is_const(e.sym1) &&
+            sym_tab->get_symbol(e.sym1)->tag != SYM_ARRAY)
+            victims.push_back(e.sym1);
+        if (e.sym2 != NULL_SYM && !is_temp(e.sym2) && !is_const(e.sym2))
+            victims.push_back(e.sym2);
+        if (!is_temp(e.result))
+            victims.push_back(e.result);
+    }
+
+    for (i = 0; i < victims.size(); i++)
+        kill(victims[i]);
+}
+
+
+/* Fill in the indexes of the quads on the list, in order. */
+void quad_optimizer::collect(vector<int> &quads)
+{
+    quad_list_iterator *ql_iterator = new quad_list_iterator(q_list);
+
+    quads.clear();
+    for (quadruple *q = ql_iterator->get_current(); q != NULL;
+         q = ql_iterator->get_next())
+        quads.push_back(ql_iterator->get_index());
+    delete ql_iterator;
+}
+
+
+/* Follow a label through any chain of unconditional jumps that start right
+   after it, and return the label at the end of the chain. */
+static int final_target(quad_list *q_list, vector<int> &quads,
+                        map<int, int> &label_pos, int label)
+{
+    // A chain can't be longer than the list, unless it is a loop.
+    for (unsigned n = 0; n < quads.size(); n++)
+    {
+        map<int, int>::iterator it = label_pos.find(label);
+        if (it == label_pos.end())
+            break;
+
+        unsigned i = it->second + 1;
+        while (i < quads.size() &&
+               (q_list->get_quad(quads[i])->op_code == q_labl ||
+                q_list->get_quad(quads[i])->op_code == q_nop))
+            i++;
+
+        if (i == quads.size())
+            break;
+        quadruple *q = q_list->get_quad(quads[i]);
+        if (q->op_code != q_jmp || q->int1 == label)
+            break;
+        label = q->int1;
+    }
+
+    return label;
+}
+
+
+/* Redirect jumps to jumps, and remove jumps to the next quad, quads that
+   can't be reached and labels that nothing refers to. Returns true if
+   anything changed. */
+bool quad_optimizer::thread_jumps()
+{
+    vector<int>   quads;
+    map<int, int> label_pos;           // Label -> position in quads.
+    map<int, int> refs;                // Label -> number of references.
+    bool          changed = false;
+    unsigned      i, j;
+
+    collect(quads);
+    for (i = 0; i < quads.size(); i++)
+    {
+        quadruple *q = q_list->get_quad(quads[i]);
+        if (q->op_code == q_labl)
+            label_pos[q->int1] = i;
+    }
+
+    vector<bool> removed(quads.size(), false);
+    for (i = 0; i < quads.size(); i++)
+    {
+        quadruple *q = q_list->get_quad(quads[i]);
+
+        if (q->op_code != q_jmp && q->op_code != q_jmpf &&
+            q->op_code != q_ireturn && q->op_code != q_rreturn)
+            continue;
+
+        if (q->op_code == q_jmp || q->op_code == q_jmpf)
+        {
+            int target = final_target(q_list, quads, label_pos, q->int1);
+            if (target != q->int1)
+            {
+                q->int1 = target;
+                changed = true;
+            }
+
+            // A jump to one of the labels right after it does nothing.
+            for (j = i + 1; j < quads.size(); j++)
+            {
+                quadruple *next = q_list->get_quad(quads[j]);
+                if (next->op_code != q_labl)
+                    break;
+                if (next->int1 == q->int1)
+                {
+                    removed[i] = true;
+                    break;
+                }
+            }
+            if (removed[i] || q->op_code == q_jmpf)
+                continue;
+        }
+
+        // Nothing after an unconditional jump is reached until a label.
+        for (j = i + 1; j < quads.size(); j++)
+        {
+            if (q_list->get_quad(quads[j])->op_code == q_labl)
+                break;
+            removed[j] = true;
+        }
+        i = j - 1;
+    }
+
+    // Count the references to each label from the quads that are left. The
+    // last label is where a block returns from, so it always stays.
+    refs[q_list->last_label]++;
+    for (i = 0; i < quads.size(); i++)
+    {
+        quadruple *q = q_list->get_quad(quads[i]);
+        if (!removed[i] &&
+            (q->op_code == q_jmp || q->op_code == q_jmpf ||
+             q->op_code == q_ireturn || q->op_code == q_rreturn))
+            refs[q->int1]++;
+    }
+
+    for (i = 0; i < quads.size(); i++)
+    {
+        quadruple *q = q_list->get_quad(quads[i]);
+        if (q->op_code == q_labl && refs.find(q->int1) == refs.end())
+            removed[i] = true;
+        if (removed[i])
+        {
+            q_list->remove(quads[i]);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+
+/* Do the local optimizations on the basic block made up of quads[first]
+   to quads[last]. Returns true if anything changed. */
+bool quad_optimizer::optimize_block(vector<int> &quads, int first, int last)
+{
+    bool changed = false;
+
+    exprs.clear();
+    copies.clear();
+
+    for (int i = first; i <= last; i++)
+    {
+        quadruple *q = q_list->get_quad(quads[i]);
+        sym_index old1 = q->sym1, old2 = q->sym2, old3 = q->sym3;
+
+        // Copy propagation: read the original instead of the copy.
+        switch (q->op_code)
+        {
+        case q_iload:
+        case q_rload:
+        case q_call:
+        case q_jmp:
+        case q_labl:
+        case q_nop:
+            break;
+        case q_param:
+            q->sym1 = copy_of(q->sym1, true);
+            break;
+        case q_inot:
+        case q_ruminus:
+        case q_iuminus:
+        case q_itor:
+        case q_iassign:
+        case q_rassign:
+            q->sym1 = copy_of(q->sym1, false);
+            break;
+        case q_rstore:
+        case q_istore:
+            q->sym1 = copy_of(q->sym1, false);
+            q->sym3 = copy_of(q->sym3, false);
+            break;
+        case q_rreturn:
+        case q_ireturn:
+        case q_jmpf:
+            q->sym2 = copy_of(q->sym2, false);
+            break;
+        default:
+            q->sym1 = copy_of(q->sym1, false);
+            q->sym2 = copy_of(q->sym2, false);
+            break;
+        }
+        if (q->sym1 != old1 || q->sym2 != old2 || q->sym3 != old3)
+            changed = true;
+
+        if (is_expression(q->op_code))
+        {
+            available_expr e;
+            e.op = q->op_code;
+            e.sym1 = NULL_SYM;
+            e.sym2 = NULL_SYM;
+            e.int1 = 0;
+            e.result = q->sym3;
+
+            switch (q->op_code)
+            {
+            case q_iload:
+            case q_rload:
+                e.int1 = q->int1;
+                break;
+            case q_inot:
+            case q_ruminus:
+            case q_iuminus:
+            case q_itor:
+                e.sym1 = q->sym1;
+                break;
+            case q_iplus:
+            case q_rplus:
+            case q_imult:
+            case q_rmult:
+            case q_iand:
+            case q_ior:
+            case q_ieq:
+            case q_req:
+            case q_ine:
+            case q_rne:
+                // These don't care about the order of the arguments.
+                e.sym1 = min(q->sym1, q->sym2);
+                e.sym2 = max(q->sym1, q->sym2);
+                break;
+            default:
+                e.sym1 = q->sym1;
+                e.sym2 = q->sym2;
+                break;
+            }
+
+            // Common subexpression elimination: copy the earlier result.
+            unsigned j;
+            for (j = 0; j < exprs.size(); j++)
+                if (exprs[j].op == e.op && exprs[j].sym1 == e.sym1 &&
+                    exprs[j].sym2 == e.sym2 && exprs[j].int1 == e.int1)
+                    break;
+
+            if (j < exprs.size())
+            {
+                switch (q->op_code)
+                {
+                case q_rload:
+                case q_ruminus:
+                case q_rplus:
+                case q_rminus:
+                case q_rmult:
+                case q_rdivide:
+                case q_rrindex:
+                case q_itor:
+                    q->op_code = q_rassign;
+                    break;
+                default:
+                    q->op_code = q_iassign;
+                    break;
+                }
+                q->sym1 = exprs[j].result;
+                changed = true;
+            }
+            else
+            {
+                kill(q->sym3);
+                if (e.sym1 != q->sym3 && e.sym2 != q->sym3)
+                    exprs.push_back(e);
+                continue;
+            }
+        }
+
+        switch (q->op_code)
+        {
+        case q_iassign:
+        case q_rassign:
+            if (q->sym1 == q->sym3)
+            {
+                q_list->remove(quads[i]);
+                changed = true;
+                break;
+            }
+            kill(q->sym3);
+            copies[q->sym3] = q->sym1;
+            break;
+        case q_istore:
+        case q_rstore:
+            kill_memory();
+            break;
+        case q_call:
+            kill_nonlocal();
+            if (q->sym3 != NULL_SYM)
+                kill(q->sym3);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return changed;
+}
+
+
+/* Split the list into basic blocks and optimize each of them. Returns true
+   if anything changed. */
+bool quad_optimizer::optimize_blocks()
+{
+    vector<int> quads;
+    bool        changed = false;
+    int         first = 0;
+
+    collect(quads);
+    for (int i = 0; i < (int)quads.size(); i++)
+    {
+        quad_op_type op = q_list->get_quad(quads[i])->op_code;
+
+        if (op == q_labl && i > first)
+        {
+            if (optimize_block(quads, first, i - 1))
+                changed = true;
+            first = i;
+        }
+        if (op == q_jmp || op == q_jmpf || op == q_ireturn ||
+            op == q_rreturn)
+        {
+            if (optimize_block(quads, first, i))
+                changed = true;
+            first = i + 1;
+        }
+    }
+    if (first < (int)quads.size() &&
+        optimize_block(quads, first, quads.size() - 1))
+        changed = true;
+
+    return changed;
+}
+
+
+/* Remove the quads that compute temporaries which are never read. Calls
+   are kept for their side effects. Returns true if anything changed. */
+bool quad_optimizer::remove_dead_temps()
+{
+    vector<int>         quads;
+    map<sym_index, int> uses;
+    sym_index           ops[3];
+    bool                changed = false;
+    int                 i, j, n;
+
+    collect(quads);
+    for (i = 0; i < (int)quads.size(); i++)
+    {
+        n = q_list->get_quad(quads[i])->get_uses(ops);
+        for (j = 0; j < n; j++)
+            uses[ops[j]]++;
+    }
+
+    // Going backwards removes a whole chain of dead temporaries at once.
+    for (i = quads.size() - 1; i >= 0; i--)
+    {
+        quadruple *q = q_list->get_quad(quads[i]);
+        sym_index def = q->get_def();
+
+        if (q->op_code == q_call || !is_temp(def) || uses[def] > 0)
+            continue;
+
+        n = q->get_uses(ops);
+        for (j = 0; j < n; j++)
+            uses[ops[j]]--;
+        q_list->remove(quads[i]);
+        changed = true;
+    }
+
+    return changed;
+}
+
+
+/* Let a quad that computes a temporary which is only read by a copy right
+   after it compute the copy's target directly, and remove the copy. This
+   is what every assignment statement looks like. Returns true if anything
+   changed. */
+bool quad_optimizer::coalesce_copies()
+{
+    vector<int>         quads;
+    map<sym_index, int> uses;
+    sym_index           ops[3];
+    bool                changed = false;
+    int                 i, j, n;
+
+    collect(quads);
+    for (i = 0; i < (int)quads.size(); i++)
+    {
+        n = q_list->get_quad(quads[i])->get_uses(ops);
+        for (j = 0; j < n; j++)
+            uses[ops[j]]++;
+    }
+
+    for (i = 1; i < (int)quads.size(); i++)
+    {
+        quadruple *q = q_list->get_quad(quads[i]);
+        quadruple *prev = q_list->get_quad(quads[i - 1]);
+
+        if ((q->op_code != q_iassign && q->op_code != q_rassign) ||
+            !is_temp(q->sym1) || uses[q->sym1] != 1 ||
+            prev->get_def() != q->sym1)
+            continue;
+
+        prev->sym3 = q->sym3;
+        q_list->remove(quads[i]);
+        changed = true;
+    }
+
+    return changed;
+}
+
+
+/* Replace calls of the block itself in tail position by a jump back to its
+   start. The arguments are copied into new temporaries where the q_params
+   were, since the parameters may still be read by the arguments that are
+   evaluated after them, and assigned to the parameters where the q_call
+   was. Returns true if anything changed. */
+bool quad_optimizer::eliminate_tail_recursion()
+{
+    vector<int>       quads;
+    vector<sym_index> formals;
+    vector<parameter_symbol *> params;
+    parameter_symbol *param;
+    bool              changed = false;
+    int               i, j, k;
+
+    // The parameters can't be looked up by name, since the block's scope is
+    // closed by the time a backend thread gets here, nor found by position,
+    // since with -J a temporary may have been installed among them. Each
+    // knows its own index instead.
+    if (env->tag == SYM_FUNC)
+        param = env->get_function_symbol()->last_parameter;
+    else
+        param = env->get_procedure_symbol()->last_parameter;
+    for (; param != NULL; param = param->preceding)
+        params.insert(params.begin(), param);
+    for (k = 0; k < (int)params.size(); k++)
+        formals.push_back(params[k]->self);
+
+    collect(quads);
+    for (i = 0; i < (int)quads.size(); i++)
+    {
+        quadruple *q = q_list->get_quad(quads[i]);
+        if (q->op_code != q_call || sym_tab->get_symbol(q->sym1) != env ||
+            !q_list->is_tail_call(quads[i]))
+            continue;
+
+        // Find the q_params of this call, first argument first. Calls in
+        // the arguments have their own q_params before them.
+        vector<int> args;
+        int skip = 0;
+        for (j = i - 1; j >= 0 && (int)args.size() < q->int2; j--)
+        {
+            quadruple *p = q_list->get_quad(quads[j]);
+            if (p->op_code == q_call)
+                skip += p->int2;
+            else if (p->op_code == q_param && skip > 0)
+                skip--;
+            else if (p->op_code == q_param)
+                args.push_back(quads[j]);
+        }
+        if (args.size() != formals.size())
+            fatal("quad_optimizer: wrong number of arguments in tail call");
+
+        if (entry_label == -1)
+        {
+            entry_label = sym_tab->get_next_label();
+            q_list->insert_after(-1, quadruple(q_labl, entry_label,
+                                               NULL_SYM, NULL_SYM));
+        }
+
+        int pos = quads[i];
+        for (k = 0; k < (int)formals.size(); k++)
+        {
+            sym_index    type = sym_tab->get_symbol_type(formals[k]);
+            quad_op_type op = type == real_type ? q_rassign : q_iassign;
+            sym_index    temp = sym_tab->gen_temp_var(type, env_p);
+
+            // The quadruple pointers are only good until the next insert.
+            quadruple *p = q_list->get_quad(args[k]);
+            *p = quadruple(op, p->sym1, NULL_SYM, temp);
+            pos = q_list->insert_after(pos, quadruple(op, temp, NULL_SYM,
+                                                      formals[k]));
+        }
+        q_list->insert_after(pos, quadruple(q_jmp, entry_label,
+                                            NULL_SYM, NULL_SYM));
+        q_list->remove(quads[i]);
+        changed = true;
+    }
+
+    return changed;
+}
+
+
+/* The optimizer's interface method. */
+int quad_optimizer::do_optimize(quad_list *q, sym_index env_p)
+{
+    int before = q->size();
+    bool inserted = false;
+
+    q_list = q;
+    this->env_p = env_p;
+    env = sym_tab->get_symbol(env_p);
+    level = env->level + 1;
+    entry_label = -1;
+
+    for (int round = 0; round < MAX_QUAD_OPT_ROUNDS; round++)
+    {
+        bool changed = eliminate_tail_recursion();
+        if (changed)
+            inserted = true;
+        if (thread_jumps())
+            changed = true;
+        if (optimize_blocks())
+            changed = true;
+        if (remove_dead_temps())
+            changed = true;
+        if (coalesce_copies())
+            changed = true;
+        if (!changed)
+            break;
+    }
+
+    // Removing quads leaves holes in the list's array.
+    if (q->size() != before || inserted)
+        q->compact();
+
+    return before - q->size();
+}
@@ -0,0 +1,94 @@
+#ifndef __QUADOPT_HH__
+#define __QUADOPT_HH__
+
+#include <vector>
+#include <map>
+#include "symtab.hh"
+#include "quads.hh"
+using namespace std;
+
+
+/*** This class optimizes the quad list of a block after it has been
+     generated, before it is handed to the backend. The AST optimizer only
+     sees one expression at a time; this one sees the whole block, and
+     removes the redundancy that the straightforward quad generation in
+     quads.cc leaves behind:
+
+     - Local common subexpression elimination. Within a basic block, an
+       expression (or constant load, or array address) that has already
+       been computed into a symbol that still holds it is replaced by a
+       copy of that symbol.
+     - Copy propagation. Within a basic block, uses of the target of a copy
+       are replaced by the source of the copy.
+     - Dead temporary elimination. Quads that compute a temporary nobody
+       reads are removed, and a temporary that is only computed to be
+       copied into a variable right away is replaced by the variable.
+     - Jump threading. Jumps to jumps are redirected to their final target,
+       jumps to the next quad are removed, as are unreachable quads and
+       labels that nothing jumps to.
+     - Tail recursion elimination. A call of the block itself in tail
+       position becomes assignments to its parameters and a jump back to
+       the start of the block, so it runs in constant stack space. Other
+       tail calls are left to the backend.
+
+     Only temporaries are ever removed; user variables are always stored,
+     since inner blocks may read them. ***/
+
+
+class quad_optimizer;
+
+
+extern __thread quad_optimizer *quad_opt; // Defined in quadopt.cc.
+
+
+/* An available expression: the symbol result holds the value of op applied
+   to sym1, sym2 and int1. */
+class available_expr {
+public:
+    quad_op_type op;
+    sym_index    sym1;
+    sym_index    sym2;
+    int          int1;
+    sym_index    result;
+};
+
+
+class quad_optimizer {
+private:
+    quad_list     *q_list;            // The list being optimized.
+    sym_index     env_p;              // The block's symbol, and the
+    symbol        *env;               //   symbol itself.
+    block_level   level;              // The level of the block's symbols.
+    int           entry_label;        // Label at the start of the block,
+                                      //   or -1 if there is none yet.
+
+    vector<available_expr>    exprs;  // Available expressions.
+    map<sym_index, sym_index> copies; // Symbol -> symbol it is a copy of.
+
+    bool is_temp(sym_index);
+    bool is_const(sym_index);
+    bool is_expression(quad_op_type);
+    sym_index copy_of(sym_index, bool);
+
+    void kill(sym_index);
+    void kill_memory();
+    void kill_nonlocal();
+
+    void collect(vector<int> &);
+    bool thread_jumps();
+    bool optimize_block(vector<int> &, int, int);
+    bool optimize_blocks();
+    bool remove_dead_temps();
+    bool coalesce_copies();
+    bool eliminate_tail_recursion();
+
+public:
+    // This is the interface to the backend pipeline, see pipeline.hh.
+    // Optimizes the quad list of the block whose symbol is the second
+    // argument, and returns the number of quads that were removed. Each
+    // backend thread has its own quad_optimizer.
+    int do_optimize(quad_list *, sym_index);
+};
+
+
+#endif
@@ -1,9 +1,11 @@
 #include <iostream>
 #include <iomanip>
 #include <stdio.h>
+#include <string.h>
 #include "symtab.hh"
 #include "ast.hh"
 #include "quads.hh"
+#include "regalloc.hh"
 
 using namespace std;
 
@@ -42,12 +44,69 @@ quadruple::quadruple(quad_op_type op, sym_index s1, int i2, sym_index s3) :
 
 
 
-/* The quad_list_element constructor. Not very exciting really. This class
-   is never used outside the quad_list class. */
-quad_list_element::quad_list_element(quadruple *q, quad_list_element *n) :
-    data(q),
-    next(n)
+/* Return the symbols read by a quad. See quads.hh. */
+int quadruple::get_uses(sym_index *uses)
 {
+    int n = 0;
+
+    switch (op_code)
+    {
+    case q_iload:
+    case q_rload:
+    case q_call:
+    case q_jmp:
+    case q_labl:
+    case q_nop:
+        break;
+    case q_inot:
+    case q_ruminus:
+    case q_iuminus:
+    case q_itor:
+    case q_iassign:
+    case q_rassign:
+    case q_param:
+        uses[n++] = sym1;
+        break;
+    case q_rstore:
+    case q_istore:
+        uses[n++] = sym1;
+        uses[n++] = sym3;
+        break;
+    case q_rreturn:
+    case q_ireturn:
+    case q_jmpf:
+        uses[n++] = sym2;
+        break;
+    default:
+        // The binary operations, relations and array indexing.
+        uses[n++] = sym1;
+        uses[n++] = sym2;
+        break;
+    }
+
+    return n;
+}
+
+
+/* Return the symbol written by a quad. See quads.hh. */
+sym_index quadruple::get_def()
+{
+    switch (op_code)
+    {
+    case q_rstore:
+    case q_istore:
+    case q_rreturn:
+    case q_ireturn:
+    case q_jmp:
+    case q_jmpf:
+    case q_param:
+    case q_labl:
+    case q_nop:
+        return NULL_SYM;
+    default:
+        // Note that this is NULL_SYM for a procedure q_call.
+        return sym3;
+    }
 }
 
 
@@ -55,6 +114,7 @@ quad_list_element::quad_list_element(quadruple *q, quad_list_element *n) :
 /* The quad_list_iterator constructor. It initializes the iterator to point
    to the first element of the quad list passed to it as an argument. */
 quad_list_iterator::quad_list_iterator(quad_list *q_list) :
+    list(q_list),
     current(q_list->head)
 {
 }
@@ -63,50 +123,198 @@ quad_list_iterator::quad_list_iterator(quad_list *q_list) :
    we've reached the end of the list. */
 quadruple *quad_list_iterator::get_current()
 {
-    if (current == NULL)
+    if (current == -1)
         return NULL;
 
-    return current->data;
+    return &list->elements[current].data;
 }
 
 /* Return the next quadruple on the quad list we're iterating over, or NULL if
-   there are no more. */
+   there are no more. A removed quad keeps its links, so this works even if
+   the current quad has just been removed. */
 quadruple *quad_list_iterator::get_next()
 {
-    if (current->next == NULL)
+    if (current == -1 || list->elements[current].next == -1)
+        return NULL;
+
+    current = list->elements[current].next;
+    return &list->elements[current].data;
+}
+
+/* Return the quadruple after the current one, or NULL if there is none,
+   but stay at the current one. */
+quadruple *quad_list_iterator::peek_next()
+{
+    if (current == -1 || list->elements[current].next == -1)
         return NULL;
 
-    current = current->next;
-    return current->data;
+    return &list->elements[list->elements[current].next].data;
+}
+
+/* Return the index of the current quad, for use with the quad_list
+   methods, or -1 if there is none. */
+int quad_list_iterator::get_index()
+{
+    return current;
 }
 
 
 
 /* The quad_list class. */
 quad_list::quad_list(int ll) :
-    head(NULL),
-    tail(NULL),
-    last_label(ll)
+    elements(NULL),
+    capacity(0),
+    used(0),
+    head(-1),
+    tail(-1),
+    nr_quads(0),
+    last_label(ll),
+    first_temp(0)
 {
     quad_nr = 1;
 }
 
 
-/* Operator for adding on a new quadruple to the list. */
-quad_list &quad_list::operator+=(quadruple *q)
+/* Copy a quad into a free slot of the array, growing it if needed, and
+   return its index. The slot isn't linked into the list. */
+int quad_list::new_element(const quadruple &q)
 {
-    if (head == NULL)
+    if (used == capacity)
     {
-        head = new quad_list_element(q, NULL);
-        tail = head;
+        // The old array is left to the block arena. Doubling means the
+        // abandoned arrays never add up to more than the current one.
+        int new_capacity = capacity == 0 ? 64 : capacity * 2;
+        quad_list_element *new_elements = (quad_list_element *)
+            block_arena->allocate(new_capacity * sizeof(quad_list_element));
+        if (used > 0)
+            memcpy(new_elements, elements, used * sizeof(quad_list_element));
+        elements = new_elements;
+        capacity = new_capacity;
     }
+
+    elements[used].data = q;
+    return used++;
+}
+
+
+/* Operator for adding on a new quadruple to the list. */
+quad_list &quad_list::operator+=(const quadruple &q)
+{
+    insert_after(tail, q);
+    return *this;
+}
+
+
+/* Insert a quad right after the one at index pos, or first on the list if
+   pos is -1. */
+int quad_list::insert_after(int pos, const quadruple &q)
+{
+    int i = new_element(q);
+    int next = pos == -1 ? head : elements[pos].next;
+
+    elements[i].prev = pos;
+    elements[i].next = next;
+    if (pos == -1)
+        head = i;
     else
+        elements[pos].next = i;
+    if (next == -1)
+        tail = i;
+    else
+        elements[next].prev = i;
+
+    nr_quads++;
+    return i;
+}
+
+
+/* Unlink the quad at index pos from the list. Its own links are left alone
+   so that an iterator standing on it can still move on. The slot isn't
+   reused. */
+void quad_list::remove(int pos)
+{
+    int prev = elements[pos].prev;
+    int next = elements[pos].next;
+
+    if (prev == -1)
+        head = next;
+    else
+        elements[prev].next = next;
+    if (next == -1)
+        tail = prev;
+    else
+        elements[next].prev = prev;
+
+    nr_quads--;
+}
+
+
+/* Return the quad at index pos. */
+quadruple *quad_list::get_quad(int pos)
+{
+    if (pos < 0 || pos >= used)
+        fatal("quad_list::get_quad(): index out of range");
+
+    return &elements[pos].data;
+}
+
+
+/* Returns true if the q_call at index pos is in tail position: nothing but
+   labels and jumps comes after it before the end of the block, or, for a
+   function call, before a return of its result. */
+bool quad_list::is_tail_call(int pos)
+{
+    sym_index result = elements[pos].data.sym3;
+    int       steps;
+
+    // Count the steps, in case of a loop of jumps.
+    for (steps = 0, pos = elements[pos].next; steps < nr_quads; steps++)
     {
-        tail->next = new quad_list_element(q, NULL);
-        tail = tail->next;
+        if (pos == -1)
+            return result == NULL_SYM;
+
+        quadruple &q = elements[pos].data;
+        switch (q.op_code)
+        {
+        case q_labl:
+            pos = elements[pos].next;
+            break;
+        case q_jmp:
+            // Find the label it jumps to.
+            for (pos = head; pos != -1; pos = elements[pos].next)
+                if (elements[pos].data.op_code == q_labl &&
+                    elements[pos].data.int1 == q.int1)
+                    break;
+            break;
+        case q_ireturn:
+        case q_rreturn:
+            return result != NULL_SYM && q.sym2 == result;
+        default:
+            return false;
+        }
     }
+    return false;
+}
 
-    return *this;
+
+/* Copy the quads into a fresh array in list order, dropping removed ones,
+   so that a list which has been edited a lot can be walked in memory order
+   again. Note that this changes the indexes of the quads. */
+void quad_list::compact()
+{
+    quad_list_element *old = elements;
+    int pos = head;
+
+    elements = NULL;
+    capacity = used = 0;
+    head = tail = -1;
+    nr_quads = 0;
+
+    while (pos != -1)
+    {
+        *this += old[pos].data;
+        pos = old[pos].next;
+    }
 }
 
 
@@ -148,10 +356,9 @@ sym_index ast_elsif::generate_quads(quad_list &q)
     USE_Q;
     /* Your code here. */
     int after = sym_tab->get_next_label();
-    sym_index pos = condition->generate_quads(q);
-    q += new quadruple(q_jmpf, after, pos, NULL_SYM);
+    q.do_condition(condition, after);
     body->generate_quads(q);
-    q += new quadruple(q_labl, after, NULL_SYM, NULL_SYM);
+    q += quadruple(q_labl, after, NULL_SYM, NULL_SYM);
     return NULL_SYM;
 }
 
@@ -168,7 +375,7 @@ sym_index ast_integer::generate_quads(quad_list &q)
 {
     /* Your code here. */
     sym_index address = sym_tab->gen_temp_var(integer_type);
-    q += new quadruple(q_iload, value, NULL_SYM, address);
+    q += quadruple(q_iload, value, NULL_SYM, address);
     return address;
 
 }
@@ -179,7 +386,7 @@ sym_index ast_real::generate_quads(quad_list &q)
     /* Your code here. */
     int iValue = sym_tab->ieee(value);
     sym_index address = sym_tab->gen_temp_var(real_type);
-    q += new quadruple(q_rload, iValue, NULL_SYM, address);
+    q += quadruple(q_rload, iValue, NULL_SYM, address);
     return address;
 
 }
@@ -198,7 +405,7 @@ sym_index ast_not::generate_quads(quad_list &q)
     /* Your code here. */
     sym_index pos = expr->generate_quads(q);
     sym_index address = sym_tab->gen_temp_var(type);
-    q += new quadruple(q_inot, pos, NULL_SYM, address);
+    q += quadruple(q_inot, pos, NULL_SYM, address);
     return address;
 
 }
@@ -210,9 +417,9 @@ sym_index ast_uminus::generate_quads(quad_list &q)
     sym_index pos = expr->generate_quads(q);
     sym_index address = sym_tab->gen_temp_var(type);
     if (type == integer_type)
-        q += new quadruple(q_iuminus, pos, NULL_SYM, address);
+        q += quadruple(q_iuminus, pos, NULL_SYM, address);
     else
-        q += new quadruple(q_ruminus, pos, NULL_SYM, address);
+        q += quadruple(q_ruminus, pos, NULL_SYM, address);
     return address;
 }
 
@@ -222,7 +429,7 @@ sym_index ast_cast::generate_quads(quad_list &q)
     /* Your code here. */
     sym_index pos = expr->generate_quads(q);
     sym_index address = sym_tab->gen_temp_var(integer_type);
-    q += new quadruple(q_itor, pos, NULL_SYM, address);
+    q += quadruple(q_itor, pos, NULL_SYM, address);
     return address;
 }
 
@@ -231,7 +438,7 @@ sym_index quad_list::do_binaryop(quad_list &q, ast_binaryoperation *node, quad_o
     sym_index left_pos = node->left->generate_quads(q);
     sym_index rigth_pos = node->right->generate_quads(q);
     sym_index address = sym_tab->gen_temp_var(type);
-    q += new quadruple(q_operation, left_pos, rigth_pos, address);
+    q += quadruple(q_operation, left_pos, rigth_pos, address);
     return address;
 }
 
@@ -241,10 +448,73 @@ sym_index quad_list::do_binaryrel(quad_list &q, ast_binaryrelation *node, quad_o
     sym_index rigth_pos = node->right->generate_quads(q);
     sym_index address = sym_tab->gen_temp_var(integer_type);
 
-    q += new quadruple(q_operation, left_pos, rigth_pos, address);
+    q += quadruple(q_operation, left_pos, rigth_pos, address);
     return address;
 }
 
+/* Generate quads that jump to 'label' when a condition evaluates to
+   'value' (1 for true, 0 for false), and fall through otherwise. And, or
+   and not are lowered to jumps, so that the right operand of an and/or is
+   never evaluated once the left one decides the result. */
+void quad_list::do_jump(ast_expression *condition, int value, int label)
+{
+    ast_binaryoperation *node;
+    int skip;
+
+    switch (condition->tag)
+    {
+    case AST_NOT:
+        do_jump(static_cast<ast_not *>(condition)->expr, !value, label);
+        return;
+    case AST_AND:
+    case AST_OR:
+        node = static_cast<ast_binaryoperation *>(condition);
+        // 'a and b' is false as soon as a is, 'a or b' true as soon as a is.
+        if ((condition->tag == AST_AND) == !value)
+        {
+            do_jump(node->left, value, label);
+            do_jump(node->right, value, label);
+        }
+        else
+        {
+            skip = sym_tab->get_next_label();
+            do_jump(node->left, !value, skip);
+            do_jump(node->right, value, label);
+            *this += quadruple(q_labl, skip, NULL_SYM, NULL_SYM);
+        }
+        return;
+    default:
+        break;
+    }
+
+    sym_index pos = condition->generate_quads(*this);
+    if (value)
+    {
+        // There is no jump-if-true quad, so jump around a q_jmp instead.
+        skip = sym_tab->get_next_label();
+        *this += quadruple(q_jmpf, skip, pos, NULL_SYM);
+        *this += quadruple(q_jmp, label, NULL_SYM, NULL_SYM);
+        *this += quadruple(q_labl, skip, NULL_SYM, NULL_SYM);
+    }
+    else
+        *this += quadruple(q_jmpf, label, pos, NULL_SYM);
+}
+
+/* Generate quads for the condition of an if, elsif or while statement,
+   jumping to 'label' when it is false. With short-circuit evaluation
+   turned on, and/or/not are lowered to jumps by do_jump. */
+void quad_list::do_condition(ast_expression *condition, int label)
+{
+    if (short_circuit)
+    {
+        do_jump(condition, 0, label);
+        return;
+    }
+
+    sym_index pos = condition->generate_quads(*this);
+    *this += quadruple(q_jmpf, label, pos, NULL_SYM);
+}
+
 sym_index ast_add::generate_quads(quad_list &q)
 {
     /* Your code here. */
@@ -354,9 +624,9 @@ sym_index ast_greaterthan::generate_quads(quad_list &q)
 void ast_id::generate_assignment(quad_list &q, sym_index rhs)
 {
     if (type == integer_type)
-        q += new quadruple(q_iassign, rhs, NULL_SYM, sym_p);
+        q += quadruple(q_iassign, rhs, NULL_SYM, sym_p);
     else if (type == real_type)
-        q += new quadruple(q_rassign, rhs, NULL_SYM, sym_p);
+        q += quadruple(q_rassign, rhs, NULL_SYM, sym_p);
     else
         fatal("Illegal type in ast_id::generate_assignment()");
 }
@@ -368,12 +638,12 @@ void ast_indexed::generate_assignment(quad_list &q, sym_index rhs)
     index_pos = index->generate_quads(q);
     address = sym_tab->gen_temp_var(integer_type);
 
-    q += new quadruple(q_lindex, id->sym_p, index_pos, address);
+    q += quadruple(q_lindex, id->sym_p, index_pos, address);
 
     if (type == integer_type)
-        q += new quadruple(q_istore, rhs, NULL_SYM, address);
+        q += quadruple(q_istore, rhs, NULL_SYM, address);
     else if (type == real_type)
-        q += new quadruple(q_rstore, rhs, NULL_SYM, address);
+        q += quadruple(q_rstore, rhs, NULL_SYM, address);
     else
         fatal("Illegal type in ast_indexed::generate_assignment()");
 }
@@ -416,7 +686,7 @@ void generate_parameter_list(quad_list &q,
     {
         *nr_params += 1;
         sym_index res = last_param->last_expr->generate_quads(q);
-        q += new quadruple(q_param, res, NULL_SYM, NULL_SYM);
+        q += quadruple(q_param, res, NULL_SYM, NULL_SYM);
 
         generate_parameter_list(q, last_param->preceding, nr_params);
     }
@@ -429,7 +699,7 @@ sym_index ast_procedurecall::generate_quads(quad_list &q)
     /* Your code here. */
     int nr_params = 0;
     generate_parameter_list(q, parameter_list, &nr_params);
-    q += new quadruple(q_call, id->sym_p, nr_params, NULL_SYM);
+    q += quadruple(q_call, id->sym_p, nr_params, NULL_SYM);
 
     return NULL_SYM;
 }
@@ -444,7 +714,7 @@ sym_index ast_functioncall::generate_quads(quad_list &q)
     
     generate_parameter_list(q, parameter_list, &nr_params);
 
-    q += new quadruple(q_call, id->sym_p, nr_params, ret);
+    q += quadruple(q_call, id->sym_p, nr_params, ret);
 
     return ret;
 }
@@ -455,29 +725,26 @@ sym_index ast_functioncall::generate_quads(quad_list &q)
 sym_index ast_while::generate_quads(quad_list &q)
 {
     int top, bottom;
-    sym_index pos;
 
     // We get two labels for jumps.
     top = sym_tab->get_next_label();
     bottom = sym_tab->get_next_label();
 
     // Here's the label for the top of the while body.
-    q += new quadruple(q_labl, top, NULL_SYM, NULL_SYM);
+    q += quadruple(q_labl, top, NULL_SYM, NULL_SYM);
 
-    // Generate quads for the condition. After this code is being run, we
-    // check if the result in the variable stored in 'pos' is 0. If it is,
-    // we want to exit the loop, which is done via a conditional jump to the
-    // 'bottom' label.
-    pos = condition->generate_quads(q);
-    q += new quadruple(q_jmpf, bottom, pos, NULL_SYM);
+    // Generate quads for the condition. If it evaluates to false we want to
+    // exit the loop, which is done via a conditional jump to the 'bottom'
+    // label.
+    q.do_condition(condition, bottom);
 
     // Generate quads for the body. Following these come an unconditional
     // jump to the 'top' label, ie, run the condition etc again.
-    pos = body->generate_quads(q);
-    q += new quadruple(q_jmp, top,  NULL_SYM, NULL_SYM);
+    body->generate_quads(q);
+    q += quadruple(q_jmp, top,  NULL_SYM, NULL_SYM);
 
     // This is where we jump to if the while condition evaluates to false.
-    q += new quadruple(q_labl, bottom, NULL_SYM, NULL_SYM);
+    q += quadruple(q_labl, bottom, NULL_SYM, NULL_SYM);
 
     return NULL_SYM;
 }
@@ -488,9 +755,7 @@ sym_index ast_while::generate_quads(quad_list &q)
 void ast_elsif::generate_quads_and_jump(quad_list &q, int label)
 {
     /* Your code here. */
-    sym_index pos;
-    pos = condition->generate_quads(q);
-    q += new quadruple(q_jmpf, label, pos, NULL_SYM);
+    q.do_condition(condition, label);
     if (body != NULL)
         body->generate_quads(q);
 }
@@ -506,8 +771,8 @@ void ast_elsif_list::generate_quads_and_jump(quad_list &q, int label)
 
     int elsif_end = sym_tab->get_next_label();
     last_elsif->generate_quads_and_jump(q, elsif_end);
-    q += new quadruple(q_jmp, label, NULL_SYM, NULL_SYM);
-    q += new quadruple(q_labl, elsif_end, NULL_SYM, NULL_SYM);
+    q += quadruple(q_jmp, label, NULL_SYM, NULL_SYM);
+    q += quadruple(q_labl, elsif_end, NULL_SYM, NULL_SYM);
 }
 
 void quad_list::start_generate_elsif_list(ast_elsif_list *elsif_list, int label)
@@ -525,36 +790,34 @@ sym_index ast_if::generate_quads(quad_list &q)
     /* Your code here. */
 
     int end_label, next_label;
-    sym_index pos;
 
     if (elsif_list != NULL || else_body != NULL)
         next_label = sym_tab->get_next_label();
     end_label = sym_tab->get_next_label();
 
-    pos = condition->generate_quads(q);
     if (elsif_list != NULL || else_body != NULL)
     {
-        q += new quadruple(q_jmpf, next_label, pos, NULL_SYM);
+        q.do_condition(condition, next_label);
     }else
     {
-        q += new quadruple(q_jmpf, end_label, pos, NULL_SYM);
+        q.do_condition(condition, end_label);
     }
 
     if (body != NULL)
         body->generate_quads(q);
 
     if (elsif_list != NULL || else_body != NULL)
-        q += new quadruple(q_jmp, end_label, NULL_SYM, NULL_SYM);
+        q += quadruple(q_jmp, end_label, NULL_SYM, NULL_SYM);
 
     if (elsif_list != NULL)
     {
-        q += new quadruple(q_labl, next_label, NULL_SYM, NULL_SYM);
+        q += quadruple(q_labl, next_label, NULL_SYM, NULL_SYM);
         next_label = sym_tab->get_next_label();
         
         if (else_body != NULL)
         {
             q.start_generate_elsif_list(elsif_list, next_label);
-            q += new quadruple(q_jmp, end_label, NULL_SYM, NULL_SYM);
+            q += quadruple(q_jmp, end_label, NULL_SYM, NULL_SYM);
         }
         else if (else_body == NULL)
         {
@@ -565,11 +828,11 @@ sym_index ast_if::generate_quads(quad_list &q)
     if (else_body != NULL)
     {
         
-        q += new quadruple(q_labl, next_label, NULL_SYM, NULL_SYM);
+        q += quadruple(q_labl, next_label, NULL_SYM, NULL_SYM);
         else_body->generate_quads(q);
     }
 
-    q += new quadruple(q_labl, end_label, NULL_SYM, NULL_SYM);
+    q += quadruple(q_labl, end_label, NULL_SYM, NULL_SYM);
     return NULL_SYM;
 }
 
@@ -582,14 +845,14 @@ sym_index ast_return::generate_quads(quad_list &q)
     {
         sym_index pos = value->generate_quads(q);
         if (value->type == integer_type)
-            q += new quadruple(q_ireturn, q.last_label, pos, NULL_SYM);
+            q += quadruple(q_ireturn, q.last_label, pos, NULL_SYM);
         else
-            q += new quadruple(q_rreturn, q.last_label, pos, NULL_SYM);
+            q += quadruple(q_rreturn, q.last_label, pos, NULL_SYM);
         return pos;
     }
     else
     {
-        q += new quadruple(q_jmp, q.last_label, NULL_SYM, NULL_SYM);
+        q += quadruple(q_jmp, q.last_label, NULL_SYM, NULL_SYM);
         return NULL_SYM;
     }
 }
@@ -603,9 +866,9 @@ sym_index ast_indexed::generate_quads(quad_list &q)
     sym_index address = sym_tab->gen_temp_var(type);
 
     if (type == integer_type)
-        q += new quadruple(q_irindex, id->sym_p, index_pos, address);
+        q += quadruple(q_irindex, id->sym_p, index_pos, address);
     else
-        q += new quadruple(q_rrindex, id->sym_p, index_pos, address);
+        q += quadruple(q_rrindex, id->sym_p, index_pos, address);
 
     return address;
 
@@ -643,30 +906,64 @@ sym_index ast_functionhead::generate_quads(quad_list &q)
 
 
 
+/* Every intermediate result gets a temporary variable of its own, which
+   makes the activation record grow with the size of the code. Once the
+   quads for a block are done (and optimized) we know the lifetimes of the
+   temporaries, so the ones that are never live at the same time are made to
+   share stack slots. They were all allocated after the block's declared
+   variables, starting at first_temp. This sets the block's ar_size, so it
+   has to be called before the quads are handed to the backend. */
+void quad_list::share_temp_slots(sym_index env_p)
+{
+    register_allocator slots;
+    symbol *env = sym_tab->get_symbol(env_p);
+    int size = first_temp + slots.share_temp_slots(this, env, first_temp);
+
+    if (env->tag == SYM_FUNC)
+        env->get_function_symbol()->ar_size = size;
+    else
+        env->get_procedure_symbol()->ar_size = size;
+}
+
+
 /* These two methods actually start off the quad generation, also taking
    care of adding a last_label. The code is identical for the two methods. */
 quad_list *ast_procedurehead::do_quads(ast_stmt_list *s)
 {
+    procedure_symbol *proc =
+        sym_tab->get_symbol(sym_p)->get_procedure_symbol();
     int last_label = sym_tab->get_next_label();
     quad_list *q = new quad_list(last_label);
 
+    q->first_temp = proc->ar_size;
+
     if (s != NULL)
         s->generate_quads(*q);
 
-    (*q) += new quadruple(q_labl, last_label, NULL_SYM, NULL_SYM);
+    (*q) += quadruple(q_labl, last_label, NULL_SYM, NULL_SYM);
+
+    // Before the backend gets to the enclosing block, see regalloc.hh.
+    mark_nonlocal_uses(q, proc->level + 1);
 
     return q;
 }
 
 quad_list *ast_functionhead::do_quads(ast_stmt_list *s)
 {
+    function_symbol *func =
+        sym_tab->get_symbol(sym_p)->get_function_symbol();
     int last_label = sym_tab->get_next_label();
     quad_list *q = new quad_list(last_label);
 
+    q->first_temp = func->ar_size;
+
     if (s != NULL)
         s->generate_quads(*q);
 
-    (*q) += new quadruple(q_labl, last_label, NULL_SYM, NULL_SYM);
+    (*q) += quadruple(q_labl, last_label, NULL_SYM, NULL_SYM);
+
+    // Before the backend gets to the enclosing block, see regalloc.hh.
+    mark_nonlocal_uses(q, func->level + 1);
 
     return q;
 }
@@ -932,16 +1229,16 @@ void quadruple::print(ostream &o)
 
 void quad_list::print(ostream &o)
 {
-    quad_list_element *e;
+    int e;
 
     o << short_symbols;
 
     quad_nr = 1;
     e = head;
-    while (e != NULL)
+    while (e != -1)
     {
-        o << setw(5) << quad_nr << e->data << endl;
-        e = e->next;
+        o << setw(5) << quad_nr << &elements[e].data << endl;
+        e = elements[e].next;
         quad_nr++;
     }
 
@@ -66,6 +66,8 @@ class quad_list_element;
 class quad_list_iterator;
 class quad_list;
 
+extern int short_circuit;   // Defined in main.cc.
+
 
 
 /* The quadruple class. A quadruple is a pseudo-assembler op-code with three
@@ -92,31 +94,50 @@ public:
     quadruple(quad_op_type, int, sym_index, sym_index);
     quadruple(quad_op_type, sym_index, int, sym_index);
 
+    // Fill in the symbols this quad reads and return how many there are
+    // (at most 3). Note that the fields a quad doesn't use are left
+    // uninitialized, so the op_code decides which ones to look at. A
+    // q_param's argument is really only read at the matching q_call.
+    int       get_uses(sym_index *);
+
+    // Return the symbol this quad writes, or NULL_SYM if none.
+    sym_index get_def();
+
     friend ostream& operator<<(ostream &, quadruple *);
 };
 
 
 /* This class is simply an abstraction to prevent quads from having to
    contain a link to the next quad, which is a representation issue having
-   nothing to do with the program it represents. */
+   nothing to do with the program it represents. The elements of a list live
+   in one array, and the links are indexes into it, so a quad keeps its index
+   for as long as it is on the list no matter what is inserted or removed
+   around it. */
 class quad_list_element {
 public:
-    quadruple         *data;
-    quad_list_element *next;
-
-    quad_list_element(quadruple *, quad_list_element *);
+    quadruple data;
+    int       prev;                    // Index of the previous quad, or -1.
+    int       next;                    // Index of the next quad, or -1.
 };
 
 
 
-/* This class lets us iterate over a quad_list in a convenient fashion. */
+/* This class lets us iterate over a quad_list in a convenient fashion. It is
+   safe to remove() the current quad while iterating. */
 class quad_list_iterator {
-    quad_list_element     *current;
+    quad_list             *list;
+    int                   current;
 
 public:
     quad_list_iterator(quad_list *q_list);
+
+    void *operator new(size_t size) { return block_arena->allocate(size); }
+    void operator delete(void *) {}
+
     quadruple *get_current();          // Return the current quad if any.
     quadruple *get_next();             // Return the next quad if any.
+    quadruple *peek_next();            // The same, without moving on.
+    int       get_index();             // Index of the current quad, or -1.
 };
 
 
@@ -124,22 +145,54 @@ public:
 /* A list of quads. This list will eventually contain the entire program in
    quad operations. Or at least entire blocks at a time. Had we represented
    the entire program as an AST, the list would have contained the whole
-   program, but since we don't, it doesn't. :-) */
+   program, but since we don't, it doesn't. :-)
+
+   The quads are stored by value in an array that doubles when it fills up,
+   so walking a list that hasn't been edited reads memory in order. Appending,
+   inserting after a quad and removing a quad are all O(1). Since the array
+   may move, a quadruple pointer is only good until the next quad is added;
+   hang on to the index instead. */
 class quad_list {
 private:
-    quad_list_element *head;           // Pointer to the first list element.
-    quad_list_element *tail;           // Pointer to the rest of the elements.
+    quad_list_element *elements;       // All the quads ever added.
+    int               capacity;        // Size of the elements array.
+    int               used;            // Number of slots used in it.
+    int               head;            // Index of the first quad, or -1.
+    int               tail;            // Index of the last quad, or -1.
+    int               nr_quads;        // Number of quads on the list.
 
     int               quad_nr;         // Used to get nice printouts.
     
     void              print(ostream&); // Used to get nice printouts.
+    int               new_element(const quadruple &);
 
 public:
     int              last_label;       // Label marking the end of a quad list.
+    int              first_temp;       // Offset of the block's first
+                                       //   temporary, see share_temp_slots().
 
     quad_list(int);                    // Constructor. Arg == last_label.
 
-    quad_list& operator+=(quadruple *q); // Add on a new quad last on the list.
+    void *operator new(size_t size) { return block_arena->allocate(size); }
+    void operator delete(void *) {}
+
+    quad_list& operator+=(const quadruple &q); // Add on a new quad last on
+                                               //   the list.
+
+    int        insert_after(int, const quadruple &); // Insert a quad after the
+                                               //   one at an index (or first
+                                               //   if it is -1). Returns the
+                                               //   new quad's index.
+    void       remove(int);                    // Unlink the quad at an index.
+    quadruple *get_quad(int);                  // The quad at an index.
+    int        size() { return nr_quads; }     // Number of quads on the list.
+    void       compact();                      // Put the quads back in list
+                                               //   order in the array.
+    void       share_temp_slots(sym_index);    // Pack the temporaries of the
+                                               //   block, see quads.cc.
+    bool       is_tail_call(int);              // Is the q_call at an index
+                                               //   the last thing the
+                                               //   block does?
 
     friend class quad_list_iterator;   // Allow the iterator access to private
                                        // data fields in this class.
@@ -148,6 +201,8 @@ public:
     sym_index do_binaryop(quad_list &q, ast_binaryoperation *node, quad_op_type q_operation, sym_index type);
     sym_index do_binaryrel(quad_list &q, ast_binaryrelation *node, quad_op_type q_operation, sym_index type);
     void start_generate_elsif_list(ast_elsif_list *elsif_list, int label);
+    void do_condition(ast_expression *condition, int label);
+    void do_jump(ast_expression *condition, int value, int label);
 };
     
     
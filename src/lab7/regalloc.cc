@@ -0,0 +1,431 @@
+#include <algorithm>
+#include "regalloc.hh"
+
+using namespace std;
+
+
+/* A basic block of quads, used by the liveness analysis below. Positions
+   are indexes into the quad vector. */
+class ra_block {
+public:
+    int          first;
+    int          last;
+    vector<int>  succ;
+    vector<bool> use;        // Read before written in the block.
+    vector<bool> def;        // Written in the block.
+    vector<bool> live_in;
+    vector<bool> live_out;
+};
+
+
+/* Returns true for the quads whose operands are handled as reals by the
+   backends. */
+static bool is_real_op(quad_op_type op)
+{
+    switch (op)
+    {
+    case q_rplus:
+    case q_rminus:
+    case q_rmult:
+    case q_rdivide:
+    case q_ruminus:
+    case q_req:
+    case q_rne:
+    case q_rlt:
+    case q_rgt:
+    case q_itor:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+/* Marks the variables, parameters and arrays of enclosing blocks that a
+   block uses, see regalloc.hh. */
+void mark_nonlocal_uses(quad_list *q_list, block_level level)
+{
+    sym_index ops[4];
+    int       n, j;
+
+    quad_list_iterator *ql_iterator = new quad_list_iterator(q_list);
+    for (quadruple *q = ql_iterator->get_current(); q != NULL;
+         q = ql_iterator->get_next())
+    {
+        n = q->get_uses(ops);
+        ops[n++] = q->get_def();
+        for (j = 0; j < n; j++)
+        {
+            if (ops[j] == NULL_SYM)
+                continue;
+            symbol *sym = sym_tab->get_symbol(ops[j]);
+            if ((sym->tag == SYM_VAR || sym->tag == SYM_PARAM ||
+                 sym->tag == SYM_ARRAY) && sym->level < level)
+                sym->nonlocal_use = true;
+        }
+    }
+    delete ql_iterator;
+}
+
+
+
+/* Comparison used to sort the intervals by increasing start point. */
+static bool by_start(const live_interval &a, const live_interval &b)
+{
+    if (a.start != b.start)
+        return a.start < b.start;
+    return a.sym < b.sym;
+}
+
+
+
+/* This method computes a live interval for every candidate symbol of a block
+   (see regalloc.hh), or for every symbol in only if that isn't NULL. The
+   intervals are found by an ordinary iterative liveness analysis over the
+   basic blocks of the quad list; each interval then covers every quad where
+   the symbol is mentioned or live. */
+void register_allocator::find_intervals(quad_list *q_list, block_level level,
+                                        vector<live_interval> &intervals,
+                                        const set<sym_index> *only)
+{
+    vector<quadruple *> quads;
+    map<sym_index, int> cand;          // Candidate -> interval index.
+    set<sym_index>      rejected;
+    sym_index           ops[4];
+    int                 n, i, j;
+
+    quad_list_iterator *ql_iterator = new quad_list_iterator(q_list);
+    for (quadruple *q = ql_iterator->get_current(); q != NULL;
+         q = ql_iterator->get_next())
+        quads.push_back(q);
+    delete ql_iterator;
+
+    // Find the candidates. Outer blocks' symbols were marked when the quads
+    // were generated, see mark_nonlocal_uses().
+    for (i = 0; i < (int)quads.size(); i++)
+    {
+        quadruple *q = quads[i];
+        n = q->get_uses(ops);
+        ops[n++] = q->get_def();
+        bool real = is_real_op(q->op_code);
+        // The result of a real relation is an ordinary integer though.
+        bool real_def = real && q->op_code != q_req && q->op_code != q_rne &&
+            q->op_code != q_rlt && q->op_code != q_rgt;
+
+        for (j = 0; j < n; j++)
+        {
+            if (ops[j] == NULL_SYM)
+                continue;
+            if (only != NULL && only->find(ops[j]) == only->end())
+                continue;
+            symbol *sym = sym_tab->get_symbol(ops[j]);
+            if (sym->tag != SYM_VAR && sym->tag != SYM_PARAM &&
+                sym->tag != SYM_ARRAY)
+                continue;
+            if (sym->level < level)
+                continue;
+            if (only == NULL &&
+                (sym->tag == SYM_ARRAY || (real && j < n - 1) ||
+                 (real_def && j == n - 1) || sym->nonlocal_use))
+            {
+                rejected.insert(ops[j]);
+                continue;
+            }
+            if (cand.find(ops[j]) == cand.end())
+            {
+                live_interval iv;
+                iv.sym = ops[j];
+                iv.start = i;
+                iv.end = i;
+                iv.reg = NO_REGISTER;
+                cand[ops[j]] = intervals.size();
+                intervals.push_back(iv);
+            }
+        }
+    }
+
+    // A symbol that was rejected somewhere is dropped altogether.
+    for (set<sym_index>::iterator it = rejected.begin();
+         it != rejected.end(); it++)
+        cand.erase(*it);
+
+    int nr_cand = intervals.size();
+
+    // Work out which candidates each quad reads and writes. Arguments are
+    // fetched when the q_call is expanded, not at the q_param.
+    vector<vector<int> > uses(quads.size());
+    vector<int>          defs(quads.size(), -1);
+    vector<sym_index>    pending;
+
+    for (i = 0; i < (int)quads.size(); i++)
+    {
+        quadruple *q = quads[i];
+        map<sym_index, int>::iterator c;
+
+        if (q->op_code == q_param)
+        {
+            pending.push_back(q->sym1);
+        }
+        else if (q->op_code == q_call)
+        {
+            for (j = 0; j < q->int2 && !pending.empty(); j++)
+            {
+                c = cand.find(pending.back());
+                if (c != cand.end())
+                    uses[i].push_back(c->second);
+                pending.pop_back();
+            }
+        }
+        else
+        {
+            n = q->get_uses(ops);
+            for (j = 0; j < n; j++)
+            {
+                c = cand.find(ops[j]);
+                if (c != cand.end())
+                    uses[i].push_back(c->second);
+            }
+        }
+
+        c = cand.find(q->get_def());
+        if (c != cand.end())
+            defs[i] = c->second;
+    }
+
+    // Split the quads into basic blocks.
+    vector<ra_block> blocks;
+    map<long, int>   label_block;
+
+    for (i = 0; i < (int)quads.size(); i++)
+    {
+        quad_op_type prev = i > 0 ? quads[i - 1]->op_code : q_labl;
+        if (i == 0 || quads[i]->op_code == q_labl ||
+            prev == q_jmp || prev == q_jmpf ||
+            prev == q_ireturn || prev == q_rreturn)
+        {
+            ra_block b;
+            b.first = i;
+            b.last = i;
+            blocks.push_back(b);
+        }
+        blocks.back().last = i;
+        if (quads[i]->op_code == q_labl)
+            label_block[quads[i]->int1] = blocks.size() - 1;
+    }
+
+    for (i = 0; i < (int)blocks.size(); i++)
+    {
+        ra_block &b = blocks[i];
+        quadruple *q = quads[b.last];
+
+        if (q->op_code == q_jmp || q->op_code == q_jmpf ||
+            q->op_code == q_ireturn || q->op_code == q_rreturn)
+        {
+            map<long, int>::iterator t = label_block.find(q->int1);
+            if (t != label_block.end())
+                b.succ.push_back(t->second);
+        }
+        if (q->op_code != q_jmp && q->op_code != q_ireturn &&
+            q->op_code != q_rreturn && i + 1 < (int)blocks.size())
+            b.succ.push_back(i + 1);
+
+        b.use.assign(nr_cand, false);
+        b.def.assign(nr_cand, false);
+        b.live_in.assign(nr_cand, false);
+        b.live_out.assign(nr_cand, false);
+        for (j = b.first; j <= b.last; j++)
+        {
+            for (unsigned k = 0; k < uses[j].size(); k++)
+                if (!b.def[uses[j][k]])
+                    b.use[uses[j][k]] = true;
+            if (defs[j] >= 0)
+                b.def[defs[j]] = true;
+        }
+    }
+
+    // Iterate backwards until nothing changes.
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (i = blocks.size() - 1; i >= 0; i--)
+        {
+            ra_block &b = blocks[i];
+            for (int c = 0; c < nr_cand; c++)
+            {
+                bool out = false;
+                for (unsigned k = 0; k < b.succ.size() && !out; k++)
+                    out = blocks[b.succ[k]].live_in[c];
+                bool in = b.use[c] || (out && !b.def[c]);
+                if (out != b.live_out[c] || in != b.live_in[c])
+                {
+                    b.live_out[c] = out;
+                    b.live_in[c] = in;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // Stretch the intervals over the blocks where they are live, and over
+    // the q_call that actually reads a q_param'ed value.
+    for (i = 0; i < (int)quads.size(); i++)
+        for (unsigned k = 0; k < uses[i].size(); k++)
+            intervals[uses[i][k]].end = max(intervals[uses[i][k]].end, i);
+
+    for (i = 0; i < (int)blocks.size(); i++)
+    {
+        for (int c = 0; c < nr_cand; c++)
+        {
+            if (blocks[i].live_in[c])
+                intervals[c].start = min(intervals[c].start, blocks[i].first);
+            if (blocks[i].live_out[c])
+                intervals[c].end = max(intervals[c].end, blocks[i].last);
+        }
+    }
+
+    // Finally drop the rejected symbols, which were given intervals before
+    // we knew better.
+    vector<live_interval> result;
+    for (i = 0; i < nr_cand; i++)
+        if (cand.find(intervals[i].sym) != cand.end())
+            result.push_back(intervals[i]);
+    intervals.swap(result);
+}
+
+
+
+/* This method does the actual allocation. When we run out of registers the
+   interval that lasts the longest is left in memory, which is the usual
+   linear scan heuristic. An interval only gets a register that is free for
+   all of it, so spilled symbols simply live in their stack slots. */
+void register_allocator::allocate(quad_list *q_list, symbol *env,
+                                  int nr_registers,
+                                  map<sym_index, int> &result)
+{
+    vector<live_interval> intervals;
+    vector<int>           active;      // Indexes into intervals.
+    vector<int>           free_regs;
+    int                   i, r;
+
+    find_intervals(q_list, env->level + 1, intervals, NULL);
+    sort(intervals.begin(), intervals.end(), by_start);
+
+    for (r = nr_registers - 1; r >= 0; r--)
+        free_regs.push_back(r);
+
+    for (i = 0; i < (int)intervals.size(); i++)
+    {
+        live_interval &iv = intervals[i];
+
+        // Expire the intervals that ended before this one starts. Two
+        // symbols mentioned by the same quad never share a register.
+        for (unsigned k = 0; k < active.size(); )
+        {
+            if (intervals[active[k]].end < iv.start)
+            {
+                free_regs.push_back(intervals[active[k]].reg);
+                active.erase(active.begin() + k);
+            }
+            else
+                k++;
+        }
+
+        if (!free_regs.empty())
+        {
+            iv.reg = free_regs.back();
+            free_regs.pop_back();
+            active.push_back(i);
+            continue;
+        }
+
+        // Spill whichever lasts longest, this one or an active one.
+        int victim = -1;
+        for (unsigned k = 0; k < active.size(); k++)
+            if (victim < 0 ||
+                intervals[active[k]].end > intervals[active[victim]].end)
+                victim = k;
+
+        if (victim >= 0 && intervals[active[victim]].end > iv.end)
+        {
+            live_interval &spilled = intervals[active[victim]];
+            iv.reg = spilled.reg;
+            spilled.reg = NO_REGISTER;
+            active[victim] = i;
+        }
+    }
+
+    result.clear();
+    for (i = 0; i < (int)intervals.size(); i++)
+        result[intervals[i].sym] = intervals[i].reg;
+}
+
+
+
+/* This method lets temporaries whose live intervals don't overlap share stack
+   slots. Every temporary is 4 bytes, and they are all allocated after the
+   block's declared variables, from first_temp and up, so they can simply be
+   renumbered into as few slots as the intervals allow. Returns the new size
+   of the temporary area in bytes. */
+int register_allocator::share_temp_slots(quad_list *q_list, symbol *env,
+                                         int first_temp)
+{
+    vector<live_interval> intervals;
+    set<sym_index>        temps;
+    vector<int>           active;      // Indexes into intervals.
+    vector<int>           free_slots;
+    sym_index             ops[4];
+    int                   n, i, nr_slots = 0;
+    block_level           level = env->level + 1;
+
+    quad_list_iterator *ql_iterator = new quad_list_iterator(q_list);
+    for (quadruple *q = ql_iterator->get_current(); q != NULL;
+         q = ql_iterator->get_next())
+    {
+        n = q->get_uses(ops);
+        ops[n++] = q->get_def();
+        for (i = 0; i < n; i++)
+        {
+            if (ops[i] == NULL_SYM)
+                continue;
+            symbol *sym = sym_tab->get_symbol(ops[i]);
+            if (sym->tag == SYM_VAR && sym->level == level &&
+                sym->offset >= first_temp)
+                temps.insert(ops[i]);
+        }
+    }
+    delete ql_iterator;
+
+    find_intervals(q_list, level, intervals, &temps);
+    sort(intervals.begin(), intervals.end(), by_start);
+
+    for (i = 0; i < (int)intervals.size(); i++)
+    {
+        live_interval &iv = intervals[i];
+
+        for (unsigned k = 0; k < active.size(); )
+        {
+            if (intervals[active[k]].end < iv.start)
+            {
+                free_slots.push_back(intervals[active[k]].reg);
+                active.erase(active.begin() + k);
+            }
+            else
+                k++;
+        }
+
+        if (free_slots.empty())
+            iv.reg = nr_slots++;
+        else
+        {
+            iv.reg = free_slots.back();
+            free_slots.pop_back();
+        }
+        active.push_back(i);
+
+        sym_tab->get_symbol(iv.sym)->offset =
+            first_temp + iv.reg * sym_tab->get_size(integer_type);
+    }
+
+    return nr_slots * sym_tab->get_size(integer_type);
+}
@@ -0,0 +1,69 @@
+#ifndef __REGALLOC_HH__
+#define __REGALLOC_HH__
+
+
+#include <vector>
+#include <map>
+#include <set>
+#include "symtab.hh"
+#include "quads.hh"
+using namespace std;
+
+
+/* Marks a symbol that didn't get a register. */
+const int NO_REGISTER = -1;
+
+
+/* The range of quads during which a symbol's value may be needed. Positions
+   are quad numbers within the block, counting from 0. */
+class live_interval {
+public:
+    sym_index sym;
+    int       start;   // First quad that mentions the symbol.
+    int       end;     // Last quad that (possibly) needs its value.
+    int       reg;     // Register number, or NO_REGISTER.
+};
+
+
+/* This class decides which variables and temporaries of a block can be
+   kept in registers, using linear scan allocation over live intervals.
+   It knows nothing about the target: registers are just numbered 0..n-1,
+   and the backend maps them to real ones.
+
+   A symbol is only a candidate if it belongs to the block being allocated,
+   is an integer-sized scalar, is never handled as a real (real arithmetic
+   goes through the floating point registers and memory anyway), and is
+   never accessed from an inner block. The last is known from
+   symbol::nonlocal_use, which mark_nonlocal_uses() sets as the quads of each
+   block are generated. That happens on the parser thread, before the block
+   is handed to the backend, and an enclosing block's quads are generated
+   after those of its inner blocks, so with -J the flags are all set before
+   any backend thread, whichever allocator it has, allocates the block.
+
+   The same intervals are used to let temporaries share stack slots, see
+   share_temp_slots(). */
+class register_allocator
+{
+private:
+    void find_intervals(quad_list *, block_level,
+                        vector<live_interval> &, const set<sym_index> *);
+
+public:
+    // Fill in a register number (or NO_REGISTER) for every candidate in
+    // the block. Symbols not in the map never get a register.
+    void allocate(quad_list *, symbol *env, int nr_registers,
+                  map<sym_index, int> &);
+
+    // Renumber the stack slots of the temporaries in a block so that ones
+    // that are never live at the same time share a slot. Args: the block's
+    // quads, its symbol, and the offset of its first temporary. Returns the
+    // number of bytes the temporaries need afterwards.
+    int  share_temp_slots(quad_list *, symbol *env, int);
+};
+
+// Set symbol::nonlocal_use for the symbols of enclosing blocks that a
+// block's quads use. Args: the quads, and the level of the block's own
+// symbols.
+extern void mark_nonlocal_uses(quad_list *, block_level);
+
+#endif
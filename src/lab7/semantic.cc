@@ -1,14 +1,15 @@
 #include "semantic.hh"
 
 
-semantic *type_checker = new semantic();
+// The type checker of the compilation on this thread, see compilation.hh.
+__thread semantic *type_checker = NULL;
 
 
 /* Used to check that all functions contain return statements.
    Static means that it is only visible inside this file.
    It is set to 0 in do_typecheck() (ie, every time we start type checking
    a new block) and set to 1 if we find an ast_return node. See below. */
-static int has_return = 0;
+static __thread int has_return = 0;
 
 
 /* Interface for type checking a block of code represented as an AST node. */
@@ -69,6 +70,9 @@ int semantic::chk_param(ast_id *env,
 void semantic::check_function_parameters(ast_id *call_id,
 				ast_expr_list *param_list) {
     /* Your code here. */
+    // Calling something else has been reported already.
+    if (sym_tab->get_symbol_tag(call_id->sym_p) != SYM_FUNC)
+        return;
     function_symbol *func = sym_tab->get_symbol(call_id->sym_p)->get_function_symbol();
     parameter_symbol *formals = func->last_parameter;
     if (param_list != NULL)
@@ -82,6 +86,9 @@ void semantic::check_function_parameters(ast_id *call_id,
 void semantic::check_procedure_parameters(ast_id *call_id,
                 ast_expr_list *param_list) {
     /* Your code here. */
+    // Calling something else has been reported already.
+    if (sym_tab->get_symbol_tag(call_id->sym_p) != SYM_PROC)
+        return;
     procedure_symbol *proc = sym_tab->get_symbol(call_id->sym_p)->get_procedure_symbol();
     parameter_symbol *formals = proc->last_parameter;
     if (param_list != NULL)
@@ -164,7 +171,8 @@ sym_index ast_elsif_list::type_check() {
    here, since all nametypes are of type void, but should return an index to
    itself in the symbol table as far as typechecking is concerned. */
 sym_index ast_id::type_check() {
-    if(sym_tab->get_symbol(sym_p)->tag != SYM_NAMETYPE)
+    // An undeclared id has been reported already, and has type void.
+    if(sym_p == NULL_SYM || sym_tab->get_symbol(sym_p)->tag != SYM_NAMETYPE)
 	return type;
     return sym_p;
 }
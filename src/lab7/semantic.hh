@@ -3,7 +3,7 @@
 class semantic;
 
 
-extern semantic *type_checker; // Defined in semantic.cc.
+extern __thread semantic *type_checker; // Defined in semantic.cc.
 
 
 class semantic {
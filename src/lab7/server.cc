@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <iostream>
+#include <fstream>
+#include "server.hh"
+
+/*** This file contains the compile server and its client. See server.hh
+     for the protocol. ***/
+
+
+/* Fill in the address of the socket. Returns false if the name is too long
+   for it. */
+static bool socket_address(const char *socket_name, sockaddr_un *address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_name) >= sizeof(address->sun_path))
+    {
+        cerr << socket_name << ": socket name too long" << endl;
+        return false;
+    }
+    strcpy(address->sun_path, socket_name);
+    return true;
+}
+
+
+
+/* Write all of it, or return false. */
+static bool write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+
+
+/* Read exactly size bytes, or return false. */
+static bool read_all(int fd, char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = read(fd, data, size);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+
+
+/* Send some text as records of the given type. Nothing is sent for empty
+   text. */
+static bool send_records(int fd, char type, const string &text)
+{
+    for (size_t start = 0; start < text.size(); start += MAX_REPLY_RECORD)
+    {
+        size_t        length = text.size() - start;
+        unsigned char header[5];
+
+        if (length > MAX_REPLY_RECORD)
+            length = MAX_REPLY_RECORD;
+        header[0] = type;
+        header[1] = length >> 24;
+        header[2] = length >> 16;
+        header[3] = length >> 8;
+        header[4] = length;
+        if (!write_all(fd, (char *)header, sizeof(header)) ||
+            !write_all(fd, text.data() + start, length))
+            return false;
+    }
+    return true;
+}
+
+
+
+/* Read a request: null terminated strings up to an empty one. The first
+   one is the client's directory. Returns false if the client went away
+   first, or if it took too long or sent too much, which problem then
+   says. */
+static bool read_request(int fd, string *directory, vector<string> *args,
+                         string *problem)
+{
+    string text;
+    char   buffer[4096];
+
+    for (;;)
+    {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            *problem = "the compile server timed out reading the request\n";
+        if (n <= 0)
+            return false;
+        text.append(buffer, n);
+        if (text.size() > MAX_REQUEST_SIZE)
+        {
+            *problem = "the request is too long for the compile server\n";
+            return false;
+        }
+
+        // Look for the empty string at the end.
+        vector<string> strings;
+        size_t         start = 0, end;
+        while ((end = text.find('\0', start)) != string::npos)
+        {
+            if (end == start)
+            {
+                if (strings.empty())
+                    return false;
+                *directory = strings[0];
+                args->assign(strings.begin() + 1, strings.end());
+                return true;
+            }
+            strings.push_back(text.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+}
+
+
+
+/* Serve one client. A client that stops sending or reading is given up
+   after CLIENT_TIMEOUT, so it can't hold up the others. */
+static void serve(int fd, request_handler handler)
+{
+    compile_request request;
+    string          directory;
+    string          problem;
+    timeval         timeout;
+
+    timeout.tv_sec = CLIENT_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    request.status = 0;
+    if (!read_request(fd, &directory, &request.args, &problem))
+    {
+        if (!problem.empty() &&
+            send_records(fd, REPLY_DIAGNOSTICS, problem))
+            send_records(fd, REPLY_STATUS, "1");
+        return;
+    }
+
+    if (chdir(directory.c_str()) != 0)
+    {
+        request.diagnostics = directory + ": " + strerror(errno) + "\n";
+        request.status = 1;
+    }
+    else
+        handler(request);
+
+    char status[16];
+    snprintf(status, sizeof(status), "%d", request.status);
+
+    if (!send_records(fd, REPLY_MESSAGES, request.messages) ||
+        !send_records(fd, REPLY_DIAGNOSTICS, request.diagnostics))
+        return;
+    if (!request.output.empty())
+    {
+        if (!send_records(fd, REPLY_OUTPUT, request.output) ||
+            !send_records(fd, REPLY_CODE, request.code))
+            return;
+    }
+    send_records(fd, REPLY_STATUS, status);
+}
+
+
+
+/* Whether a server answers on the socket. */
+static bool socket_in_use(sockaddr_un *address)
+{
+    int  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool answered;
+
+    if (fd < 0)
+        return false;
+    answered = connect(fd, (sockaddr *)address, sizeof(*address)) == 0;
+    close(fd);
+    return answered;
+}
+
+
+
+/* Run the compile server, see server.hh. Only returns if the socket can't
+   be set up. */
+int run_server(const char *socket_name, request_handler handler)
+{
+    sockaddr_un address;
+    int         listener;
+    struct stat status;
+    mode_t      saved_mask;
+
+    if (!socket_address(socket_name, &address))
+        return 1;
+
+    // A client that goes away is no reason to stop.
+    signal(SIGPIPE, SIG_IGN);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        perror("socket");
+        return 1;
+    }
+
+    // A socket left behind by a server that is gone is replaced, but not
+    // one that is in use, or a file that isn't a socket.
+    if (lstat(socket_name, &status) == 0)
+    {
+        if (!S_ISSOCK(status.st_mode))
+        {
+            cerr << socket_name << ": not a socket" << endl;
+            return 1;
+        }
+        if (socket_in_use(&address))
+        {
+            cerr << socket_name << ": another compile server is running"
+                 << endl;
+            return 1;
+        }
+        unlink(socket_name);
+    }
+
+    // The socket is created with no permissions for anyone else, so that
+    // nobody else can have files compiled as us.
+    saved_mask = umask(077);
+    if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0)
+    {
+        perror(socket_name);
+        umask(saved_mask);
+        return 1;
+    }
+    umask(saved_mask);
+    if (listen(listener, SOMAXCONN) != 0)
+    {
+        perror(socket_name);
+        return 1;
+    }
+    cout << "Serving compile requests on " << socket_name << ".\n" << flush;
+
+    for (;;)
+    {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("accept");
+            return 1;
+        }
+        serve(fd, handler);
+        close(fd);
+    }
+}
+
+
+
+/* Have the server compile what the command line says, see server.hh.
+   Returns the exit status. */
+int run_client(const char *socket_name, int argc, char **argv)
+{
+    sockaddr_un address;
+    char        directory[PATH_MAX];
+    string      request;
+    int         fd;
+    int         status = -1;
+    ofstream    output;
+
+    if (!socket_address(socket_name, &address))
+        return 1;
+    if (getcwd(directory, sizeof(directory)) == NULL)
+    {
+        perror("getcwd");
+        return 1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr *)&address, sizeof(address)) != 0)
+    {
+        perror(socket_name);
+        return 1;
+    }
+
+    request.append(directory, strlen(directory) + 1);
+    for (int i = 0; i < argc; i++)
+        request.append(argv[i], strlen(argv[i]) + 1);
+    request += '\0';
+    if (!write_all(fd, request.data(), request.size()))
+    {
+        perror(socket_name);
+        close(fd);
+        return 1;
+    }
+
+    // The records, until the status.
+    while (status < 0)
+    {
+        unsigned char header[5];
+        if (!read_all(fd, (char *)header, sizeof(header)))
+            break;
+
+        size_t length = (header[1] << 24) | (header[2] << 16) |
+            (header[3] << 8) | header[4];
+        string text(length, '\0');
+        if (length > 0 && !read_all(fd, &text[0], length))
+            break;
+
+        switch (header[0])
+        {
+        case REPLY_MESSAGES:
+            cout << text << flush;
+            break;
+        case REPLY_DIAGNOSTICS:
+            cerr << text << flush;
+            break;
+        case REPLY_OUTPUT:
+            output.open(text.c_str());
+            if (!output)
+                perror(text.c_str());
+            break;
+        case REPLY_CODE:
+            output.write(text.data(), text.size());
+            break;
+        case REPLY_STATUS:
+            status = atoi(text.c_str());
+            break;
+        }
+    }
+    close(fd);
+
+    if (status < 0)
+    {
+        cerr << socket_name << ": the compile server gave no reply" << endl;
+        return 1;
+    }
+    return status;
+}
@@ -0,0 +1,66 @@
+#ifndef __SERVER_HH__
+#define __SERVER_HH__
+
+
+#include <string>
+#include <vector>
+using namespace std;
+
+
+/* The records of a reply, see below. */
+const char REPLY_MESSAGES = 'o';        // What the compiler prints on stdout,
+const char REPLY_DIAGNOSTICS = 'e';     //   and on stderr.
+const char REPLY_OUTPUT = 'f';          // The name of the assembler file,
+const char REPLY_CODE = 'a';            //   and what is to be written to it.
+const char REPLY_STATUS = 'x';          // The exit status. Always the last.
+
+// Text is sent in records of at most this many bytes.
+const unsigned MAX_REPLY_RECORD = 65536;
+
+// A request may be at most this many bytes, and the server waits at most
+// this many seconds for the client to send or read anything.
+const unsigned MAX_REQUEST_SIZE = 65536;
+const int      CLIENT_TIMEOUT = 10;
+
+
+/* A compile request, and the reply to it. */
+class compile_request {
+public:
+    vector<string> args;                // The command line, without the
+                                        //   program name.
+    string         messages;            // See above.
+    string         diagnostics;
+    string         output;              // Empty if no file is to be
+    string         code;                //   written.
+    int            status;
+};
+
+// What the server does with a request. Given by main.cc.
+typedef void (*request_handler)(compile_request &);
+
+
+/* The compile server, -S. It saves a build that compiles many files the
+   start up of a process for each of them, and the symbol table constructor,
+   see compilation::snapshot_symbols(); also include files are only compiled
+   once, see units.hh.
+
+   The server listens on a Unix domain socket. A client connects, sends the
+   directory it is in and the options and file to compile, as it would give
+   them on the command line, each null terminated, and an empty string at the
+   end. The server compiles the file in the client's directory and replies
+   with a series of records, each a record type from above, the length of
+   the text as four bytes, most significant first, and the text, and closes
+   the connection. The server doesn't write the assembler file itself; the
+   client does. Requests are served one at a time, since the options are
+   globals. A fatal error only fails the request it happened in, see
+   fatal_error in error.hh.
+
+   Only the user who started the server can connect to the socket. If
+   another server answers on it, the server refuses to start.
+
+   run_client() is the client, -C, which does everything the compiler would
+   have done with the same command line. */
+extern int run_server(const char *socket_name, request_handler);
+extern int run_client(const char *socket_name, int argc, char **argv);
+
+#endif
@@ -10,6 +10,7 @@ symbol::symbol(pool_index pool_p) {
     id = pool_p;
     tag = SYM_UNDEF;      // All symbols are tagged as SYM_UNDEF at creation.
                           // This is used later to check for redeclarations.
+    nonlocal_use = false;
 }
 
 
@@ -52,6 +53,7 @@ parameter_symbol::parameter_symbol(const pool_index pool_p) :
 {
     size = 0;
     preceding = NULL;
+    self = NULL_SYM;
 }
 
 
@@ -88,7 +90,7 @@ nametype_symbol::nametype_symbol(const pool_index pool_p) :
 
 // This is the default detail level of information given when printing a
 // symbol.
-symbol::format_type symbol::output_format = symbol::LONG_FORMAT;
+__thread symbol::format_type symbol::output_format = symbol::LONG_FORMAT;
 
 
 /* Prints information common to all symbols. The various subclasses add on
@@ -97,7 +99,7 @@ void symbol::print(ostream& o) {
     switch(output_format) {
 	case LONG_FORMAT:
 	    o << "symbol:" << endl;
-	    o << "  id:        " << sym_tab->pool_lookup(id) << endl;
+	    o << "  id:        " << sym_tab->pool_view(id) << endl;
 	    o << "  type:      " << short_symbols 
 	      << sym_tab->get_symbol(type) << long_symbols << endl;
 	    o << "  level:     " << level << endl;
@@ -160,10 +162,10 @@ void symbol::print(ostream& o) {
 		    o << "(SYM_NAMETYPE) ";
 		    break;
 	    }
-	    o << sym_tab->pool_lookup(id);
+	    o << sym_tab->pool_view(id);
 	    break;
 	case SHORT_FORMAT:
-	    o << sym_tab->pool_lookup(id);
+	    o << sym_tab->pool_view(id);
 	    break;
 	default:
 	    fatal("Bad output format in symbol::print()");
@@ -258,11 +260,11 @@ void parameter_symbol::print(ostream& o) {
 	    if(preceding == NULL)
 		o << "  preceding: NULL" << endl;
 	    else
-		o << "  preceding: " << sym_tab->pool_lookup(preceding->id)
+		o << "  preceding: " << sym_tab->pool_view(preceding->id)
 		  << endl;
 	    break;
 	case SUMMARY_FORMAT:
-	    o << " <-- " << sym_tab->pool_lookup(preceding->id);
+	    o << " <-- " << sym_tab->pool_view(preceding->id);
 	    break;
 	case SHORT_FORMAT:
 	    break;
@@ -7,17 +7,19 @@
 #include <cstdio>
 #include <ctype.h>
 #include <string.h>
+#include <map>
 #include "symtab.hh"
 
 using namespace std;
 
 /*** Global variables ***/
 
-symbol_table *sym_tab = new symbol_table(); // The symbol table itself.
+// The symbol table of the compilation on this thread, see compilation.hh.
+__thread symbol_table *sym_tab = NULL;
 // The symbeltable is a table of pointers to symbol (which can be of various types)
-sym_index     void_type;
-sym_index     integer_type;
-sym_index     real_type;
+__thread sym_index void_type;
+__thread sym_index integer_type;
+__thread sym_index real_type;
 
 
 
@@ -26,7 +28,8 @@ sym_index     real_type;
 /* Constructor: allocates the data members. The symbol table itself is just
    a table of pointers to symbols. This is due to the various subclasses of
    symbols used. */
-symbol_table::symbol_table()
+symbol_table::symbol_table() :
+    symbols()
 {
     int i; // counter, later used when initialising hash_table, block_table,
     // sym_table. See below.
@@ -48,17 +51,33 @@ symbol_table::symbol_table()
        Take a look at figure 2 in the laboratory
        assignement.*/
 
+    pthread_mutex_init(&lock, NULL);
+
     pool_pos = 0; // Always points to the last position in the string pool
-    pool_length = BASE_POOL_SIZE; // set base size of string pool. Can be
-    // extended later on, if there are many symbols to scan.
 
-    // create a string with length of pool_length
-    string_pool = new char[pool_length];
-    string_pool[0] = '\0'; // insert the null char in the end
+    // Only the first chunk is allocated to begin with, the others are added
+    // by pool_intern() as they are needed.
+    string_pool = new char*[MAX_POOL_CHUNKS];
+    for (i = 0; i < MAX_POOL_CHUNKS; i++)
+        string_pool[i] = NULL;
+    string_pool[0] = new char[POOL_CHUNK_SIZE];
+    string_pool[0][0] = '\0'; // insert the null char in the end
+
+    // The intern table maps each string in the pool to its index, so that
+    // installing a string that's already there doesn't add it again.
+    intern_size = BASE_INTERN_SIZE;
+    intern_entries = 0;
+    intern_table = new pool_index[intern_size];
+    for (i = 0; i < intern_size; i++)
+        intern_table[i] = -1;
 
     // --- Initialize hash table. ---
-    hash_table = new sym_index[MAX_HASH];    // Allocate space.
-    for (i = 0; i < MAX_HASH; i++)           // Zero the table.
+    hash_size = BASE_HASH_SIZE;              // Grows with the number of
+    hash_entries = 0;                        //   symbols, see rehash().
+    for (hash_bits = 0; (1L << hash_bits) < hash_size; hash_bits++)
+        ;
+    hash_table = new sym_index[hash_size];   // Allocate space.
+    for (i = 0; i < hash_size; i++)          // Zero the table.
     {
         hash_table[i] = NULL_SYM;
     }
@@ -74,11 +93,8 @@ symbol_table::symbol_table()
     }
 
     // --- Initialize symbol table. ---
-    sym_table = new symbol*[MAX_SYM];            // Weird syntax, gives us a
-    //   table of pointers to
-    //   symbols.
-    for (i = 0; i < MAX_SYM; i++)                // Zero the table.
-        sym_table[i] = NULL;
+    // The symbol_array constructor has zeroed sym_table, and
+    // create_symbol() allocates its chunks.
 
     label_nr = -1;                               // Zero the assembler label
     // counter.
@@ -86,6 +102,9 @@ symbol_table::symbol_table()
     // sym_pos will point to the last entry in symbol table
     sym_pos = -1;                                // Zero the current symbol
     // position.
+    last_installed = NULL_SYM;
+    last_predefined = NULL_SYM;
+    first_label = 0;
 
     // --- Install predefined symbols. ---
     // If the scanner works the TEST_SCANNER must be set to 0.
@@ -97,8 +116,6 @@ symbol_table::symbol_table()
 
     // This "empty" symbol represents the global level.
     enter_procedure(dummy_pos, pool_install(capitalize("global.")));
-    sym_table[0]->type = void_type; // Needed since there have been no types
-    // installed yet.
 
     // Install the default nametypes. This is the only place enter_nametype()
     // is used, since currently Diesel's grammar doesn't handle used-defined
@@ -106,6 +123,8 @@ symbol_table::symbol_table()
 
     void_type = enter_nametype(dummy_pos, pool_install(capitalize("void")));
     sym_table[void_type]->type = void_type; // Needed since it's the first one.
+    sym_table[0]->type = void_type; // Needed since there were no types
+    // installed before it.
 
     integer_type = enter_nametype(dummy_pos, pool_install(capitalize("integer")));
 
@@ -150,8 +169,176 @@ symbol_table::symbol_table()
     par->offset = 0;
     func->last_parameter = par; // ...which is now real-arg only.
 
+    // Add the writeint(int-value) and writereal(real-value) procedures,
+    // which print a whole number at once. They are used by stdio.d, and
+    // are at labels 3 and 4 in diesel_glue.s. Their parameters need the
+    // same workaround as real-arg.
+    tmp = enter_procedure(dummy_pos, pool_install(capitalize("writeint")));
+    tmp2 = enter_parameter(dummy_pos,
+                           pool_install(capitalize("int-value")),
+                           integer_type);
+    proc = sym_table[tmp]->get_procedure_symbol();
+    par = sym_table[tmp2]->get_parameter_symbol();
+    par->preceding = NULL;
+    par->offset = 0;
+    proc->last_parameter = par;
+
+    tmp = enter_procedure(dummy_pos, pool_install(capitalize("writereal")));
+    tmp2 = enter_parameter(dummy_pos,
+                           pool_install(capitalize("real-value")),
+                           real_type);
+    proc = sym_table[tmp]->get_procedure_symbol();
+    par = sym_table[tmp2]->get_parameter_symbol();
+    par->preceding = NULL;
+    par->offset = 0;
+    proc->last_parameter = par;
+
     proc = sym_table[0]->get_procedure_symbol();
     proc->last_parameter = NULL;
+
+    // The glue files hard code the labels of the procedures above, and call
+    // the main program, which gets the next label, see MAIN_PROGRAM_LABEL.
+    // Whoever adds a predefined procedure must add it to both glue files.
+    if (label_nr != MAIN_PROGRAM_LABEL)
+        fatal("symbol_table: predefined procedures don't match the glue code");
+
+    last_predefined = sym_pos;
+    first_label = label_nr;
+}
+
+
+
+/* Copy constructor. Makes a table that is the same as the given one, in a
+   fraction of the time the constructor takes to install the predefined
+   symbols, see compilation::snapshot_symbols(). The symbols are copied into
+   our own arena, so the copy can be changed, and deleted, on its own. */
+symbol_table::symbol_table(const symbol_table &pristine) :
+    symbols()
+{
+    map<symbol *, symbol *> copies;             // Old symbol -> ours.
+    long i;
+
+    pthread_mutex_init(&lock, NULL);
+
+    // --- Copy string pool. --- Only up to pool_pos, which is all that
+    // has been used of its last chunk.
+    pool_pos = pristine.pool_pos;
+    string_pool = new char*[MAX_POOL_CHUNKS];
+    for (i = 0; i < MAX_POOL_CHUNKS; i++)
+        string_pool[i] = NULL;
+    for (i = 0; i <= pool_pos / POOL_CHUNK_SIZE; i++)
+    {
+        long used = POOL_CHUNK_SIZE;
+
+        if (i == pool_pos / POOL_CHUNK_SIZE)
+            used = pool_pos % POOL_CHUNK_SIZE + 1;
+        string_pool[i] = new char[POOL_CHUNK_SIZE];
+        memcpy(string_pool[i], pristine.string_pool[i], used);
+    }
+
+    intern_size = pristine.intern_size;
+    intern_entries = pristine.intern_entries;
+    intern_table = new pool_index[intern_size];
+    memcpy(intern_table, pristine.intern_table,
+           intern_size * sizeof(pool_index));
+
+    // --- Copy hash table and display. ---
+    hash_size = pristine.hash_size;
+    hash_bits = pristine.hash_bits;
+    hash_entries = pristine.hash_entries;
+    hash_table = new sym_index[hash_size];
+    memcpy(hash_table, pristine.hash_table, hash_size * sizeof(sym_index));
+
+    current_level = pristine.current_level;
+    block_table = new sym_index[MAX_BLOCK];
+    memcpy(block_table, pristine.block_table, MAX_BLOCK * sizeof(sym_index));
+
+    // --- Copy symbol table. ---
+    label_nr = pristine.label_nr;
+    temp_nr = pristine.temp_nr;
+    sym_pos = pristine.sym_pos;
+    last_installed = pristine.last_installed;
+    last_predefined = pristine.last_predefined;
+    first_label = pristine.first_label;
+
+    for (i = 0; i <= sym_pos; i++)
+    {
+        symbol *old = pristine.sym_table[i];
+        symbol *sym = NULL;
+
+        sym_table.reserve(i);
+        switch (old->tag)
+        {
+        case SYM_ARRAY:
+            sym = new (symbols) array_symbol(*old->get_array_symbol());
+            break;
+        case SYM_CONST:
+            sym = new (symbols) constant_symbol(*old->get_constant_symbol());
+            break;
+        case SYM_FUNC:
+            sym = new (symbols) function_symbol(*old->get_function_symbol());
+            break;
+        case SYM_PROC:
+            sym = new (symbols) procedure_symbol(*old->get_procedure_symbol());
+            break;
+        case SYM_VAR:
+            sym = new (symbols) variable_symbol(*old->get_variable_symbol());
+            break;
+        case SYM_PARAM:
+            sym = new (symbols) parameter_symbol(*old->get_parameter_symbol());
+            break;
+        case SYM_NAMETYPE:
+            sym = new (symbols) nametype_symbol(*old->get_nametype_symbol());
+            break;
+        case SYM_UNDEF:
+            fatal("symbol_table: can't copy an undefined symbol");
+        }
+        sym_table[i] = sym;
+        copies[old] = sym;
+    }
+
+    // The parameter lists are linked with pointers, which must point at
+    // our copies.
+    for (i = 0; i <= sym_pos; i++)
+    {
+        symbol *sym = sym_table[i];
+
+        if (sym->tag == SYM_PARAM && sym->get_parameter_symbol()->preceding)
+            sym->get_parameter_symbol()->preceding =
+                copies[sym->get_parameter_symbol()->preceding]
+                ->get_parameter_symbol();
+        else if (sym->tag == SYM_FUNC &&
+                 sym->get_function_symbol()->last_parameter)
+            sym->get_function_symbol()->last_parameter =
+                copies[sym->get_function_symbol()->last_parameter]
+                ->get_parameter_symbol();
+        else if (sym->tag == SYM_PROC &&
+                 sym->get_procedure_symbol()->last_parameter)
+            sym->get_procedure_symbol()->last_parameter =
+                copies[sym->get_procedure_symbol()->last_parameter]
+                ->get_parameter_symbol();
+    }
+
+    // The types are set on this thread, as by the constructor.
+    void_type = sym_table[0]->type;
+    integer_type = lookup_symbol(pool_install("INTEGER"));
+    real_type = lookup_symbol(pool_install("REAL"));
+}
+
+
+
+/* Destructor. A process may compile many files, see compilation.hh, so
+   everything is given back. The symbols themselves go with their arena. */
+symbol_table::~symbol_table()
+{
+    for (long i = 0; i < MAX_POOL_CHUNKS; i++)
+        delete[] string_pool[i];
+    delete[] string_pool;
+    delete[] intern_table;
+    delete[] hash_table;
+    delete[] block_table;
+    symbols.release_all();
+    pthread_mutex_destroy(&lock);
 }
 
 
@@ -176,6 +363,8 @@ int symbol_table::ieee(float f)
 /* This function generates assembler label numbers. */
 long symbol_table::get_next_label()
 {
+    mutex_lock hold(&lock);
+
     // Labels start on -1 (which is the global level, meaning that all labels
     // generated for user-defined functions etc start with 0).
     return label_nr++;
@@ -185,10 +374,20 @@ long symbol_table::get_next_label()
 /* Generate a unique temporary variable name. We do it without any extra fuss:
    $1, $2, $3, $4 ... up to 1 million. Diesel isn't written to handle that
    large programs anyway. The type should never be void_type; if it is, it's
-   an error. This method is used for quad generation. */
+   an error. This method is used for quad generation, and the temporary
+   belongs to the block being compiled. */
 sym_index symbol_table::gen_temp_var(sym_index type)
 {
-    // Your code here.
+    return gen_temp_var(type, current_environment());
+}
+
+
+/* Generate a temporary variable in the block env_p, which need not be the
+   current one. Nothing looks a temporary up by name, so unlike the other
+   symbols it isn't linked into hash_table, which only the parser uses. */
+sym_index symbol_table::gen_temp_var(sym_index type, sym_index env_p)
+{
+    mutex_lock hold(&lock);
     char tmp[10] = {0};
     tmp[0] = '$';
     
@@ -196,12 +395,32 @@ sym_index symbol_table::gen_temp_var(sym_index type)
     if (temp_nr > 1000000)
         fatal("Too many temporary variables\n");
 
-    snprintf(&tmp[1], 8, "%d", temp_nr);
+    snprintf(&tmp[1], 8, "%ld", temp_nr);
 
-    pool_index pool_p = pool_install(tmp);
-    position_information *pos = new position_information(0, 0);
-    
-    return enter_variable(pos, pool_p, type);
+    sym_index sym_p = create_symbol(pool_intern(tmp, strlen(tmp)), SYM_VAR);
+    variable_symbol *var = sym_table[sym_p]->get_variable_symbol();
+    symbol *env = sym_table[env_p];
+
+    var->tag = SYM_VAR;
+    var->type = type;
+    var->level = env->level + 1;
+
+    // The temporary goes last in the block's activation record, see
+    // enter_variable().
+    if (env->tag == SYM_FUNC)
+    {
+        function_symbol *func = env->get_function_symbol();
+        var->offset = func->ar_size;
+        func->ar_size += get_size(type);
+    }
+    else
+    {
+        procedure_symbol *proc = env->get_procedure_symbol();
+        var->offset = proc->ar_size;
+        proc->ar_size += get_size(type);
+    }
+
+    return sym_p;
 }
 
 
@@ -246,140 +465,152 @@ void symbol_table::print(int detail)
     array_symbol *arr;       // Needed for safe downcasting below.
     parameter_symbol *par;   // Needed for safe downcasting below.
     constant_symbol *con;    // Needed for safe downcasting below.
+    ostream &out = *message_stream; // With the other messages.
 
     if (detail == 2)
     {
         if (pool_pos > 0)
         {
-            unsigned int pos, k;
-            unsigned int len;
-            pos = 0;
-            while (pos < strlen(string_pool))
+            long chunk, pos, k;
+            long len;
+            long printed = 0;
+
+            // Each chunk is filled up to a null char, see pool_intern().
+            for (chunk = 0; string_pool[chunk] != NULL; chunk++)
             {
-                len = (int)string_pool[pos];
-                cout << len;
-                for (k = pos + 1; k < pos + len + 1; k++)
+                char *c = string_pool[chunk];
+
+                pos = 0;
+                while (c[pos] != '\0')
                 {
-                    cout << string_pool[k];
+                    len = (unsigned char)c[pos];
+                    out << len;
+                    for (k = pos + 1; k < pos + len + 1; k++)
+                    {
+                        out << c[k];
+                    }
+                    pos += len + 1;
                 }
-                pos += len + 1;
+                printed += pos;
             }
-            cout << endl;
+            out << endl;
 
             int j;
-            // cout << string_pool << endl;
-            for (j = 0; j < pool_pos; j++)
-                cout << "-";
-            cout << "^" << " (pool_pos = " << pool_pos << ")" << endl;
+            for (j = 0; j < printed; j++)
+                out << "-";
+            out << "^" << " (pool_pos = " << pool_pos << ")" << endl;
         }
         else
-            cout << "(String pool empty)" << endl;
+            out << "(String pool empty)" << endl;
         return;
     }
 
     if (detail == 3)
     {
-        cout << "Hash table:\n";
+        out << "Hash table:\n";
         int j;
-        for (j = 0; j < MAX_HASH; j++)
+        for (j = 0; j < hash_size; j++)
         {
             if (hash_table[j])
-                cout << j << ": " << hash_table[j] << endl;
+                out << j << ": " << hash_table[j] << endl;
         }
         return;
     }
 
-    cout << endl << "Symbol table (size = " << sym_pos << "):\n";
+    out << endl << "Symbol table (size = " << sym_pos << "):\n";
 
     switch (detail)
     {
     case 1:
         // Element 0 is the global environment, "program.".
-        cout << "Pos  Name      Lev Hash Back Offs Type "
+        out << "Pos  Name      Lev Hash Back Offs Type "
              << "     Tag\n";
-        cout << "---------------------------------------"
+        out << "---------------------------------------"
              << "--------\n";
         for (i = 0; i < sym_pos + 1; i++)
         {
             tmp = sym_table[i];
             if (tmp == NULL)
             {
-                cout << i << ": " << "NULL" << endl;
+                out << i << ": " << "NULL" << endl;
                 continue;
             }
 
-            cout << setw(3) << i << ": ";
-            cout.flags(ios::left);
-            cout << setw(12) << pool_lookup(tmp->id);
-            cout.flags(ios::right);
-            cout << tmp->level
+            out << setw(3) << i << ": ";
+            out.flags(ios::left);
+            out << setw(12) << pool_view(tmp->id);
+            out.flags(ios::right);
+            out << tmp->level
                  << setw(5) << tmp->hash_link << setw(5)
                  << tmp->back_link << setw(5) << tmp->offset << " ";
 
-            cout.flags(ios::left);
-            cout << setw(10);
-            cout << pool_lookup(sym_table[tmp->type]->id);
-            cout << setw(14);
+            out.flags(ios::left);
+            out << setw(10);
+            if (tmp->type == NULL_SYM)          // An undeclared type.
+                out << "-";
+            else
+                out << pool_view(sym_table[tmp->type]->id);
+            out << setw(14);
             switch (tmp->tag)
             {
             case SYM_UNDEF:
-                cout << "SYM_UNDEF";
+                out << "SYM_UNDEF";
                 break;
             case SYM_NAMETYPE:
-                cout << "SYM_NAMETYPE";
+                out << "SYM_NAMETYPE";
                 break;
             case SYM_VAR:
-                cout << "SYM_VAR";
+                out << "SYM_VAR";
                 break;
             case SYM_PARAM:
                 par = tmp->get_parameter_symbol();
-                cout << "SYM_PARAM";
+                out << "SYM_PARAM";
                 if (par->preceding != NULL)
                 {
-                    cout << setw(7) << "prec = "
+                    out << setw(7) << "prec = "
                          << setw(12) <<
-                         pool_lookup(par->preceding->id);
+                         pool_view(par->preceding->id);
                 }
                 break;
             case SYM_PROC:
                 proc = tmp->get_procedure_symbol();
-                cout << "SYM_PROC" << setw(6) << "lbl = "
+                out << "SYM_PROC" << setw(6) << "lbl = "
                      << setw(3) << proc->label_nr << setw(9)
                      << "ar_size = " << setw(3) << proc->ar_size;
                 break;
             case SYM_FUNC:
                 func = tmp->get_function_symbol();
-                cout << "SYM_FUNC" << setw(6) << "lbl = "
+                out << "SYM_FUNC" << setw(6) << "lbl = "
                      << setw(3) << func->label_nr << setw(9)
                      << "ar_size = " << setw(3) << func->ar_size;
                 break;
             case SYM_ARRAY:
                 arr = tmp->get_array_symbol();
-                cout << "SYM_ARRAY" << setw(7) << "card = "
+                out << "SYM_ARRAY" << setw(7) << "card = "
                      << setw(4) << arr->array_cardinality;
                 break;
             case SYM_CONST:
                 con = tmp->get_constant_symbol();
                 if (con->type == integer_type)
-                    cout << "SYM_CONST" << setw(7) << "value = "
+                    out << "SYM_CONST" << setw(7) << "value = "
                          << con->const_value.ival;
                 else if (con->type == real_type)
-                    cout << "SYM_CONST" << setw(7) << "value = "
+                    out << "SYM_CONST" << setw(7) << "value = "
                          << con->const_value.rval;
                 else
-                    cout << "SYM_CONST" << setw(7) << "value = "
+                    out << "SYM_CONST" << setw(7) << "value = "
                          << "(error: bad type)";
                 break;
             }
-            cout.flags(ios::right);
-            cout << setw(0) << endl;
+            out.flags(ios::right);
+            out << setw(0) << endl;
         }
         break;
     default:
         for (i = 0; i < sym_pos + 1; i++)
         {
             tmp = sym_table[i];
-            cout << "Pos = " << i << " -----------------------------\n"
+            out << "Pos = " << i << " -----------------------------\n"
                  << tmp;
         }
         break;
@@ -409,57 +640,201 @@ char *symbol_table::capitalize(const char *s)
     return capitalized_s;
 }
 
-/* Install a string into the pool table and return its index.
-   The table is on the form <string1 length>string1<string2 length>string2...
+/* The hash_x33 algorithm, used for the intern table. */
+static unsigned int hash_x33(const char *s, int length)
+{
+    unsigned int h = 0;
+    int i;
+
+    for (i = 0; i < length; i++)
+        h = (h << 5) + h + (unsigned char)s[i];
+    return h;
+}
+
+
+/* Return the intern_table slot that holds the string s of the given length,
+   or the empty slot where it would go. Collisions are resolved by linear
+   probing, and the table is never more than half full. */
+long symbol_table::intern_slot(const char *s, int length)
+{
+    long mask = intern_size - 1;
+    long slot = hash_x33(s, length) & mask;
+
+    while (intern_table[slot] != -1)
+    {
+        pool_index p = intern_table[slot];
+
+        char *c = pool_chars(p);
+
+        if ((unsigned char)c[0] == length && !memcmp(c + 1, s, length))
+            break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+
+/* Double the size of the intern table, putting each string back in. */
+void symbol_table::grow_intern_table()
+{
+    pool_index *old_table = intern_table;
+    long old_size = intern_size;
+    long i;
+
+    intern_size *= 2;
+    intern_table = new pool_index[intern_size];
+    for (i = 0; i < intern_size; i++)
+        intern_table[i] = -1;
+
+    for (i = 0; i < old_size; i++)
+    {
+        pool_index p = old_table[i];
+
+        if (p != -1)
+            intern_table[intern_slot(pool_chars(p) + 1,
+                                     (unsigned char)*pool_chars(p))] = p;
+    }
+    delete[] old_table;
+}
+
+
+/* Return the index of the string s of the given length in the pool,
+   installing it first if it isn't there yet. The table is on the form
+   <string1 length>string1<string2 length>string2...
    Note that the null char denotes the end of the entire pool,
    NOT the separator of two strings. It is appended in pool_lookup, though.
    Snapshot:
    7INTEGER4REAL4READ5WRITE4PROG1A\0
               ^
               pool_pos
-*/
+   Each string is only stored once, so two names are the same exactly when
+   their pool indexes are. */
 
-pool_index symbol_table::pool_install(char *s)
+pool_index symbol_table::pool_intern(const char *s, int length)
 {
+    long slot;
     long old_pos;       // The return value, ie, the start of the string.
 
-    // Make sure pool is not full. If it is, double pool size.
-    if (pool_pos + (int)strlen(s) >= pool_length)
+    // This is not really a pretty solution but it works for now. Some sort
+    // struct with length/char * would be a more general solution, since this
+    // way we're limited to strings that fit within 255 bytes.
+    if (length >= 255)
     {
-        char *tmp_pool = new char[2 * pool_length]; // Tmp storage.
+        fatal("symbol_table::pool_install: Too long string");
+        return 0;
+    }
+
+    slot = intern_slot(s, length);
+    if (intern_table[slot] != -1)
+        return intern_table[slot];
 
-        pool_length *= 2;                         // Double pool size.
-        strcpy(tmp_pool, string_pool);            // Copy to tmp storage.
-        delete[] string_pool;
-        string_pool = tmp_pool;
+    // Make sure there's room for the length, the string and the null char
+    // in the current chunk. If there isn't, the string goes first in the
+    // next one. Strings never straddle two chunks, and chunks are never
+    // moved, so a pool_string stays valid.
+    if (pool_pos % POOL_CHUNK_SIZE + length + 2 > POOL_CHUNK_SIZE)
+    {
+        long chunk = pool_pos / POOL_CHUNK_SIZE + 1;
+
+        if (chunk >= MAX_POOL_CHUNKS)
+            fatal("symbol_table::pool_install: String pool full");
+        string_pool[chunk] = new char[POOL_CHUNK_SIZE];
+        pool_pos = chunk * POOL_CHUNK_SIZE;
     }
 
     old_pos = pool_pos;
 
-    // This is not really a pretty solution but it works for now. Some sort
-    // struct with length/char * would be a more general solution, since this
-    // way we're limited to strings that fit within 255 bytes.
-    if (strlen(s) >= 255)
+    // First install the length of the string, then the string itself.
+    char *c = pool_chars(pool_pos);
+    c[0] = (unsigned char)length;
+    memcpy(c + 1, s, length);
+    c[length + 1] = '\0';
+
+    // Move pool_pos to the end of the new entry.
+    pool_pos += length + 1;
+
+    intern_table[slot] = old_pos;
+    if (2 * ++intern_entries > intern_size)
+        grow_intern_table();
+
+    return old_pos;
+}
+
+
+/* Install a string into the pool table and return its index. */
+
+pool_index symbol_table::pool_install(const char *s)
+{
+    mutex_lock hold(&lock);
+    size_t length = strlen(s);
+
+    if (length >= 255)
     {
         fatal("symbol_table::pool_install: Too long string");
         return 0;
     }
+    return pool_intern(s, (int)length);
+}
 
-    // First install the length of the string.
-    string_pool[pool_pos++] = (unsigned char)strlen(s);
-    string_pool[pool_pos] = '\0';
 
-    // Add the string itself to the end of the pool.
-    strcat(string_pool, s);
+/* Install an identifier as scanned. Diesel isn't case sensitive, so it is
+   capitalized on the way, into a buffer on the stack rather than through
+   capitalize(). */
 
-    // Move pool_pos to the end of the new entry.
-    pool_pos += strlen(s);
+pool_index symbol_table::pool_install_id(const char *s, int length)
+{
+    mutex_lock hold(&lock);
+    char buf[256];
+    int i;
 
-    return old_pos;
+    if (length >= 255)
+    {
+        fatal("symbol_table::pool_install: Too long string");
+        return 0;
+    }
+
+    for (i = 0; i < length; i++)
+        buf[i] = (unsigned char)toupper(s[i]);
+    return pool_intern(buf, length);
+}
+
+
+/* Return a view of the string at a pool_index, see symtab.hh. */
+
+pool_string symbol_table::pool_view(const pool_index p)
+{
+    pool_string v;
+    char *c = pool_chars(p);  // Asserts that the pos is in range.
+
+    // p points to the char holding the length of the sought string, and the
+    // string itself follows right after it.
+    v.length = (unsigned char)c[0];
+    v.str = c + 1;
+
+    return v;
+}
+
+
+/* Print a pool string. Since it isn't null terminated we have to do the
+   padding for setw() ourselves. */
+
+ostream &operator<<(ostream &o, const pool_string &v)
+{
+    streamsize pad = o.width(0) - v.length;
+    bool left = (o.flags() & ios::adjustfield) == ios::left;
+
+    for (; !left && pad > 0; pad--)
+        o.put(o.fill());
+    o.write(v.str, v.length);
+    for (; left && pad > 0; pad--)
+        o.put(o.fill());
+
+    return o;
 }
 
 
-/* Allocate memory for and return a string given a pool_index. */
+/* Allocate memory for and return a string given a pool_index. The caller
+   must delete[] it. Use pool_view() if you don't need a copy. */
 
 char *symbol_table::pool_lookup(const pool_index p)
 {
@@ -467,14 +842,13 @@ char *symbol_table::pool_lookup(const pool_index p)
     char *s;                  // The string to be returned.
     char *start;              // The start of the string.
 
-    assert(p < pool_pos);     // Catch references to beyond last string.
-
-    start = &string_pool[p + 1]; // Start points to first char of the sought
+    start = pool_chars(p) + 1; // Start points to first char of the sought
     // string. We just use it to index the pool,
-    // it is never assigned to.
+    // it is never assigned to. pool_chars() catches references to beyond
+    // the last string.
 
     // p points to the char holding the length of the sought string.
-    i = (int)string_pool[p];
+    i = (unsigned char)start[-1];
 
     s = new char[i + 1];    // We only want to return a string of i chars, plus
     // one extra for the null terminator.
@@ -490,30 +864,8 @@ char *symbol_table::pool_lookup(const pool_index p)
 int symbol_table::pool_compare(const pool_index pool_p1,
                                const pool_index pool_p2)
 {
-    int result;                                         // Return value.
-
-    assert(pool_p1 < pool_pos && pool_p2 < pool_pos);   // Catch too large pos.
-
-    // Compare the two strings. strcmp returns 0 if they're equal.
-    result = !strcmp(pool_lookup(pool_p1), pool_lookup(pool_p2));
-    return result;
-}
-
-
-/* Remove the last entry into the string pool. */
-
-pool_index symbol_table::pool_forget(const pool_index pool_p)
-{
-    char *last_entry;
-
-    last_entry = pool_lookup(pool_p);
-
-    // Make sure that this really is the last entry.
-    assert((pool_p + (int)strlen(last_entry)) == pool_pos - 1);
-
-    pool_pos = pool_p;              // Back up pool_pos one entry.
-    string_pool[pool_pos] = '\0';   // Terminate the string pool there.
-    return pool_pos;                // Mostly useful for debugging.
+    // pool_install() never stores a string twice.
+    return pool_p1 == pool_p2;
 }
 
 
@@ -558,29 +910,17 @@ char *symbol_table::fix_string(const char *old_str)
 
 /*** Hash table methods. ***/
 
-/* Uses the hash_x33 algorithm. Returns an index into the symbol table
-   given a string. The string is probably attained using pool_lookup(). */
+/* Returns an index into the symbol table given a string. Since the pool
+   holds each string only once, the string's pool index identifies it and is
+   hashed instead of the string itself. The indexes are only a few bytes
+   apart, so they are multiplied by Knuth's constant and the top hash_bits
+   bits of the product are used: those depend on all of the index, while
+   the low bits only depend on its own low bits. */
 hash_index symbol_table::hash(const pool_index p)
 {
-    int len;                             // Length of s.
-    unsigned int h;                      // Magical hash value variable.
-    char *s;                             // Hash string. Causes memory leak.
-
-    s = pool_lookup(p);                  // Get (and allocate) the string.
-    len = (int)strlen(s);
-    h = 0;
-
-
-    while (len > 0)                      // Calculate the hash value.
-    {
-        h = (h << 5) + h + *s++;
-        len--;
-    }
+    unsigned int h = (unsigned int)p * 2654435761u;
 
-    return h % MAX_HASH;                 // Memory leak since s is still
-    //   allocated. However, since we've
-    //   changed it, delete[] s is not a
-    //   good idea at all.
+    return h >> (32 - hash_bits);
 }
 
 
@@ -594,15 +934,18 @@ sym_index symbol_table::current_environment()
 }
 
 
-/* Increase the current_level by one. */
+/* Increase the current_level by one. The new block's symbol is the last one
+   the parser installed; sym_pos won't do, since a backend thread may have
+   made a temporary since then. */
 void symbol_table::open_scope()
 {
     /*  Your code here. */
-    if(current_level == MAX_BLOCK)
+    // block_table has room for levels 0 to MAX_BLOCK - 1.
+    if(current_level == MAX_BLOCK - 1)
         fatal("Max block level reached");
 
     current_level++;
-    block_table[current_level] = sym_pos;
+    block_table[current_level] = last_installed;
 }
 
 
@@ -610,14 +953,18 @@ void symbol_table::open_scope()
 sym_index symbol_table::close_scope()
 {
     /*  Your code here. */
-    for (int i = sym_pos; i > current_environment(); i--)
+    mutex_lock hold(&lock);
+
+    for (sym_index i = sym_pos; i > current_environment(); i--)
     {
         symbol *s = get_symbol(i);
         hash_index hid = s->back_link;
 
-        if (hash_table[hid] == i)
+        // Temporaries were never linked in, see gen_temp_var().
+        if (hid != NULL_SYM && hash_table[hid] == i)
         {
             hash_table[hid] = s->hash_link;
+            hash_entries--;
         }
     }
     current_level--;
@@ -648,6 +995,104 @@ sym_index symbol_table::lookup_symbol(const pool_index pool_p)    //%% OK
 }
 
 
+/* Constructor: no chunks yet. */
+symbol_array::symbol_array()
+{
+    for (long i = 0; i < MAX_SYM_CHUNKS; i++)
+        chunks[i] = NULL;
+}
+
+
+symbol_array::~symbol_array()
+{
+    for (long i = 0; i < MAX_SYM_CHUNKS; i++)
+        delete[] chunks[i];
+}
+
+
+/* Make sure there is a chunk for the index i. Symbols are referred to by
+   their index everywhere, and the chunks are never moved, so a symbol can
+   be read without locking the symbol table. */
+void symbol_array::reserve(sym_index i)
+{
+    long chunk = i / SYM_CHUNK_SIZE;
+
+    if (chunk >= MAX_SYM_CHUNKS)
+        fatal("Symbol table full");
+    if (chunks[chunk] != NULL)
+        return;
+
+    chunks[chunk] = new symbol*[SYM_CHUNK_SIZE];
+    for (i = 0; i < SYM_CHUNK_SIZE; i++)
+        chunks[chunk][i] = NULL;
+}
+
+
+/* Move the symbols that are currently visible into a hash table of a new
+   size. The chains must keep the newest symbol first, since that is what
+   makes an inner declaration hide an outer one, so the symbols are
+   relinked oldest first. Symbols in closed scopes aren't linked anywhere,
+   and close_scope() never touches them again, so we leave them alone. */
+void symbol_table::rehash(const hash_index new_size)
+{
+    sym_index  i;
+    hash_index h;
+    char      *linked = new char[sym_pos + 1];  // Visible symbols.
+
+    for (i = 0; i <= sym_pos; i++)
+        linked[i] = 0;
+    for (h = 0; h < hash_size; h++)
+        for (i = hash_table[h]; i != NULL_SYM; i = sym_table[i]->hash_link)
+            linked[i] = 1;
+
+    delete[] hash_table;
+    hash_size = new_size;
+    for (hash_bits = 0; (1L << hash_bits) < hash_size; hash_bits++)
+        ;
+    hash_table = new sym_index[hash_size];
+    for (h = 0; h < hash_size; h++)
+        hash_table[h] = NULL_SYM;
+
+    for (i = 0; i <= sym_pos; i++)
+    {
+        if (!linked[i])
+            continue;
+        symbol *sym = sym_table[i];
+        sym->back_link = hash(sym->id);
+        sym->hash_link = hash_table[sym->back_link];
+        hash_table[sym->back_link] = i;
+    }
+
+    delete[] linked;
+}
+
+
+/* The number of symbols and temporaries so far, for the profiler. */
+long symbol_table::get_nr_symbols()
+{
+    mutex_lock hold(&lock);
+    return sym_pos + 1;
+}
+
+long symbol_table::get_nr_temps()
+{
+    mutex_lock hold(&lock);
+    return temp_nr;
+}
+
+
+/* Whether a symbol or label is one of the constructor's, see units.cc. */
+bool symbol_table::is_predefined(const sym_index sym_p)
+{
+    return sym_p != NULL_SYM && sym_p <= last_predefined;
+}
+
+bool symbol_table::is_predefined_label(const long label)
+{
+    return label < first_label;
+}
+
+
 /* Returns a symbol * given a sym_index, or NULL if no symbol found. */
 
 symbol *symbol_table::get_symbol(const sym_index sym_p)
@@ -729,6 +1174,7 @@ sym_index symbol_table::install_symbol(const pool_index pool_p,
                                        const sym_type tag)
 {
     /* Your code here */
+    mutex_lock hold(&lock);
 
     sym_index sym_id = lookup_symbol(pool_p);
 
@@ -736,52 +1182,72 @@ sym_index symbol_table::install_symbol(const pool_index pool_p,
     if (sym_id != NULL_SYM && get_symbol(sym_id)->level != current_level)
         sym_id = NULL_SYM;
 
-    symbol *sym;
     if (sym_id == NULL_SYM)
     {
+        // Keep the hash chains short. This changes what hash() returns, so
+        // it has to be done before we hash the new symbol.
+        if (hash_entries >= MAX_HASH_LOAD * hash_size)
+            rehash(2 * hash_size);
 
-        sym_pos++;
-        if (sym_pos > MAX_SYM)
-        {
-            fatal("Error: Symbol table is full");
-        }
-        sym_id = sym_pos;
-
-        switch (tag)
-        {
-        case SYM_ARRAY: sym = new array_symbol(pool_p);
-            break;
-        case SYM_CONST: sym = new constant_symbol(pool_p);
-            break;
-        case SYM_FUNC: sym = new function_symbol(pool_p);
-            break;
-        case SYM_PROC: sym = new procedure_symbol(pool_p);
-            break;
-        case SYM_VAR: sym = new variable_symbol(pool_p);
-            break;
-        case SYM_PARAM: sym = new parameter_symbol(pool_p);
-            break;
-        case SYM_NAMETYPE: sym = new nametype_symbol(pool_p);
-            break;
-        case SYM_UNDEF: assert(false);
-        }
+        sym_id = create_symbol(pool_p, tag);
 
+        symbol *sym = sym_table[sym_id];
         sym->back_link = hash(pool_p);
         sym->hash_link = hash_table[sym->back_link];
         sym->level = current_level;
-        sym->type = void_type;
-        sym->offset = 0;
 
-        sym_table[sym_pos] = sym;
         hash_table[sym->back_link] = sym_id;
+        hash_entries++;
     }
 
+    last_installed = sym_id;
+
     // Return index to the symbol we just created.
     return sym_id;
 
 }
 
 
+/* Allocate a new symbol at the end of the table and return its index. The
+   symbol isn't linked into hash_table, and its level is left for the caller.
+   The lock must be held. */
+sym_index symbol_table::create_symbol(const pool_index pool_p,
+                                      const sym_type tag)
+{
+    symbol *sym = NULL;
+
+    sym_pos++;
+    sym_table.reserve(sym_pos);
+
+    switch (tag)
+    {
+    case SYM_ARRAY: sym = new (symbols) array_symbol(pool_p);
+        break;
+    case SYM_CONST: sym = new (symbols) constant_symbol(pool_p);
+        break;
+    case SYM_FUNC: sym = new (symbols) function_symbol(pool_p);
+        break;
+    case SYM_PROC: sym = new (symbols) procedure_symbol(pool_p);
+        break;
+    case SYM_VAR: sym = new (symbols) variable_symbol(pool_p);
+        break;
+    case SYM_PARAM: sym = new (symbols) parameter_symbol(pool_p);
+        break;
+    case SYM_NAMETYPE: sym = new (symbols) nametype_symbol(pool_p);
+        break;
+    case SYM_UNDEF: assert(false);
+    }
+
+    sym->back_link = NULL_SYM;
+    sym->hash_link = NULL_SYM;
+    sym->type = void_type;
+    sym->offset = 0;
+
+    sym_table[sym_pos] = sym;
+    return sym_pos;
+}
+
+
 /* Enter a constant into the symbol table. The value is an integer. The type
    argument is a sym_index pointer to the correct type.
    This function is used from within parser.y. Currently we call using the
@@ -1104,6 +1570,7 @@ sym_index symbol_table::enter_parameter(position_information *pos,
         type_error(pos) << "Redeclaration: " << par << endl;
         return sym_p; // returns the original symbol
     }
+    par->self = sym_p;
 
     // Again we have to do some downcasting... This really looks a lot less
     // ugly in a language that doesn't differ a function from a procedure.
@@ -1,7 +1,9 @@
 #ifndef __SYMTAB_HH__
 #define __SYMTAB_HH__
 
+#include <assert.h>
 #include "error.hh"
+#include "mutex.hh"
 // Set this #define to 0 after the scanner works. 
 #define TEST_SCANNER 0
 
@@ -26,9 +28,17 @@ typedef enum symbol_types sym_type;
 
 /* Some numerical constants we use in the symbol table. */
 const block_level MAX_BLOCK = 8;            // Max allowed nesting levels.
-const hash_index  MAX_HASH = 512;           // Max size of hash table.
-const pool_index  BASE_POOL_SIZE = 1024;    // Base size of string pool.
-const sym_index   MAX_SYM = 1024;           // Max size of symbol table.
+const hash_index  BASE_HASH_SIZE = 512;     // Base size of hash table.
+const int         MAX_HASH_LOAD = 1;        // Rehash when the average chain
+                                            //   gets longer than this.
+const pool_index  POOL_CHUNK_SIZE = 65536;  // The string pool grows by
+const long        MAX_POOL_CHUNKS = 16384;  //   this much, up to this many
+                                            //   times.
+const long        BASE_INTERN_SIZE = 1024;  // Base size of intern table,
+                                            //   a power of two.
+const sym_index   SYM_CHUNK_SIZE = 1024;    // The symbol table grows by
+const long        MAX_SYM_CHUNKS = 16384;   //   this much, up to this many
+                                            //   times.
 const sym_index   NULL_SYM = -1;            // Signifies 'no symbol'.
 const int         ILLEGAL_ARRAY_CARD = -1;  // Signifies a non-int array size.
 
@@ -38,6 +48,27 @@ const int         ILLEGAL_ARRAY_CARD = -1;  // Signifies a non-int array size.
 const int MAX_TEMP_VARS = 999999;
 const int MAX_TEMP_VAR_LENGTH = 8;
 
+/* The assembler label of the main program, the first label after the
+   predefined procedures. The glue code calls it by the name diesel_main,
+   which the backends define to be this label, see codegen.cc and
+   codegen_x86.cc. The labels 0-4 of the predefined procedures themselves
+   are written out in diesel_glue.s and diesel_glue_x86.s, which must match
+   the order they are installed in the symbol_table constructor. */
+const int MAIN_PROGRAM_LABEL = 5;
+
+/* A view of a string in the string pool: a pointer to its first char and its
+   length. It is not null terminated. The pool never moves, so the view stays
+   valid. Use this instead of pool_lookup() wherever the string is just
+   hashed, compared or printed, since it doesn't allocate anything. */
+class pool_string {
+public:
+    const char *str;
+    int         length;
+};
+
+// Prints the string, honouring setw() and friends.
+ostream &operator<<(ostream &, const pool_string &);
+
 /* The various symbol classes, predefined. */
 class symbol;
 class constant_symbol;
@@ -48,18 +79,43 @@ class procedure_symbol;
 class function_symbol;
 class nametype_symbol;
 
+
+/* The table of pointers to symbols. It grows in chunks of SYM_CHUNK_SIZE
+   that never move once they have been allocated, so that a backend thread
+   can read a symbol while the parser is installing others, see pipeline.hh.
+   Otherwise it is used just like an array. */
+class symbol_array {
+private:
+    symbol     **chunks[MAX_SYM_CHUNKS];
+
+public:
+    symbol_array();
+    ~symbol_array();
+
+    void         reserve(sym_index);         // Make room for an index.
+    symbol     *&operator[](sym_index i)
+    {
+        return chunks[i / SYM_CHUNK_SIZE][i % SYM_CHUNK_SIZE];
+    }
+    symbol      *operator[](sym_index i) const
+    {
+        return chunks[i / SYM_CHUNK_SIZE][i % SYM_CHUNK_SIZE];
+    }
+};
+
+
 class symbol_table;
 
-extern symbol_table *sym_tab;      // Declared 'for real' in symtab.cc.
+extern __thread symbol_table *sym_tab; // Declared 'for real' in symtab.cc.
 
 
 
 /* Global symbol table variables. These indexes point to symbols in the symbol
    table which represent information about types. Declared "for real" in
    symbol.cc. */
-extern sym_index void_type;
-extern sym_index integer_type;
-extern sym_index real_type;
+extern __thread sym_index void_type;     // Set by the symbol_table
+extern __thread sym_index integer_type;  //   constructor and by
+extern __thread sym_index real_type;     //   compilation::bind().
 
 
 
@@ -86,7 +142,7 @@ protected:
     
     enum format_types { LONG_FORMAT, SUMMARY_FORMAT, SHORT_FORMAT };
     typedef enum format_types format_type;
-    static format_type output_format;
+    static __thread format_type output_format;
     
 public:
     pool_index   id;         // Index to the string_pool, ie, its name.
@@ -96,9 +152,16 @@ public:
     sym_index    back_link;  // Link back to the hash table. 
     block_level  level;      // Current block level, ie, nesting depth. 
     int          offset;     // Offset, used in code generation. 
+    bool         nonlocal_use; // Used from an inner block, see regalloc.hh.
 
     // Constructor.
     symbol(pool_index);
+
+    // Symbols are allocated in the arena of their symbol table, and freed
+    // with it.
+    void *operator new(size_t size, arena &a) { return a.allocate(size); }
+    void operator delete(void *) {}
+    void operator delete(void *, arena &) {}
   
     // Currently lacks print method/operator.
     // Currently lacks some other needed stuff like conversions to and
@@ -201,6 +264,7 @@ protected:
 public:
     int               size;          // Nr of bytes parameter needs.
     parameter_symbol *preceding;     // Link to preceding parameter, if any.
+    sym_index         self;          // Its own index in the symbol table.
 
     // Constructor. Args: identifier.
     parameter_symbol(const pool_index);
@@ -303,15 +367,30 @@ ostream& operator<<(ostream&, symbol *);
 */
 class symbol_table {
 private:
+    // --- Locking. ---
+    pthread_mutex_t lock;                     // Held while anything is
+                                              //   installed, since the
+                                              //   backend threads of -J
+                                              //   make temps and labels.
+
     // --- String pool variables. ---
-    char         *string_pool;                // The actual string pool.
-    long          pool_length;                // Keep track of dynamic
-                                              //   pool size.
+    char        **string_pool;                // The actual string pool, in
+                                              //   chunks that never move.
     long          pool_pos;                   // Points to end of string
                                               //   pool.
+    pool_index   *intern_table;               // Open addressed table of the
+                                              //   strings in the pool, so
+                                              //   each is only stored once.
+    long          intern_size;                // Its size, a power of two.
+    long          intern_entries;             // Nr of strings in it.
 
     // --- Hash table variables. ---
     sym_index    *hash_table;                 // The actual hash table.
+    hash_index    hash_size;                  // Keep track of dynamic
+                                              //   hash table size.
+    int           hash_bits;                  // log2(hash_size).
+    long          hash_entries;               // Nr of symbols currently
+                                              //   linked into hash_table.
 
     // --- Display variables. ---
     block_level   current_level;              // Current nesting depth.
@@ -321,15 +400,41 @@ private:
                                               //   scope/block.
 
     // --- Symbol table variables. ---
-    symbol      **sym_table;                  // The actual symbol table.
+    symbol_array  sym_table;                  // The actual symbol table.
     sym_index     sym_pos;                    // Points to last symbol
                                               //   entered in the table.
+    sym_index     last_installed;             // The last symbol the parser
+                                              //   installed, see
+                                              //   open_scope().
+    arena         symbols;                    // Where the symbols are.
     int           label_nr;                   // Assembler label counter.
+    sym_index     last_predefined;            // The last symbol and the
+    int           first_label;                //   first free label after
+                                              //   the constructor.
     long          temp_nr;                    // Temp variable counter.
+
+    sym_index     create_symbol(const pool_index, // A new symbol, not
+                                const sym_type);  //   linked into
+                                                  //   hash_table.
+    void          rehash(const hash_index);   // Resize the hash table.
+    pool_index    pool_intern(const char *,   // Find or install a string
+                              int);           //   of the given length.
+    long          intern_slot(const char *,   // The intern_table slot of a
+                              int);           //   string, or the free one
+                                              //   where it belongs.
+    void          grow_intern_table();        // Double the intern table.
+    char         *pool_chars(const pool_index p) // Where a pool entry is.
+    {
+        assert(p >= 0 && string_pool[p / POOL_CHUNK_SIZE] != NULL);
+        return &string_pool[p / POOL_CHUNK_SIZE][p % POOL_CHUNK_SIZE];
+    }
     
 public:
     // NOTE: Some of these methods should be made private. 
     symbol_table();                           // Constructor.
+    symbol_table(const symbol_table &);       // Copy a pristine one, see
+                                              //   compilation.hh.
+    ~symbol_table();                          // Destructor.
 
     // --- Utility methods. ---
     int           ieee(float);                // Convert float to ieee 32-bit
@@ -337,14 +442,20 @@ public:
     int           get_size(const sym_index);  // Return type byte size.
   
     // --- String pool methods. ---
-    pool_index    pool_install(char *);        // Install a string in the pool.
+    pool_index    pool_install(const char *);  // Install a string in the pool,
+                                               //   or return the index it
+                                               //   already has there.
+    pool_index    pool_install_id(const char *,   // Same for an identifier
+                                  int);           //   of the given length,
+                                                  //   which is capitalized.
     char         *pool_lookup(const pool_index);  // pool_index -> string.
+                                                  //   Allocates a copy.
+    pool_string   pool_view(const pool_index);    // pool_index -> view. Does
+                                                  //   not allocate.
     int           pool_compare(const pool_index,  // Compare strings: Return 1 
 			       const pool_index); //   if equal, 0 if not.
                                               
                                               
-    pool_index    pool_forget(const pool_index); // Remove last entry from
-                                                 //   string pool.
     char         *fix_string(const char *);      // Remove double '' in
                                                  //   strings constants.
                                                  //   Args are dst, src.
@@ -380,10 +491,23 @@ public:
     void          set_symbol_type(const sym_index,
 				  const sym_index);
 
-    // These methods are used in quads.cc.
+    // These methods are used in quads.cc. They may also be called from the
+    // backend threads, see pipeline.hh, but those have to give the block
+    // a temporary belongs to, since it is no longer the current one.
     long          get_next_label();           // Generate next asm label.
     sym_index     gen_temp_var(sym_index);    // Generate, install and return
                                               // sym_index to next temp var.
+    sym_index     gen_temp_var(sym_index,     // The same, for the block
+                               sym_index);    //   given as second arg.
+
+    // These are used by the compile-time profiler, see profile.cc.
+    long          get_nr_symbols();
+    long          get_nr_temps();
+
+    // Whether a symbol or a label was installed by the constructor, and so
+    // is the same in every symbol table. Used by units.cc.
+    bool          is_predefined(const sym_index);
+    bool          is_predefined_label(const long);
     
     // These functions are used to enter identifiers into the symbol table,
     // depending on their context (function, constant, etc).
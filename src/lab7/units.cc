@@ -0,0 +1,392 @@
+#include <ctype.h>
+#include <sstream>
+#include "units.hh"
+#include "preprocess.hh"
+#include "pipeline.hh"
+#include "codegen.hh"
+#include "mutex.hh"
+
+/*** This file contains the include unit cache. See units.hh. ***/
+
+
+extern int assembler_trace;         // All these defined in main.cc.
+extern int print_ast;
+extern int print_quads;
+extern int no_typecheck;
+extern int no_optimize;
+extern int no_quads;
+extern int no_assembler;
+extern int no_register_allocation;
+extern int target_x86;
+extern int sparc_v8;
+extern int short_circuit;
+extern int interpret;
+
+// Shared by all compilations in the process.
+unit_cache compiled_units;
+
+// The unit compiler of the compilation on this thread, see compilation.hh.
+__thread unit_compiler *units = NULL;
+
+
+/* Constructor. */
+include_unit::include_unit()
+{
+    file = NULL;
+    outer = NULL;
+    recording = false;
+    reusable = true;
+    first_symbol = NULL_SYM;
+    level = 0;
+}
+
+
+/* Destructor. */
+include_unit::~include_unit()
+{
+    if (file != NULL)
+        fclose(file);
+}
+
+
+
+/* Constructor. */
+unit_cache::unit_cache()
+{
+    pthread_mutex_init(&lock, NULL);
+}
+
+
+/* Destructor. */
+unit_cache::~unit_cache()
+{
+    map<string, include_unit *>::iterator i;
+
+    for (i = units.begin(); i != units.end(); i++)
+        delete i->second;
+    pthread_mutex_destroy(&lock);
+}
+
+
+/* The unit with the given key, or NULL. */
+include_unit *unit_cache::find(const string &key)
+{
+    mutex_lock hold(&lock);
+
+    map<string, include_unit *>::iterator i = units.find(key);
+    if (i == units.end())
+        return NULL;
+    return i->second;
+}
+
+
+/* Keep a unit. Two compilations may have compiled the same one at once, and
+   then the first one is kept. */
+void unit_cache::add(include_unit *unit)
+{
+    mutex_lock hold(&lock);
+
+    if (units.find(unit->key) != units.end())
+    {
+        delete unit;
+        return;
+    }
+    units[unit->key] = unit;
+}
+
+
+
+/* The name of a symbol, as a string. */
+static string symbol_name(sym_index sym_p)
+{
+    pool_string name = sym_tab->pool_view(sym_tab->get_symbol_id(sym_p));
+    return string(name.str, name.length);
+}
+
+
+/* The code of a unit, with its labels renumbered: the label of one of its
+   routines gets the one the routine has now, and the others new ones. The
+   predefined routines' labels are the same in every compilation. */
+static string relabel(const string &code, map<long, long> &labels)
+{
+    string text;
+    size_t i = 0;
+    char   number[32];
+
+    text.reserve(code.size());
+    while (i < code.size())
+    {
+        size_t end = i + 1;
+        long   label = 0;
+
+        if (code[i] != 'L' || (i > 0 && (isalnum(code[i - 1]) ||
+                                         code[i - 1] == '_')))
+        {
+            text += code[i++];
+            continue;
+        }
+        while (end < code.size() && isdigit(code[end]))
+            label = 10 * label + code[end++] - '0';
+        if (end == i + 1 ||
+            (end < code.size() && (isalnum(code[end]) || code[end] == '_')))
+        {
+            text += code[i++];
+            continue;
+        }
+
+        if (!sym_tab->is_predefined_label(label))
+        {
+            if (labels.find(label) == labels.end())
+                labels[label] = sym_tab->get_next_label();
+            label = labels[label];
+        }
+        snprintf(number, sizeof(number), "L%ld", label);
+        text += number;
+        i = end;
+    }
+    return text;
+}
+
+
+
+/* Constructor. */
+unit_compiler::unit_compiler()
+{
+    recording = NULL;
+}
+
+
+
+/* Units are only reused, or recorded, when they are compiled all the way
+   to assembler, and nothing about them is to be printed. */
+bool unit_compiler::can_reuse()
+{
+    return error_count == 0 && !interpret && !no_quads && !no_assembler &&
+        !print_ast && !print_quads;
+}
+
+
+
+/* The part of a unit's key that comes from where it is included. */
+string unit_compiler::context()
+{
+    ostringstream key;
+
+    key << "level " << sym_tab->get_symbol(sym_tab->current_environment())
+        ->level + 1
+        << ", options " << target_x86 << sparc_v8 << assembler_trace
+        << no_typecheck << no_optimize << no_register_allocation
+        << short_circuit;
+    return key.str();
+}
+
+
+
+/* Whether the predefined symbols the unit used are what the names mean
+   here too: whoever includes it may have declared one of them again. */
+bool unit_compiler::same_predefined(include_unit *compiled)
+{
+    map<string, sym_index>::iterator i;
+
+    for (i = compiled->predefined.begin(); i != compiled->predefined.end(); i++)
+    {
+        pool_index id = sym_tab->pool_install(i->first.c_str());
+        if (sym_tab->lookup_symbol(id) != i->second)
+            return false;
+    }
+    return true;
+}
+
+
+
+/* Install a compiled unit's routines, as if it had been compiled here, and
+   write out its code. The symbols within the routines aren't needed, so
+   they aren't installed. */
+void unit_compiler::install(include_unit *compiled, position_information *pos)
+{
+    map<long, long> labels;
+
+    for (unsigned i = 0; i < compiled->routines.size(); i++)
+    {
+        unit_routine &routine = compiled->routines[i];
+        pool_index    id = sym_tab->pool_install(routine.name.c_str());
+        int           errors = error_count;
+        sym_index     sym_p;
+
+        if (routine.tag == SYM_FUNC)
+            sym_p = sym_tab->enter_function(pos, id);
+        else
+            sym_p = sym_tab->enter_procedure(pos, id);
+        if (error_count != errors)      // Declared already.
+            continue;
+
+        sym_tab->open_scope();
+        for (unsigned p = 0; p < routine.param_names.size(); p++)
+            sym_tab->enter_parameter(pos,
+                                     sym_tab->pool_install(
+                                         routine.param_names[p].c_str()),
+                                     routine.param_types[p]);
+        sym_tab->close_scope();
+
+        symbol *sym = sym_tab->get_symbol(sym_p);
+        if (routine.tag == SYM_FUNC)
+        {
+            function_symbol *func = sym->get_function_symbol();
+            sym_tab->set_symbol_type(sym_p, routine.type);
+            func->ar_size = routine.ar_size;
+            labels[routine.label_nr] = func->label_nr;
+        }
+        else
+        {
+            procedure_symbol *proc = sym->get_procedure_symbol();
+            proc->ar_size = routine.ar_size;
+            labels[routine.label_nr] = proc->label_nr;
+        }
+    }
+
+    // The code goes after that of the blocks before the unit.
+    pipeline->write_out();
+    code_gen->write_code(relabel(compiled->code, labels));
+}
+
+
+
+/* Record the routines a unit declared at its own level, which are all that
+   those who include it see. */
+void unit_compiler::record_routines(include_unit *unit)
+{
+    long nr_symbols = sym_tab->get_nr_symbols();
+
+    for (sym_index i = unit->first_symbol; i < nr_symbols; i++)
+    {
+        symbol           *sym = sym_tab->get_symbol(i);
+        parameter_symbol *param;
+        unit_routine      routine;
+
+        if (sym->level != unit->level)
+            continue;
+        if (sym->tag == SYM_FUNC)
+        {
+            function_symbol *func = sym->get_function_symbol();
+            routine.ar_size = func->ar_size;
+            routine.label_nr = func->label_nr;
+            param = func->last_parameter;
+        }
+        else if (sym->tag == SYM_PROC)
+        {
+            procedure_symbol *proc = sym->get_procedure_symbol();
+            routine.ar_size = proc->ar_size;
+            routine.label_nr = proc->label_nr;
+            param = proc->last_parameter;
+        }
+        else
+            continue;
+
+        routine.name = symbol_name(i);
+        routine.tag = sym->tag;
+        routine.type = sym->type;
+
+        // The parameters are linked last first.
+        for (; param != NULL; param = param->preceding)
+        {
+            pool_string name = sym_tab->pool_view(param->id);
+            routine.param_names.insert(routine.param_names.begin(),
+                                       string(name.str, name.length));
+            routine.param_types.insert(routine.param_types.begin(),
+                                       param->type);
+        }
+        unit->routines.push_back(routine);
+    }
+}
+
+
+
+/* The parser has come to an #include. If the unit has been compiled before
+   in the same context, it is installed, and the scanner skips it. If not,
+   the scanner reads it, and it is recorded for the next time. */
+void unit_compiler::begin(include_unit *unit, position_information *pos)
+{
+    if (!can_reuse())
+    {
+        preproc->read_unit(unit);
+        return;
+    }
+
+    unit->level = sym_tab->get_symbol(sym_tab->current_environment())
+        ->level + 1;
+    unit->key += context();
+
+    include_unit *compiled = compiled_units.find(unit->key);
+    if (compiled != NULL && same_predefined(compiled))
+    {
+        install(compiled, pos);
+        *message_stream << "Reusing the code compiled for \"" << unit->name
+                        << "\"" << endl;
+        preproc->skip_unit(unit, compiled);
+        return;
+    }
+
+    // The blocks before the unit must be written out first, so that the
+    // unit's code is all that is captured.
+    pipeline->write_out();
+    unit->recording = true;
+    unit->outer = recording;
+    unit->first_symbol = sym_tab->get_nr_symbols();
+    recording = unit;
+    code_gen->capture_code(&unit->code);
+    preproc->read_unit(unit);
+}
+
+
+
+/* The end of a unit. One that was compiled, and can be reused, is kept in
+   the cache. */
+void unit_compiler::end(include_unit *unit)
+{
+    if (!unit->recording)
+    {
+        delete unit;
+        return;
+    }
+
+    pipeline->write_out();
+    recording = unit->outer;
+    if (recording != NULL)
+    {
+        recording->code += unit->code;
+        code_gen->capture_code(&recording->code);
+    }
+    else
+        code_gen->capture_code(NULL);
+
+    if (error_count > 0 || !unit->reusable)
+    {
+        delete unit;
+        return;
+    }
+    record_routines(unit);
+    unit->recording = false;
+    unit->outer = NULL;
+    compiled_units.add(unit);
+}
+
+
+
+/* The parser looked up a symbol. A unit that uses its includer's symbols
+   can't be reused, and for the predefined ones the names are checked when
+   it is, see same_predefined(). */
+void unit_compiler::use(sym_index sym_p)
+{
+    if (sym_p == NULL_SYM)
+        return;
+
+    for (include_unit *unit = recording; unit != NULL; unit = unit->outer)
+    {
+        if (sym_p >= unit->first_symbol)
+            continue;
+        if (sym_tab->is_predefined(sym_p))
+            unit->predefined[symbol_name(sym_p)] = sym_p;
+        else
+            unit->reusable = false;
+    }
+}
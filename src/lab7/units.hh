@@ -0,0 +1,122 @@
+#ifndef __UNITS_HH__
+#define __UNITS_HH__
+
+
+#include <stdio.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "symtab.hh"
+using namespace std;
+
+
+/* A #define or #undef, see preprocess.hh. */
+class macro_change {
+public:
+    string name;
+    string value;
+    bool   defined;                     // False for an #undef.
+};
+
+
+/* A procedure or function of an include unit, as those who include it see
+   it: the symbol and its parameters. */
+class unit_routine {
+public:
+    string            name;
+    sym_type          tag;              // SYM_PROC or SYM_FUNC.
+    sym_index         type;             // The return type of a function.
+    int               ar_size;
+    long              label_nr;         // As in the unit's code.
+    vector<string>    param_names;      // In the order they are declared.
+    vector<sym_index> param_types;
+};
+
+
+/* A file brought in with #include. Diesel includes are units of procedures
+   and functions, so they may only appear where those are declared, and the
+   grammar sees the whole unit as one declaration: T_INCLUDE, the unit's
+   own declarations and T_UNIT_END. The scanner makes an include_unit for
+   the #include (see preprocessor::include()), then the parser asks
+   unit_compiler::begin() whether it has been compiled before.
+
+   A unit that is compiled is recorded as well: its procedures and
+   functions, the #defines it made and the assembler it gave. The next
+   compilation in the process (see compile_batch()) that includes the same
+   file, in the same context, just installs the symbols and writes out the
+   code, with the labels renumbered, instead of compiling it again.
+
+   A unit can only be reused if it doesn't depend on where it is included:
+   the key is made from the contents of the file and of the files it
+   includes, and where those were found (see preprocessor::file_key()), the
+   macros that are defined, the block level and the options that affect
+   the code, and a unit that uses any symbol of its includer, other than
+   the predefined ones, isn't kept at all. */
+class include_unit {
+public:
+    // Set by the preprocessor.
+    string               name;          // As written in the #include.
+    string               path;          // The file that was found.
+    FILE                *file;          // Open, until read or skipped.
+    string               key;           // See unit_compiler::begin().
+
+    // Recorded while the unit is compiled.
+    include_unit        *outer;         // The unit it is part of, if any.
+    bool                 recording;
+    bool                 reusable;      // Cleared by unit_compiler::use().
+    sym_index            first_symbol;  // The first one it installed.
+    block_level          level;         // Where its routines are.
+    vector<unit_routine> routines;
+    vector<macro_change> macros;        // What it #defined and #undefined.
+    map<string, sym_index> predefined;  // The predefined names it used.
+    string               code;          // The assembler for all of it.
+
+    include_unit();
+    ~include_unit();
+};
+
+
+/* The units compiled so far, in any compilation in the process. Once a
+   unit is in the cache it is never changed, so the compilations on other
+   threads can read it without locking. */
+class unit_cache {
+private:
+    pthread_mutex_t               lock; // For units.
+    map<string, include_unit *>   units;
+
+public:
+    unit_cache();
+    ~unit_cache();
+
+    include_unit *find(const string &key);
+    void          add(include_unit *);  // Takes it over.
+};
+
+extern unit_cache compiled_units;       // Defined in units.cc.
+
+
+/* This class takes care of the include units of one compilation. parser.y
+   calls begin() and end() around each of them, and use() for every
+   identifier it looks up. */
+class unit_compiler {
+private:
+    include_unit *recording;            // The innermost unit recorded.
+
+    bool          can_reuse();
+    string        context();
+    bool          same_predefined(include_unit *);
+    void          install(include_unit *, position_information *);
+    void          record_routines(include_unit *);
+
+public:
+    unit_compiler();
+
+    void          begin(include_unit *, position_information *);
+    void          end(include_unit *);
+    void          use(sym_index);
+};
+
+extern __thread unit_compiler *units; // Defined in units.cc.
+
+#endif